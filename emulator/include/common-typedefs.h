@@ -0,0 +1,17 @@
+/*
+ * common-typedefs.h for the native emulator
+ */
+
+#ifndef __COMMON_TYPEDEFS_H__
+#define __COMMON_TYPEDEFS_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+
+typedef uint32_t *address_t;
+
+#ifndef UINT32_MAX
+#define UINT32_MAX            0xFFFFFFFF
+#endif
+
+#endif /* __COMMON_TYPEDEFS_H__ */
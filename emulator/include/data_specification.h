@@ -0,0 +1,14 @@
+/*
+ * data_specification.h for the native emulator - the regions come from the machine image
+ */
+
+#ifndef __DATA_SPECIFICATION_H__
+#define __DATA_SPECIFICATION_H__
+
+#include "common-typedefs.h"
+
+address_t data_specification_get_data_address(void);
+bool data_specification_read_header(address_t data_address);
+address_t data_specification_get_region(uint32_t region, address_t data_address);
+
+#endif /* __DATA_SPECIFICATION_H__ */
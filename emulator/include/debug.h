@@ -0,0 +1,22 @@
+/*
+ * debug.h for the native emulator - the log goes to the core's iobuf like on the board
+ */
+
+#ifndef __DEBUG_H__
+#define __DEBUG_H__
+
+#include "spin1_api.h"
+
+#define log_error(message, ...) \
+    io_printf(IO_BUF, "[ERROR]   (%s: %d): \t" message "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+#define log_warning(message, ...) \
+    io_printf(IO_BUF, "[WARNING] (%s: %d): \t" message "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+#define log_info(message, ...) \
+    io_printf(IO_BUF, "[INFO]    (%s: %d): \t" message "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+
+#define log_debug(message, ...) \
+    do {} while (0)
+
+#endif /* __DEBUG_H__ */
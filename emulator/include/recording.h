@@ -0,0 +1,17 @@
+/*
+ * recording.h for the native emulator - recorded data is kept per channel and written
+ * to the output directory when the run ends
+ */
+
+#ifndef __RECORDING_H__
+#define __RECORDING_H__
+
+#include "common-typedefs.h"
+
+bool recording_initialize(address_t recording_data_address, uint32_t *recording_flags);
+bool recording_record(uint8_t channel, void *data, uint32_t size_bytes);
+void recording_finalise(void);
+void recording_do_timestep_update(uint32_t time);
+void recording_reset(void);
+
+#endif /* __RECORDING_H__ */
@@ -0,0 +1,28 @@
+/*
+ * simulation.h for the native emulator - the run length comes from the machine image,
+ * a paused core stays paused until the run ends
+ */
+
+#ifndef __SIMULATION_H__
+#define __SIMULATION_H__
+
+#include "common-typedefs.h"
+
+#ifndef APPLICATION_NAME_HASH
+#define APPLICATION_NAME_HASH 0
+#endif
+
+typedef void (*prepare_resume_callback_t)(void);
+
+bool simulation_initialise(
+        address_t address, uint32_t expected_application_magic_number,
+        uint32_t *timer_period, uint32_t *simulation_ticks_pointer,
+        uint32_t *infinite_run_pointer, int sdp_packet_callback_priority,
+        int dma_transfer_done_callback_priority);
+void simulation_run(void);
+void simulation_handle_pause_resume(prepare_resume_callback_t callback);
+void simulation_exit(void);
+void simulation_sdp_callback_on(uint sdp_port, void (*callback)(uint, uint));
+void simulation_sdp_callback_off(uint sdp_port);
+
+#endif /* __SIMULATION_H__ */
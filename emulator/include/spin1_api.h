@@ -0,0 +1,255 @@
+/*
+ * spin1_api.h for the native emulator
+ *
+ * Declares the part of the spin1 API, SARK and the hardware registers that the
+ * applications use, with the values of the real headers. Everything a core owns on the
+ * chip (sv, sark, the timer registers) is reached through a function of the emulator,
+ * so the application sources compile unchanged while every emulated core sees its own.
+ */
+
+#ifndef __SPIN1_API_H__
+#define __SPIN1_API_H__
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdlib.h>
+#include <string.h>
+
+// ------------------------------------------------------------------------
+// types
+// ------------------------------------------------------------------------
+
+typedef unsigned int   uint;
+typedef unsigned short ushort;
+typedef unsigned char  uchar;
+
+typedef void (*callback_t) (uint, uint);
+
+#ifndef TRUE
+#define TRUE                  (0 == 0)
+#define FALSE                 (0 != 0)
+#endif
+
+#define SUCCESS               1
+#define FAILURE               0
+
+// ------------------------------------------------------------------------
+// events and priorities
+// ------------------------------------------------------------------------
+
+#define MC_PACKET_RECEIVED    0
+#define DMA_TRANSFER_DONE     1
+#define TIMER_TICK            2
+#define SDP_PACKET_RX         3
+#define USER_EVENT            4
+#define MCPL_PACKET_RECEIVED  5
+#define NUM_EVENTS            6
+
+// priority -1 is the FIQ, 0 runs straight away, 1 .. NUM_PRIORITIES - 1 are queued
+#define NUM_PRIORITIES        5
+
+#define NO_PAYLOAD            0
+#define WITH_PAYLOAD          1
+
+#define SYNC_NOWAIT           0
+#define SYNC_WAIT             1
+
+// ------------------------------------------------------------------------
+// SDP
+// ------------------------------------------------------------------------
+
+#define SDP_BUF_SIZE          256
+#define PORT_SHIFT            5
+#define PORT_ETH              (7 << PORT_SHIFT)
+
+typedef struct sdp_msg {
+    struct sdp_msg *next;
+    ushort length;
+    ushort checksum;
+
+    uchar flags;
+    uchar tag;
+    uchar dest_port;
+    uchar srce_port;
+    ushort dest_addr;
+    ushort srce_addr;
+
+    ushort cmd_rc;
+    ushort seq;
+    uint arg1;
+    uint arg2;
+    uint arg3;
+
+    uchar data[SDP_BUF_SIZE];
+    uint __PAD1;
+} sdp_msg_t;
+
+typedef struct {
+    uchar flags;
+    uchar tag;
+    uchar dest_port;
+    uchar srce_port;
+    ushort dest_addr;
+    ushort srce_addr;
+} sdp_hdr_t;
+
+typedef struct {
+    ushort cmd_rc;
+    ushort seq;
+    uint arg1;
+    uint arg2;
+    uint arg3;
+} cmd_hdr_t;
+
+// ------------------------------------------------------------------------
+// SARK
+// ------------------------------------------------------------------------
+
+typedef struct heap_t heap_t;
+
+typedef struct {
+    heap_t *sdram_heap;
+    heap_t *sysram_heap;
+    void *sysram_base;
+    void *sdram_base;
+    ushort p2p_addr;
+    ushort eth_addr;
+    ushort board_addr;
+    uint clock_ms;
+} sv_t;
+
+typedef struct {
+    uint user0;
+    uint user1;
+    uint user2;
+    uint user3;
+} vcpu_t;
+
+typedef struct {
+    vcpu_t *vcpu;
+    heap_t *heap;
+    uint virt_cpu;
+    uint phys_cpu;
+} sark_t;
+
+#define ALLOC_LOCK            1
+#define ALLOC_ID              2
+
+#define RTE_NONE              0
+#define RTE_RESET             1
+#define RTE_UNDEF             2
+#define RTE_SVC               3
+#define RTE_PABT              4
+#define RTE_DABT              5
+#define RTE_IRQ               6
+#define RTE_FIQ               7
+#define RTE_VIC               8
+#define RTE_ABORT             9
+#define RTE_MALLOC            10
+#define RTE_DIV0              11
+#define RTE_EVENT             12
+#define RTE_SWERR             13
+#define RTE_IOBUF             14
+#define RTE_ENABLE            15
+#define RTE_NULL              16
+#define RTE_PKT               17
+#define RTE_TIMER             18
+#define RTE_API               19
+
+#define IO_STD                ((char *) 0)
+#define IO_DBG                ((char *) 1)
+#define IO_BUF                ((char *) 2)
+#define IO_NULL               ((char *) 3)
+
+#define SPINN_SDRAM_BASE      (spin1_emu_sv()->sdram_base)
+
+#define use(x)                do {} while ((x) != (x))
+
+sv_t *spin1_emu_sv(void);
+sark_t *spin1_emu_sark(void);
+uint spin1_emu_lead_ap(void);
+volatile uint *spin1_emu_tc(void);
+
+// the emulator itself keeps these as fields of its chips and cores
+#ifndef SPIN1_EMULATOR
+#define sv                    (spin1_emu_sv())
+#define sark                  (*spin1_emu_sark())
+#define leadAp                (spin1_emu_lead_ap())
+#endif
+
+void *sark_xalloc(heap_t *heap, uint size, uint tag, uint flag);
+void sark_xfree(heap_t *heap, void *ptr, uint flag);
+uint sark_heap_max(heap_t *heap, uint flag);
+void *sark_alloc(uint count, uint size);
+void sark_free(void *ptr);
+void rt_error(uint code, ...);
+void io_printf(char *stream, char *format, ...);
+char *itoa(int value, char *buffer, int base);
+
+// ------------------------------------------------------------------------
+// timers - every read of tc[] refreshes the counters from the core's cpu time
+// ------------------------------------------------------------------------
+
+#define T1_LOAD               0
+#define T1_COUNT              1
+#define T1_CONTROL            2
+#define T1_INT_CLR            3
+#define T1_RAW_INT            4
+#define T1_MASK_INT           5
+#define T1_BG_LOAD            6
+#define T2_LOAD               8
+#define T2_COUNT              9
+#define T2_CONTROL            10
+#define T2_INT_CLR            11
+#define T2_RAW_INT            12
+#define T2_MASK_INT           13
+#define T2_BG_LOAD            14
+
+#ifndef SPIN1_EMULATOR
+#define tc                    (spin1_emu_tc())
+#endif
+
+// ------------------------------------------------------------------------
+// spin1 API
+// ------------------------------------------------------------------------
+
+uint spin1_start(uint sync);
+void spin1_exit(uint error);
+void spin1_set_timer_tick(uint time);
+uint spin1_get_simulation_time(void);
+
+void spin1_callback_on(uint event_id, callback_t cback, int priority);
+void spin1_callback_off(uint event_id);
+uint spin1_schedule_callback(callback_t cback, uint arg0, uint arg1, uint priority);
+uint spin1_trigger_user_event(uint arg0, uint arg1);
+
+uint spin1_send_mc_packet(uint key, uint data, uint load);
+uint spin1_send_sdp_msg(sdp_msg_t *msg, uint timeout);
+sdp_msg_t *spin1_msg_get(void);
+void spin1_msg_free(sdp_msg_t *msg);
+
+void spin1_delay_us(uint n);
+uint spin1_get_id(void);
+uint spin1_get_core_id(void);
+uint spin1_get_chip_id(void);
+uchar spin1_get_leds(void);
+void spin1_set_leds(uchar leds);
+
+void spin1_memcpy(void *dst, void const *src, uint len);
+void *spin1_malloc(uint bytes);
+
+// the C heap of the application is the heap of its core, so its peak can be measured
+void *spin1_emu_malloc(size_t bytes);
+void spin1_emu_free(void *ptr);
+
+#ifndef SPIN1_EMULATOR
+#define malloc(bytes)         spin1_emu_malloc(bytes)
+#define free(ptr)             spin1_emu_free(ptr)
+#endif
+
+uint spin1_irq_disable(void);
+uint spin1_fiq_disable(void);
+uint spin1_int_disable(void);
+void spin1_mode_restore(uint status);
+
+#endif /* __SPIN1_API_H__ */
@@ -0,0 +1,759 @@
+/*
+ * emulator.c - runs a SpiNNaker application on the cores of a machine image, natively
+ *
+ *     emulator [options] application.so machine.spem output_directory
+ *
+ *     -r factor   real time: a tick every timer period times factor (0.5 - twice as fast);
+ *                 without it the next tick starts once every core has gone idle
+ *     -t ticks    ticks to run (default: the run length of the image, plus the tick in
+ *                 which the cores see that the run is over)
+ *     -q packets  packets a core may have waiting (default 4096)
+ *     -Q tasks    room of every queued priority (default 16, like the spin1 API)
+ *     -v          statistics of every core
+ *     -s file     statistics of every core as csv: busy time in callbacks, peak heap (with
+ *                 the block headers of the SARK heap), tick and time of its last packet
+ *     -R x,y,p:capture
+ *                 replay: only core x, y, p runs and gets the packets of capture (its capture
+ *                 region, see utilities/replay.py) in the ticks it handled them in, whatever
+ *                 it sends goes nowhere - lockstep only
+ *     -S file     SDP messages of the host (see utilities/emulation.py), each handed to its core
+ *                 once the run has reached its tick - what the cores send back over SDP goes
+ *                 to <x>_<y>_<p>.sdp in the output directory
+ *
+ * Every core gets a private copy of application.so (loaded from a memfd), so the globals of
+ * the unchanged application source belong to one core, and runs c_main on a thread of its own.
+ * Packets go through the routing table of the image into lock-free queues of the target cores.
+ * Each core leaves its recordings (<x>_<y>_<p>_<channel>.rec), its iobuf (<x>_<y>_<p>.iobuf)
+ * and its regions as the run left them (<x>_<y>_<p>.regions) in the output directory.
+ *
+ * Machine image (little endian 32 bit words, see utilities/emulation.py):
+ *     magic "SPEM", version, cores, routes, run ticks (0 - forever)
+ *     per core:  x, y, p, regions, then per region: reserved bytes, written bytes, data
+ *                (padded to a word)
+ *     per route: key, mask, targets, then the index of every target core
+ *
+ * SDP messages (little endian 32 bit words, in the order of their ticks):
+ *     tick, x, y, p, port, length of the message from its SDP header on, then the command
+ *     header and the data (length - 8 bytes, padded to a word)
+ */
+
+#define _GNU_SOURCE
+
+#include "emulator.h"
+
+#include <dlfcn.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+#define IMAGE_MAGIC           0x4D455053
+#define IMAGE_VERSION         1
+
+emulator_t emulator;
+
+// ------------------------------------------------------------------------
+// shared by the cores
+// ------------------------------------------------------------------------
+
+void work_add(long count) {
+    atomic_fetch_add(&emulator.work, count);
+}
+
+void work_done(long count) {
+
+    if (count > 0 && atomic_fetch_sub(&emulator.work, count) == count) {
+        pthread_mutex_lock(&emulator.lock);
+        pthread_cond_signal(&emulator.idle);
+        pthread_mutex_unlock(&emulator.lock);
+    }
+}
+
+void wake_core(core_t *core) {
+
+    atomic_thread_fence(memory_order_seq_cst);
+    if (atomic_exchange(&core->sleeping, 0)) {
+        sem_post(&core->wake);
+    }
+}
+
+//! the first entry that matches wins, like in the router
+route_t *find_route(uint key) {
+
+    for (uint i = 0; i < emulator.num_routes; i++) {
+        if ((key & emulator.routes[i].mask) == emulator.routes[i].key) {
+            return &emulator.routes[i];
+        }
+    }
+
+    return NULL;
+}
+
+double elapsed_us(void) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_REALTIME, &now);
+
+    return (now.tv_sec - emulator.start_time.tv_sec) * 1e6 +
+           (now.tv_nsec - emulator.start_time.tv_nsec) / 1e3;
+}
+
+// ------------------------------------------------------------------------
+// loading
+// ------------------------------------------------------------------------
+
+static void fail(const char *message, const char *detail) {
+
+    fprintf(stderr, "emulator: %s %s\n", message, detail != NULL ? detail : "");
+    exit(2);
+}
+
+static uint32_t *read_file(const char *filename, size_t *size) {
+
+    FILE *file = fopen(filename, "rb");
+    if (file == NULL) {
+        fail("cannot open", filename);
+    }
+
+    fseek(file, 0, SEEK_END);
+    *size = ftell(file);
+    fseek(file, 0, SEEK_SET);
+
+    uint32_t *data = malloc(*size + 4);
+    if (data == NULL || fread(data, 1, *size, file) != *size) {
+        fail("cannot read", filename);
+    }
+    fclose(file);
+
+    return data;
+}
+
+typedef struct {
+    uint32_t *words;
+    size_t size;
+    size_t position;
+} image_t;
+
+static uint32_t next_word(image_t *image) {
+
+    if ((image->position + 1) * 4 > image->size) {
+        fail("machine image ends early", NULL);
+    }
+
+    return image->words[image->position++];
+}
+
+static chip_t *find_chip(uint x, uint y) {
+
+    for (uint i = 0; i < emulator.num_chips; i++) {
+        if (emulator.chips[i].x == x && emulator.chips[i].y == y) {
+            return &emulator.chips[i];
+        }
+    }
+
+    chip_t *chip = &emulator.chips[emulator.num_chips++];
+    chip->x = x;
+    chip->y = y;
+    chip->lead_ap = 0xFFFFFFFF;
+    chip->sv.p2p_addr = (x << 8) | y;
+    chip->sv.sysram_base = calloc(1, SYSRAM_SIZE);
+    chip->sv.sdram_base = calloc(1, SYSRAM_SIZE);
+    chip->sv.sdram_heap = (heap_t *) chip;
+    chip->sv.sysram_heap = (heap_t *) chip;
+
+    return chip;
+}
+
+static void load_image(const char *filename, uint packet_queue_size) {
+
+    image_t image = {NULL, 0, 0};
+    image.words = read_file(filename, &image.size);
+
+    if (next_word(&image) != IMAGE_MAGIC || next_word(&image) != IMAGE_VERSION) {
+        fail("not a machine image of version 1:", filename);
+    }
+
+    emulator.num_cores  = next_word(&image);
+    emulator.num_routes = next_word(&image);
+    emulator.run_ticks  = next_word(&image);
+
+    emulator.cores  = calloc(emulator.num_cores, sizeof(core_t));
+    emulator.chips  = calloc(emulator.num_cores, sizeof(chip_t));
+    emulator.routes = calloc(emulator.num_routes, sizeof(route_t));
+
+    for (uint i = 0; i < emulator.num_cores; i++) {
+
+        core_t *core = &emulator.cores[i];
+        core->index = i;
+        core->x = next_word(&image);
+        core->y = next_word(&image);
+        core->p = next_word(&image);
+
+        core->chip = find_chip(core->x, core->y);
+        if (core->p < core->chip->lead_ap) {
+            core->chip->lead_ap = core->p;
+        }
+
+        uint num_regions = next_word(&image);
+        if (num_regions > MAX_REGIONS) {
+            fail("too many regions in", filename);
+        }
+
+        for (uint region = 0; region < num_regions; region++) {
+
+            uint reserved = next_word(&image);
+            uint written  = next_word(&image);
+            if (written > reserved || image.position * 4 + written > image.size) {
+                fail("region does not fit in", filename);
+            }
+
+            if (reserved > 0) {
+                core->regions[region] = calloc(1, (reserved + 3) & ~3);
+                memcpy(core->regions[region], &image.words[image.position], written);
+            }
+            core->region_sizes[region] = reserved;
+            image.position += (written + 3) / 4;
+        }
+
+        if (!packet_queue_init(&core->packets, packet_queue_size)) {
+            fail("out of memory", NULL);
+        }
+        for (uint priority = 0; priority < NUM_PRIORITIES; priority++) {
+            core->task_queues[priority].tasks = calloc(emulator.task_queue_size, sizeof(task_t));
+        }
+
+        sem_init(&core->wake, 0, 0);
+        pthread_mutex_init(&core->sdp_lock, NULL);
+        core->sark.vcpu = &core->vcpu;
+        core->sark.virt_cpu = core->p;
+        core->sark.phys_cpu = core->p;
+    }
+
+    for (uint i = 0; i < emulator.num_routes; i++) {
+
+        route_t *route = &emulator.routes[i];
+        route->key  = next_word(&image);
+        route->mask = next_word(&image);
+        route->num_targets = next_word(&image);
+        route->targets = calloc(route->num_targets, sizeof(uint));
+
+        for (uint target = 0; target < route->num_targets; target++) {
+            route->targets[target] = next_word(&image);
+            if (route->targets[target] >= emulator.num_cores) {
+                fail("route to a core that is not in", filename);
+            }
+        }
+    }
+
+    free(image.words);
+}
+
+//! a copy of the library for every core - each copy has its own globals
+static void load_application(const char *filename, const char *directory) {
+
+    size_t size;
+    uint32_t *library = read_file(filename, &size);
+
+    for (uint i = 0; i < emulator.num_cores; i++) {
+
+        core_t *core = &emulator.cores[i];
+
+        int fd = memfd_create("core", 0);
+        if (fd < 0 || write(fd, library, size) != (ssize_t) size) {
+            fail("cannot copy", filename);
+        }
+
+        char path[64];
+        snprintf(path, sizeof(path), "/proc/self/fd/%d", fd);
+
+        core->library = dlopen(path, RTLD_NOW | RTLD_LOCAL);
+        if (core->library == NULL) {
+            fail("cannot load", dlerror());
+        }
+        close(fd);
+
+        core->c_main = (void (*)(void)) dlsym(core->library, "c_main");
+        if (core->c_main == NULL) {
+            fail("no c_main in", filename);
+        }
+
+        char iobuf[4096];
+        snprintf(iobuf, sizeof(iobuf), "%s/%d_%d_%d.iobuf", directory, core->x, core->y, core->p);
+        core->iobuf = fopen(iobuf, "w");
+        if (core->iobuf == NULL) {
+            fail("cannot write", iobuf);
+        }
+    }
+
+    free(library);
+}
+
+//! keeps only core x, y, p of "x,y,p:capture" and reads the packets it is to get
+static void load_replay(const char *argument) {
+
+    uint x, y, p;
+    int length = 0;
+    if (sscanf(argument, "%u,%u,%u:%n", &x, &y, &p, &length) != 3 || length == 0) {
+        fail("a replay is given as x,y,p:capture, not", argument);
+    }
+
+    core_t *core = NULL;
+    for (uint i = 0; i < emulator.num_cores; i++) {
+        if (emulator.cores[i].x == x && emulator.cores[i].y == y && emulator.cores[i].p == p) {
+            core = &emulator.cores[i];
+        }
+    }
+    if (core == NULL) {
+        fail("no core of the machine image at", argument);
+    }
+
+    // the core moves to the front - what points into it is set up again
+    if (core != &emulator.cores[0]) {
+        emulator.cores[0] = *core;
+        emulator.cores[0].index = 0;
+        emulator.cores[0].sark.vcpu = &emulator.cores[0].vcpu;
+        sem_init(&emulator.cores[0].wake, 0, 0);
+    }
+    emulator.num_cores  = 1;
+    emulator.num_routes = 0;
+
+    // capacity, packets received, then the packets that fitted
+    size_t size;
+    uint32_t *capture = read_file(argument + length, &size);
+    if (size < 8 || size < 8 + (size_t) (capture[0] < capture[1] ? capture[0] : capture[1]) * 12) {
+        fail("capture ends early:", argument + length);
+    }
+
+    emulator.num_replay = capture[0] < capture[1] ? capture[0] : capture[1];
+    emulator.replay     = &capture[2];
+
+    if (capture[1] > capture[0]) {
+        fprintf(stderr, "emulator: the capture kept %u of %u packets, the replay stops there\n",
+                capture[0], capture[1]);
+    }
+}
+
+//! the messages of the host, checked against the cores of the image
+static void load_sdp(const char *filename) {
+
+    image_t messages = {NULL, 0, 0};
+    messages.words = read_file(filename, &messages.size);
+
+    uint capacity = 16;
+    emulator.sdp = malloc(capacity * sizeof(sdp_input_t));
+
+    while (messages.position * 4 < messages.size) {
+
+        if (emulator.num_sdp == capacity) {
+            capacity = capacity * 2;
+            emulator.sdp = realloc(emulator.sdp, capacity * sizeof(sdp_input_t));
+        }
+
+        sdp_input_t *input = &emulator.sdp[emulator.num_sdp];
+        input->tick = next_word(&messages);
+        uint x = next_word(&messages);
+        uint y = next_word(&messages);
+        uint p = next_word(&messages);
+        input->port   = next_word(&messages);
+        input->length = next_word(&messages);
+
+        input->core = emulator.num_cores;
+        for (uint i = 0; i < emulator.num_cores; i++) {
+            if (emulator.cores[i].x == x && emulator.cores[i].y == y && emulator.cores[i].p == p) {
+                input->core = i;
+            }
+        }
+        if (input->core == emulator.num_cores) {
+            fail("SDP message to a core that is not in the machine image:", filename);
+        }
+
+        uint body = input->length - sizeof(sdp_hdr_t);
+        if (input->length < sizeof(sdp_hdr_t) ||
+                body > sizeof(cmd_hdr_t) + SDP_BUF_SIZE || input->port >= NUM_SDP_PORTS ||
+                messages.position * 4 + body > messages.size) {
+            fail("SDP message does not fit in", filename);
+        }
+        if (emulator.num_sdp > 0 && input->tick < emulator.sdp[emulator.num_sdp - 1].tick) {
+            fail("SDP messages are not in the order of their ticks in", filename);
+        }
+
+        input->body = &messages.words[messages.position];
+        messages.position += (body + 3) / 4;
+        emulator.num_sdp++;
+    }
+}
+
+// ------------------------------------------------------------------------
+// running
+// ------------------------------------------------------------------------
+
+static void *core_thread(void *argument) {
+
+    core_t *core = argument;
+    current = core;
+
+    atomic_store(&core->state, CORE_STARTING);
+    core->c_main();
+
+    // c_main returned without starting
+    if (atomic_load(&core->state) < CORE_RUNNING) {
+        atomic_store(&core->state, CORE_EXITED);
+        atomic_fetch_add(&emulator.started, 1);
+        core_release(core);
+    }
+
+    fflush(core->iobuf);
+    atomic_store(&core->done, 1);
+    return NULL;
+}
+
+//! packets that reached a core after its thread finished
+static void drain_finished_cores(void) {
+
+    for (uint i = 0; i < emulator.num_cores; i++) {
+
+        core_t *core = &emulator.cores[i];
+        packet_t packet;
+
+        while (atomic_load(&core->done) && packet_queue_pop(&core->packets, &packet)) {
+            atomic_fetch_add(&core->dropped, 1);
+            work_done(1);
+        }
+    }
+}
+
+static void wait_ms(long milliseconds) {
+
+    struct timespec until;
+    clock_gettime(CLOCK_REALTIME, &until);
+    until.tv_sec  += milliseconds / 1000;
+    until.tv_nsec += (milliseconds % 1000) * 1000000L;
+    if (until.tv_nsec >= 1000000000L) {
+        until.tv_sec++;
+        until.tv_nsec -= 1000000000L;
+    }
+
+    pthread_mutex_lock(&emulator.lock);
+    if (atomic_load(&emulator.work) != 0) {
+        pthread_cond_timedwait(&emulator.idle, &emulator.lock, &until);
+    }
+    pthread_mutex_unlock(&emulator.lock);
+}
+
+static void wait_idle(void) {
+
+    while (atomic_load(&emulator.work) != 0) {
+        wait_ms(10);
+        drain_finished_cores();
+    }
+}
+
+//! a core that will take another tick - only asked while every core is idle
+static bool ticking(core_t *core) {
+
+    return atomic_load(&core->state) == CORE_RUNNING && !atomic_load(&core->done) &&
+           core->callbacks[TIMER_TICK] != NULL && core->timer_period > 0 &&
+           core->ticks < emulator.max_ticks;
+}
+
+/*
+ * the captured packets the core handled after tick ticks - it writes the tick count of the
+ * application, which starts at -1 and is 0 in the first tick
+ */
+static void replay_packets(uint ticks) {
+
+    core_t *core = &emulator.cores[0];
+
+    while (emulator.replayed < emulator.num_replay &&
+           atomic_load(&core->state) == CORE_RUNNING) {
+
+        uint32_t *captured = &emulator.replay[emulator.replayed * 3];
+        if ((uint32_t) (captured[0] + 1) > ticks) {
+            break;
+        }
+
+        packet_t packet = {captured[1], captured[2], true};
+
+        work_add(1);
+        if (!packet_queue_push(&core->packets, packet)) {
+            // the queue has room again once the core took what is in it
+            work_done(1);
+            wait_idle();
+            continue;
+        }
+
+        wake_core(core);
+        emulator.replayed++;
+    }
+
+    wait_idle();
+}
+
+//! the messages of the host up to tick ticks - reached by the core they go to in real time
+static void deliver_sdp(uint ticks) {
+
+    while (emulator.sdp_delivered < emulator.num_sdp) {
+
+        sdp_input_t *input = &emulator.sdp[emulator.sdp_delivered];
+        core_t *core = &emulator.cores[input->core];
+
+        if (input->tick > (emulator.realtime > 0 ? core->ticks : ticks)) {
+            break;
+        }
+
+        sdp_msg_t *msg = sdp_alloc();
+        if (msg == NULL) {
+            fail("out of memory below 4 GB for an SDP message", NULL);
+        }
+
+        msg->length    = input->length;
+        msg->flags     = 0x07;
+        msg->tag       = 0xFF;
+        msg->dest_port = (input->port << PORT_SHIFT) | core->p;
+        msg->srce_port = PORT_ETH;
+        msg->dest_addr = (core->x << 8) | core->y;
+        memcpy(&msg->cmd_rc, input->body, input->length - sizeof(sdp_hdr_t));
+
+        sdp_deliver(core, msg);
+        emulator.sdp_delivered++;
+    }
+}
+
+static void run_lockstep(void) {
+
+    for (;;) {
+
+        wait_idle();
+
+        if (emulator.replay != NULL) {
+            replay_packets(atomic_load(&emulator.tick));
+        }
+
+        if (emulator.sdp_delivered < emulator.num_sdp) {
+            deliver_sdp(atomic_load(&emulator.tick));
+            wait_idle();
+        }
+
+        uint cores = 0;
+        for (uint i = 0; i < emulator.num_cores; i++) {
+            cores += ticking(&emulator.cores[i]);
+        }
+        if (cores == 0) {
+            break;
+        }
+
+        atomic_fetch_add(&emulator.tick, 1);
+
+        // every core has its tick before the first one can send packets in it
+        work_add(cores);
+        for (uint i = 0; i < emulator.num_cores; i++) {
+            if (ticking(&emulator.cores[i])) {
+                atomic_fetch_add(&emulator.cores[i].ticks_pending, 1);
+            }
+        }
+        for (uint i = 0; i < emulator.num_cores; i++) {
+            wake_core(&emulator.cores[i]);
+        }
+    }
+}
+
+static void run_realtime(void) {
+
+    atomic_store(&emulator.tick, 1);
+
+    for (;;) {
+
+        wait_ms(10);
+        drain_finished_cores();
+        deliver_sdp(0);
+
+        // the tick counts are only looked at once nothing is left to do
+        if (atomic_load(&emulator.work) != 0) {
+            continue;
+        }
+
+        bool ticking_cores = false;
+        for (uint i = 0; i < emulator.num_cores; i++) {
+            ticking_cores = ticking_cores || ticking(&emulator.cores[i]);
+        }
+        if (!ticking_cores) {
+            break;
+        }
+    }
+}
+
+static void report(double seconds, int verbose) {
+
+    uint sent = 0, received = 0, dropped = 0, unhandled = 0, failed = 0, ticks = 0;
+
+    if (verbose) {
+        printf("core        state  ticks     sent       received   dropped  callbacks\n");
+    }
+
+    for (uint i = 0; i < emulator.num_cores; i++) {
+
+        core_t *core = &emulator.cores[i];
+        sent      += core->sent;
+        received  += core->received;
+        dropped   += core->dropped;
+        unhandled += core->unhandled;
+        failed    += atomic_load(&core->state) == CORE_RTE;
+        ticks      = core->ticks > ticks ? core->ticks : ticks;
+
+        if (verbose) {
+            static const char *states[] = {"load", "start", "run", "exit", "RTE"};
+            printf("%3d %3d %2d  %-5s  %-8d  %-9d  %-9d  %-7d  %d\n",
+                   core->x, core->y, core->p, states[atomic_load(&core->state)],
+                   core->ticks, core->sent, core->received, core->dropped,
+                   core->callbacks_run);
+        }
+    }
+
+    printf("%d cores, %d ticks in %.3f s: %d packets sent, %d received, %d dropped, "
+           "%d unrouted, %d unhandled, %d cores in rt_error\n",
+           emulator.num_cores, ticks, seconds, sent, received, dropped,
+           atomic_load(&emulator.unrouted), unhandled, failed);
+}
+
+static void write_stats(const char *filename, double seconds) {
+
+    FILE *stats = fopen(filename, "w");
+    if (stats == NULL) {
+        fail("cannot write", filename);
+    }
+
+    fprintf(stats, "x,y,p,state,ticks,packet_tick,packet_us,sent,received,dropped,callbacks,"
+                   "busy_us,heap_peak,wall_us\n");
+
+    for (uint i = 0; i < emulator.num_cores; i++) {
+
+        core_t *core = &emulator.cores[i];
+        fprintf(stats, "%u,%u,%u,%d,%u,%u,%.0f,%u,%u,%u,%u,%.1f,%zu,%.0f\n",
+                core->x, core->y, core->p, atomic_load(&core->state), core->ticks,
+                core->packet_tick, core->packet_us, core->sent, core->received, core->dropped,
+                core->callbacks_run, core->busy_ns / 1000.0, core->heap_peak, seconds * 1e6);
+    }
+
+    fclose(stats);
+}
+
+static void usage(void) {
+
+    fprintf(stderr, "usage: emulator [-r factor] [-t ticks] [-q packets] [-Q tasks] [-v] [-s file] "
+                    "[-R x,y,p:capture] [-S file] application.so machine.spem output_directory\n");
+    exit(2);
+}
+
+int main(int argc, char *argv[]) {
+
+    uint packet_queue_size = PACKET_QUEUE_SIZE;
+    long max_ticks = -1;
+    int verbose = 0;
+    const char *stats = NULL;
+    const char *replay = NULL;
+    const char *sdp = NULL;
+    int option;
+
+    emulator.task_queue_size = TASK_QUEUE_SIZE;
+
+    while ((option = getopt(argc, argv, "r:t:q:Q:vs:R:S:")) != -1) {
+        switch (option) {
+        case 'r': emulator.realtime = atof(optarg); break;
+        case 't': max_ticks = atol(optarg); break;
+        case 'q': packet_queue_size = atoi(optarg); break;
+        case 'Q': emulator.task_queue_size = atoi(optarg); break;
+        case 'v': verbose = 1; break;
+        case 's': stats = optarg; break;
+        case 'R': replay = optarg; break;
+        case 'S': sdp = optarg; break;
+        default: usage();
+        }
+    }
+    if (argc - optind != 3 || emulator.task_queue_size == 0 || packet_queue_size == 0 ||
+            (replay != NULL && emulator.realtime > 0)) {
+        usage();
+    }
+
+    const char *directory = argv[optind + 2];
+    emulator.directory = directory;
+    if (mkdir(directory, 0755) != 0 && errno != EEXIST) {
+        fail("cannot create", directory);
+    }
+
+    load_image(argv[optind + 1], packet_queue_size);
+    if (replay != NULL) {
+        load_replay(replay);
+    }
+    if (sdp != NULL) {
+        load_sdp(sdp);
+    }
+    load_application(argv[optind], directory);
+
+    // the cores see the end of the run in the tick after the last one
+    emulator.max_ticks = max_ticks >= 0 ? (uint) max_ticks :
+                         emulator.run_ticks > 0 ? emulator.run_ticks + 1 : 0xFFFFFFFF;
+
+    pthread_mutex_init(&emulator.lock, NULL);
+    pthread_cond_init(&emulator.idle, NULL);
+    clock_gettime(CLOCK_REALTIME, &emulator.start_time);
+
+    for (uint i = 0; i < emulator.num_cores; i++) {
+        if (pthread_create(&emulator.cores[i].thread, NULL, core_thread, &emulator.cores[i]) != 0) {
+            fail("cannot start a thread for every core", NULL);
+        }
+    }
+
+    // SYNC_WAIT - the first tick waits for every core
+    while (atomic_load(&emulator.started) < emulator.num_cores) {
+        struct timespec pause = {0, 1000000L};
+        nanosleep(&pause, NULL);
+    }
+
+    clock_gettime(CLOCK_REALTIME, &emulator.start_time);
+
+    if (emulator.realtime > 0) {
+        run_realtime();
+    } else {
+        run_lockstep();
+    }
+
+    double seconds = elapsed_us() / 1e6;
+
+    atomic_store(&emulator.stop, 1);
+    for (uint i = 0; i < emulator.num_cores; i++) {
+        atomic_store(&emulator.cores[i].sleeping, 1);
+        wake_core(&emulator.cores[i]);
+    }
+
+    uint failed = 0;
+    for (uint i = 0; i < emulator.num_cores; i++) {
+
+        core_t *core = &emulator.cores[i];
+        pthread_join(core->thread, NULL);
+
+        recording_write(core, directory);
+        regions_write(core, directory);
+        fclose(core->iobuf);
+
+        // nothing sent - the messages of an earlier run must not be read as this one's
+        char replies[4096];
+        snprintf(replies, sizeof(replies), "%s/%d_%d_%d.sdp", directory, core->x, core->y, core->p);
+        if (core->sdp_replies != NULL) {
+            fclose(core->sdp_replies);
+        } else {
+            unlink(replies);
+        }
+        failed += atomic_load(&core->state) == CORE_RTE;
+    }
+
+    report(seconds, verbose);
+    if (replay != NULL) {
+        printf("replayed %u of %u captured packets\n", emulator.replayed, emulator.num_replay);
+    }
+    if (stats != NULL) {
+        write_stats(stats, seconds);
+    }
+
+    return failed > 0 ? 1 : 0;
+}
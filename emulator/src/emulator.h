@@ -0,0 +1,215 @@
+/*
+ * emulator.h - state shared by the emulator and the API it gives the applications
+ */
+
+#ifndef __EMULATOR_H__
+#define __EMULATOR_H__
+
+#define SPIN1_EMULATOR
+
+#include <spin1_api.h>
+#include <common-typedefs.h>
+
+#include <pthread.h>
+#include <semaphore.h>
+#include <stdatomic.h>
+#include <stdio.h>
+
+#include "queue.h"
+
+#define MAX_REGIONS           32
+#define MAX_CHANNELS          4
+#define SYSRAM_SIZE           (64 * 1024)
+#define CLOCK_MHZ             200
+
+//! default room for packets a core has not taken yet (the router buffer)
+#define PACKET_QUEUE_SIZE     4096
+
+//! default room of every queued priority (TASK_QUEUE_SIZE of the spin1 API)
+#define TASK_QUEUE_SIZE       16
+
+//! bookkeeping of every block on the SARK heap, counted in the peak heap of a core
+#define HEAP_BLOCK_HEADER     8
+
+//! DTCM heap of a core (64 KB less stack and globals) - only sark_heap_max looks at it
+#define DTCM_HEAP_SIZE        (56 * 1024)
+
+//! SDP ports the simulation interface hands messages to
+#define NUM_SDP_PORTS         8
+
+typedef enum {
+    CORE_LOADED,              // c_main not called yet
+    CORE_STARTING,            // in c_main before spin1_start
+    CORE_RUNNING,             // in spin1_start
+    CORE_EXITED,              // spin1_start returned
+    CORE_RTE                  // rt_error
+} core_state_t;
+
+typedef struct {
+    callback_t cback;
+    uint arg0;
+    uint arg1;
+} task_t;
+
+typedef struct {
+    task_t *tasks;
+    uint start;
+    uint count;
+} task_queue_t;
+
+typedef struct {
+    uint8_t *data;
+    size_t size;
+    size_t capacity;
+} recording_t;
+
+typedef struct {
+    uint x;
+    uint y;
+    sv_t sv;
+    uint lead_ap;
+} chip_t;
+
+typedef struct core {
+    uint index;
+    uint x;
+    uint y;
+    uint p;
+    chip_t *chip;
+
+    void *library;
+    void (*c_main)(void);
+    pthread_t thread;
+
+    //! data_specification_get_data_address() - magic, version, then zeros
+    uint32_t ds_header[2 + MAX_REGIONS];
+    address_t regions[MAX_REGIONS];
+    uint region_sizes[MAX_REGIONS];
+
+    packet_queue_t packets;
+    sem_t wake;
+    atomic_int sleeping;
+
+    //! SDP messages from the host the core has not taken yet, linked through next
+    pthread_mutex_t sdp_lock;
+    sdp_msg_t *sdp_head;
+    sdp_msg_t *sdp_tail;
+    atomic_uint sdp_pending;
+    void (*sdp_callbacks[NUM_SDP_PORTS])(uint, uint);
+    FILE *sdp_replies;
+
+    callback_t callbacks[NUM_EVENTS];
+    int priorities[NUM_EVENTS];
+    task_queue_t task_queues[NUM_PRIORITIES];
+
+    uint timer_period;
+    uint timer_on;
+    uint ticks;
+    atomic_uint ticks_pending;
+
+    atomic_int state;
+    atomic_int done;
+    uint exit_code;
+    uint rte_code;
+    int in_callback;
+    int in_immediate;
+
+    //! simulation interface
+    uint32_t *simulation_ticks;
+    uint32_t *infinite_run;
+    int paused;
+
+    recording_t recordings[MAX_CHANNELS];
+    FILE *iobuf;
+
+    vcpu_t vcpu;
+    sark_t sark;
+    uint tc[16];
+    uint leds;
+
+    //! statistics
+    atomic_uint sent;
+    atomic_uint received;
+    atomic_uint dropped;
+    uint callbacks_run;
+    uint unhandled;
+    uint64_t busy_ns;         // thread cpu time spent in callbacks
+    size_t heap_used;
+    size_t heap_peak;
+    uint packet_tick;         // tick of the last packet sent or received
+    double packet_us;         // and its time since the start
+} core_t;
+
+typedef struct {
+    uint key;
+    uint mask;
+    uint num_targets;
+    uint *targets;
+} route_t;
+
+//! a message from the host - delivered once the run has reached its tick
+typedef struct {
+    uint tick;
+    uint core;
+    uint port;
+    uint length;              // of the message from its SDP header on, like sdp_msg_t
+    uint32_t *body;           // command header and data
+} sdp_input_t;
+
+typedef struct {
+    core_t *cores;
+    uint num_cores;
+    chip_t *chips;
+    uint num_chips;
+    route_t *routes;
+    uint num_routes;
+
+    uint run_ticks;
+    uint max_ticks;
+    double realtime;          // 0 - ticks advance once every core is idle
+    uint task_queue_size;
+
+    //! packets, ticks and tasks that are not finished yet (lockstep)
+    atomic_long work;
+    atomic_uint started;
+    atomic_int stop;
+    atomic_uint tick;
+
+    pthread_mutex_t lock;
+    pthread_cond_t idle;
+
+    struct timespec start_time;
+    atomic_uint unrouted;
+
+    //! replay - captured packets (tick, key, payload) fed to the only core of the run
+    uint32_t *replay;
+    uint num_replay;
+    uint replayed;
+
+    //! SDP messages of the host in the order of their ticks
+    sdp_input_t *sdp;
+    uint num_sdp;
+    uint sdp_delivered;
+
+    const char *directory;
+} emulator_t;
+
+extern emulator_t emulator;
+extern __thread core_t *current;
+
+// emulator.c
+void work_add(long count);
+void work_done(long count);
+void wake_core(core_t *core);
+route_t *find_route(uint key);
+double elapsed_us(void);
+
+// spin1.c
+void core_run(core_t *core);
+void core_release(core_t *core);
+sdp_msg_t *sdp_alloc(void);
+void sdp_deliver(core_t *core, sdp_msg_t *msg);
+void recording_write(core_t *core, const char *directory);
+void regions_write(core_t *core, const char *directory);
+
+#endif /* __EMULATOR_H__ */
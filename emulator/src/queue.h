@@ -0,0 +1,101 @@
+/*
+ * queue.h - bounded lock-free packet queue, many senders and one receiving core
+ *
+ * Every slot carries a sequence number: a sender claims a slot by moving the tail on and
+ * publishes the packet by advancing the slot's sequence, the core takes the packet and
+ * hands the slot back one lap later (D. Vyukov's bounded queue, with a single consumer).
+ */
+
+#ifndef __QUEUE_H__
+#define __QUEUE_H__
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdlib.h>
+
+typedef struct {
+    unsigned int key;
+    unsigned int payload;
+    unsigned int has_payload;
+} packet_t;
+
+typedef struct {
+    atomic_uint sequence;
+    packet_t packet;
+} packet_slot_t;
+
+typedef struct {
+    packet_slot_t *slots;
+    unsigned int mask;
+    _Alignas(64) atomic_uint tail;
+    _Alignas(64) unsigned int head;
+} packet_queue_t;
+
+//! size is rounded up to a power of two
+static inline bool packet_queue_init(packet_queue_t *queue, unsigned int size) {
+
+    unsigned int capacity = 1;
+    while (capacity < size) {
+        capacity <<= 1;
+    }
+
+    queue->slots = malloc(sizeof(packet_slot_t) * capacity);
+    if (queue->slots == NULL) {
+        return false;
+    }
+
+    for (unsigned int i = 0; i < capacity; i++) {
+        atomic_init(&queue->slots[i].sequence, i);
+    }
+    queue->mask = capacity - 1;
+    atomic_init(&queue->tail, 0);
+    queue->head = 0;
+
+    return true;
+}
+
+//! false if the queue is full
+static inline bool packet_queue_push(packet_queue_t *queue, packet_t packet) {
+
+    unsigned int position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+
+    for (;;) {
+        packet_slot_t *slot = &queue->slots[position & queue->mask];
+        unsigned int sequence =
+            atomic_load_explicit(&slot->sequence, memory_order_acquire);
+        int difference = (int) (sequence - position);
+
+        if (difference == 0) {
+            if (atomic_compare_exchange_weak_explicit(
+                    &queue->tail, &position, position + 1,
+                    memory_order_relaxed, memory_order_relaxed)) {
+                slot->packet = packet;
+                atomic_store_explicit(&slot->sequence, position + 1, memory_order_release);
+                return true;
+            }
+        } else if (difference < 0) {
+            return false;
+        } else {
+            position = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+        }
+    }
+}
+
+//! only the receiving core may call this - false if there is no packet
+static inline bool packet_queue_pop(packet_queue_t *queue, packet_t *packet) {
+
+    packet_slot_t *slot = &queue->slots[queue->head & queue->mask];
+    unsigned int sequence = atomic_load_explicit(&slot->sequence, memory_order_acquire);
+
+    if ((int) (sequence - (queue->head + 1)) < 0) {
+        return false;
+    }
+
+    *packet = slot->packet;
+    atomic_store_explicit(&slot->sequence, queue->head + queue->mask + 1, memory_order_release);
+    queue->head++;
+
+    return true;
+}
+
+#endif /* __QUEUE_H__ */
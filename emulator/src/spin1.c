@@ -0,0 +1,1018 @@
+/*
+ * spin1.c - the spin1 API, SARK and the front end common libraries as one emulated
+ * core sees them
+ *
+ * Every core runs on its own thread. Callbacks are never interrupted: a packet callback
+ * of priority 0 or -1 runs as soon as the callback that is running returns, or while it
+ * waits in spin1_delay_us. Packets wait in the core's packet queue (the router) until the
+ * task queue of their priority has room, so bursts are not dropped by the emulation.
+ */
+
+#define _GNU_SOURCE
+
+#include "emulator.h"
+
+#include <data_specification.h>
+#include <recording.h>
+#include <simulation.h>
+
+#include <errno.h>
+#include <stdarg.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// the spin1 API hands a message to its callback as a uint
+#ifndef MAP_32BIT
+#define MAP_32BIT             0
+#endif
+
+#define DS_MAGIC_NUMBER       0xAD130AD6
+#define DS_VERSION            0x00010000
+
+//! SYSTEM region written by get_simulation_header_array - hash, timer period, sdp port
+#define SIMULATION_TIMER_PERIOD 1
+#define DEFAULT_TIMER_PERIOD  1000
+
+__thread core_t *current;
+
+// ------------------------------------------------------------------------
+// heap - every block keeps its size in front, as the SARK heap does
+// ------------------------------------------------------------------------
+
+typedef union {
+    size_t size;
+    long double align;
+} block_t;
+
+static void *heap_alloc(size_t size) {
+
+    block_t *block = malloc(sizeof(block_t) + size);
+    if (block == NULL) {
+        return NULL;
+    }
+
+    block->size = size;
+    current->heap_used += size + HEAP_BLOCK_HEADER;
+    if (current->heap_used > current->heap_peak) {
+        current->heap_peak = current->heap_used;
+    }
+
+    return block + 1;
+}
+
+static void heap_free(void *ptr) {
+
+    if (ptr == NULL) {
+        return;
+    }
+
+    block_t *block = (block_t *) ptr - 1;
+    current->heap_used -= block->size + HEAP_BLOCK_HEADER;
+    free(block);
+}
+
+// ------------------------------------------------------------------------
+// events and tasks
+// ------------------------------------------------------------------------
+
+static bool task_room(core_t *core, uint event) {
+
+    if (core->callbacks[event] == NULL || core->priorities[event] <= 0) {
+        return true;
+    }
+
+    return core->task_queues[core->priorities[event]].count < emulator.task_queue_size;
+}
+
+static bool task_push(core_t *core, uint priority, callback_t cback, uint arg0, uint arg1) {
+
+    task_queue_t *queue = &core->task_queues[priority];
+    if (queue->count == emulator.task_queue_size) {
+        return false;
+    }
+
+    uint slot = (queue->start + queue->count) % emulator.task_queue_size;
+    queue->tasks[slot].cback = cback;
+    queue->tasks[slot].arg0  = arg0;
+    queue->tasks[slot].arg1  = arg1;
+    queue->count++;
+
+    work_add(1);
+    return true;
+}
+
+static uint64_t cpu_ns(void) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+    return now.tv_sec * 1000000000ULL + now.tv_nsec;
+}
+
+//! a callback run by another one is part of the busy time of the outer one
+static void run_callback(core_t *core, callback_t cback, uint arg0, uint arg1) {
+
+    uint64_t start = core->in_callback == 0 ? cpu_ns() : 0;
+
+    core->in_callback++;
+    cback(arg0, arg1);
+    core->in_callback--;
+    core->callbacks_run++;
+
+    if (core->in_callback == 0) {
+        core->busy_ns += cpu_ns() - start;
+    }
+}
+
+//! runs the callback of the event now (priority 0 or -1) or queues it
+static void raise_event(core_t *core, uint event, uint arg0, uint arg1) {
+
+    callback_t cback = core->callbacks[event];
+    if (cback == NULL) {
+        core->unhandled++;
+        return;
+    }
+
+    if (core->priorities[event] <= 0) {
+        core->in_immediate++;
+        run_callback(core, cback, arg0, arg1);
+        core->in_immediate--;
+    } else if (!task_push(core, core->priorities[event], cback, arg0, arg1)) {
+        atomic_fetch_add(&core->dropped, 1);
+    }
+}
+
+static bool run_next_task(core_t *core) {
+
+    for (uint priority = 1; priority < NUM_PRIORITIES; priority++) {
+
+        task_queue_t *queue = &core->task_queues[priority];
+        if (queue->count > 0) {
+
+            task_t task = queue->tasks[queue->start];
+            queue->start = (queue->start + 1) % emulator.task_queue_size;
+            queue->count--;
+
+            run_callback(core, task.cback, task.arg0, task.arg1);
+            work_done(1);
+            return true;
+        }
+    }
+
+    return false;
+}
+
+static bool timer_active(core_t *core) {
+    return core->callbacks[TIMER_TICK] != NULL && core->timer_period > 0 &&
+           core->ticks < emulator.max_ticks;
+}
+
+//! microseconds since the start at which the next tick of the core is due (real time)
+static double next_tick_due(core_t *core) {
+    return (core->ticks + 1) * (double) core->timer_period * emulator.realtime;
+}
+
+static void take_ticks(core_t *core) {
+
+    if (emulator.realtime > 0) {
+        if (atomic_load(&emulator.tick) > 0 && timer_active(core) &&
+                elapsed_us() >= next_tick_due(core)) {
+            core->ticks++;
+            raise_event(core, TIMER_TICK, core->ticks, 0);
+        }
+        return;
+    }
+
+    uint pending = atomic_exchange(&core->ticks_pending, 0);
+    for (uint i = 0; i < pending; i++) {
+        if (timer_active(core)) {
+            core->ticks++;
+            raise_event(core, TIMER_TICK, core->ticks, 0);
+        }
+        work_done(1);
+    }
+}
+
+//! moves packets from the router to the core while their callbacks have room
+static void take_packets(core_t *core) {
+
+    packet_t packet;
+
+    while (task_room(core, MC_PACKET_RECEIVED) && task_room(core, MCPL_PACKET_RECEIVED) &&
+           atomic_load(&core->state) == CORE_RUNNING &&
+           packet_queue_pop(&core->packets, &packet)) {
+
+        // a neighbour may already have run the tick this packet came from - the tick of
+        // this core goes first, as it does when every core is woken by the same timer
+        take_ticks(core);
+
+        atomic_fetch_add(&core->received, 1);
+        core->packet_tick = core->ticks;
+        core->packet_us   = elapsed_us();
+        raise_event(core,
+                    packet.has_payload ? MCPL_PACKET_RECEIVED : MC_PACKET_RECEIVED,
+                    packet.key, packet.payload);
+        work_done(1);
+    }
+}
+
+//! hands the messages of the host to the core while the SDP callback has room
+static void take_sdp(core_t *core) {
+
+    while (task_room(core, SDP_PACKET_RX) && atomic_load(&core->state) == CORE_RUNNING &&
+           atomic_load(&core->sdp_pending) > 0) {
+
+        pthread_mutex_lock(&core->sdp_lock);
+        sdp_msg_t *msg = core->sdp_head;
+        core->sdp_head = msg->next;
+        if (core->sdp_head == NULL) {
+            core->sdp_tail = NULL;
+        }
+        pthread_mutex_unlock(&core->sdp_lock);
+        atomic_fetch_sub(&core->sdp_pending, 1);
+
+        msg->next = NULL;
+        if (core->callbacks[SDP_PACKET_RX] == NULL) {
+            core->unhandled++;
+            spin1_msg_free(msg);
+        } else {
+            raise_event(core, SDP_PACKET_RX, (uint) (uintptr_t) msg, msg->dest_port);
+        }
+        work_done(1);
+    }
+}
+
+static bool leaving(core_t *core) {
+    return atomic_load(&emulator.stop) || atomic_load(&core->state) != CORE_RUNNING;
+}
+
+static bool has_events(core_t *core) {
+
+    packet_slot_t *slot = &core->packets.slots[core->packets.head & core->packets.mask];
+
+    return leaving(core) || atomic_load(&core->ticks_pending) > 0 ||
+           atomic_load(&core->sdp_pending) > 0 ||
+           (int) (atomic_load(&slot->sequence) - (core->packets.head + 1)) >= 0;
+}
+
+static void sleep_core(core_t *core) {
+
+    atomic_store(&core->sleeping, 1);
+    atomic_thread_fence(memory_order_seq_cst);
+
+    if (has_events(core)) {
+        atomic_store(&core->sleeping, 0);
+        return;
+    }
+
+    if (emulator.realtime > 0 && atomic_load(&emulator.tick) > 0 && timer_active(core)) {
+
+        double due = next_tick_due(core);
+        struct timespec until = emulator.start_time;
+        until.tv_sec  += (time_t) (due / 1e6);
+        until.tv_nsec += (long) ((due - (time_t) (due / 1e6) * 1e6) * 1e3);
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+
+        while (sem_timedwait(&core->wake, &until) == -1 && errno == EINTR) {
+        }
+
+    } else if (emulator.realtime > 0) {
+
+        // before the start or without a timer - look again now and then
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 10000000L;
+        if (until.tv_nsec >= 1000000000L) {
+            until.tv_sec++;
+            until.tv_nsec -= 1000000000L;
+        }
+        while (sem_timedwait(&core->wake, &until) == -1 && errno == EINTR) {
+        }
+
+    } else {
+        while (sem_wait(&core->wake) == -1 && errno == EINTR) {
+        }
+    }
+
+    atomic_store(&core->sleeping, 0);
+}
+
+void core_run(core_t *core) {
+
+    while (!leaving(core)) {
+
+        take_ticks(core);
+        take_packets(core);
+        take_sdp(core);
+
+        if (leaving(core)) {
+            break;
+        }
+
+        if (!run_next_task(core)) {
+            sleep_core(core);
+        }
+    }
+}
+
+//! drops what the core will never handle - called once it has left spin1_start
+void core_release(core_t *core) {
+
+    for (uint priority = 1; priority < NUM_PRIORITIES; priority++) {
+        work_done(core->task_queues[priority].count);
+        core->task_queues[priority].count = 0;
+    }
+
+    if (emulator.realtime == 0) {
+        work_done(atomic_exchange(&core->ticks_pending, 0));
+    }
+
+    packet_t packet;
+    while (packet_queue_pop(&core->packets, &packet)) {
+        atomic_fetch_add(&core->dropped, 1);
+        work_done(1);
+    }
+
+    pthread_mutex_lock(&core->sdp_lock);
+    while (core->sdp_head != NULL) {
+        sdp_msg_t *msg = core->sdp_head;
+        core->sdp_head = msg->next;
+        spin1_msg_free(msg);
+        atomic_fetch_sub(&core->sdp_pending, 1);
+        work_done(1);
+    }
+    core->sdp_tail = NULL;
+    pthread_mutex_unlock(&core->sdp_lock);
+}
+
+//! a message from the host - the core takes it on its own thread
+void sdp_deliver(core_t *core, sdp_msg_t *msg) {
+
+    if (atomic_load(&core->state) > CORE_RUNNING) {
+        spin1_msg_free(msg);
+        return;
+    }
+
+    work_add(1);
+
+    pthread_mutex_lock(&core->sdp_lock);
+    msg->next = NULL;
+    if (core->sdp_tail != NULL) {
+        core->sdp_tail->next = msg;
+    } else {
+        core->sdp_head = msg;
+    }
+    core->sdp_tail = msg;
+    pthread_mutex_unlock(&core->sdp_lock);
+    atomic_fetch_add(&core->sdp_pending, 1);
+
+    wake_core(core);
+}
+
+// ------------------------------------------------------------------------
+// spin1 API
+// ------------------------------------------------------------------------
+
+uint spin1_start(uint sync) {
+
+    use(sync);
+    core_t *core = current;
+
+    atomic_store(&core->state, CORE_RUNNING);
+    atomic_fetch_add(&emulator.started, 1);
+
+    core_run(core);
+
+    if (atomic_load(&core->state) == CORE_RUNNING) {
+        atomic_store(&core->state, CORE_EXITED);
+    }
+    core_release(core);
+
+    return core->exit_code;
+}
+
+void spin1_exit(uint error) {
+
+    current->exit_code = error;
+    atomic_store(&current->state, CORE_EXITED);
+}
+
+void spin1_set_timer_tick(uint time) {
+    current->timer_period = time;
+}
+
+uint spin1_get_simulation_time(void) {
+    return current->ticks;
+}
+
+void spin1_callback_on(uint event_id, callback_t cback, int priority) {
+
+    if (event_id >= NUM_EVENTS || priority >= NUM_PRIORITIES) {
+        rt_error(RTE_API);
+    }
+
+    current->callbacks[event_id]  = cback;
+    current->priorities[event_id] = priority;
+}
+
+void spin1_callback_off(uint event_id) {
+
+    if (event_id < NUM_EVENTS) {
+        current->callbacks[event_id] = NULL;
+    }
+}
+
+uint spin1_schedule_callback(callback_t cback, uint arg0, uint arg1, uint priority) {
+
+    if (priority == 0 || priority >= NUM_PRIORITIES) {
+        return FAILURE;
+    }
+
+    return task_push(current, priority, cback, arg0, arg1) ? SUCCESS : FAILURE;
+}
+
+uint spin1_trigger_user_event(uint arg0, uint arg1) {
+
+    if (current->callbacks[USER_EVENT] == NULL) {
+        return FAILURE;
+    }
+
+    raise_event(current, USER_EVENT, arg0, arg1);
+    return SUCCESS;
+}
+
+uint spin1_send_mc_packet(uint key, uint data, uint load) {
+
+    core_t *core = current;
+    atomic_fetch_add(&core->sent, 1);
+    core->packet_tick = core->ticks;
+    core->packet_us   = elapsed_us();
+
+    route_t *route = find_route(key);
+    if (route == NULL) {
+        atomic_fetch_add(&emulator.unrouted, 1);
+        return SUCCESS;
+    }
+
+    packet_t packet = {key, load == WITH_PAYLOAD ? data : 0, load == WITH_PAYLOAD};
+
+    for (uint i = 0; i < route->num_targets; i++) {
+
+        core_t *target = &emulator.cores[route->targets[i]];
+        if (atomic_load(&target->state) > CORE_RUNNING) {
+            atomic_fetch_add(&target->dropped, 1);
+            continue;
+        }
+
+        work_add(1);
+        if (!packet_queue_push(&target->packets, packet)) {
+            atomic_fetch_add(&target->dropped, 1);
+            work_done(1);
+            continue;
+        }
+
+        wake_core(target);
+    }
+
+    return SUCCESS;
+}
+
+/*
+ * there is no host link - the messages go to <x>_<y>_<p>.sdp in the output directory, each as
+ * its size and the bytes the host would get: 2 bytes of padding, the SDP header, the rest
+ */
+uint spin1_send_sdp_msg(sdp_msg_t *msg, uint timeout) {
+
+    use(timeout);
+    core_t *core = current;
+
+    if (msg->length < sizeof(sdp_hdr_t) || msg->length > sizeof(sdp_hdr_t) + sizeof(cmd_hdr_t) +
+            SDP_BUF_SIZE) {
+        return FAILURE;
+    }
+
+    if (core->sdp_replies == NULL) {
+        char filename[4096];
+        snprintf(filename, sizeof(filename), "%s/%d_%d_%d.sdp",
+                 emulator.directory, core->x, core->y, core->p);
+        core->sdp_replies = fopen(filename, "wb");
+        if (core->sdp_replies == NULL) {
+            return FAILURE;
+        }
+    }
+
+    uint32_t size = 2 + msg->length;
+    uint16_t padding = 0;
+    fwrite(&size, sizeof(size), 1, core->sdp_replies);
+    fwrite(&padding, sizeof(padding), 1, core->sdp_replies);
+    fwrite(&msg->flags, 1, msg->length, core->sdp_replies);
+
+    return SUCCESS;
+}
+
+//! messages live below 4 GB - the spin1 API hands them to the callbacks as a uint
+sdp_msg_t *sdp_alloc(void) {
+
+    void *msg = mmap(NULL, sizeof(sdp_msg_t), PROT_READ | PROT_WRITE,
+                     MAP_PRIVATE | MAP_ANONYMOUS | MAP_32BIT, -1, 0);
+
+    return msg != MAP_FAILED ? msg : NULL;
+}
+
+sdp_msg_t *spin1_msg_get(void) {
+    return sdp_alloc();
+}
+
+void spin1_msg_free(sdp_msg_t *msg) {
+
+    if (msg != NULL) {
+        munmap(msg, sizeof(sdp_msg_t));
+    }
+}
+
+void spin1_delay_us(uint n) {
+
+    core_t *core = current;
+
+    // packets get in while a core waits, like interrupts would
+    if (core->in_immediate == 0 && atomic_load(&core->state) == CORE_RUNNING) {
+        take_packets(core);
+    }
+
+    if (emulator.realtime > 0) {
+        struct timespec delay = {n / 1000000, (n % 1000000) * 1000L};
+        nanosleep(&delay, NULL);
+    }
+}
+
+uint spin1_get_id(void) {
+    return (spin1_get_chip_id() << 5) | current->p;
+}
+
+uint spin1_get_core_id(void) {
+    return current->p;
+}
+
+uint spin1_get_chip_id(void) {
+    return (current->x << 8) | current->y;
+}
+
+uchar spin1_get_leds(void) {
+    return current->leds;
+}
+
+void spin1_set_leds(uchar leds) {
+    current->leds = leds;
+}
+
+void spin1_memcpy(void *dst, void const *src, uint len) {
+    memcpy(dst, src, len);
+}
+
+void *spin1_malloc(uint bytes) {
+    return heap_alloc(bytes);
+}
+
+void *spin1_emu_malloc(size_t bytes) {
+    return heap_alloc(bytes);
+}
+
+void spin1_emu_free(void *ptr) {
+    heap_free(ptr);
+}
+
+uint spin1_irq_disable(void) {
+    return 0;
+}
+
+uint spin1_fiq_disable(void) {
+    return 0;
+}
+
+uint spin1_int_disable(void) {
+    return 0;
+}
+
+void spin1_mode_restore(uint status) {
+    use(status);
+}
+
+// ------------------------------------------------------------------------
+// SARK
+// ------------------------------------------------------------------------
+
+sv_t *spin1_emu_sv(void) {
+
+    current->chip->sv.clock_ms = (uint) (elapsed_us() / 1000);
+    return &current->chip->sv;
+}
+
+sark_t *spin1_emu_sark(void) {
+    return &current->sark;
+}
+
+uint spin1_emu_lead_ap(void) {
+    return current->chip->lead_ap == current->p;
+}
+
+//! the counters run down at CLOCK_MHZ over the cpu time of the core's thread
+volatile uint *spin1_emu_tc(void) {
+
+    struct timespec now;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &now);
+
+    uint cycles = (uint) ((now.tv_sec * 1000000000ULL + now.tv_nsec) * CLOCK_MHZ / 1000);
+    current->tc[T1_COUNT] = 0xFFFFFFFF - cycles;
+    current->tc[T2_COUNT] = 0xFFFFFFFF - cycles;
+
+    return current->tc;
+}
+
+void *sark_xalloc(heap_t *heap, uint size, uint tag, uint flag) {
+
+    use(heap);
+    use(tag);
+    use(flag);
+    return heap_alloc(size);
+}
+
+void sark_xfree(heap_t *heap, void *ptr, uint flag) {
+
+    use(heap);
+    use(flag);
+    heap_free(ptr);
+}
+
+//! the largest block left is what the core has not used of its DTCM heap
+uint sark_heap_max(heap_t *heap, uint flag) {
+
+    use(heap);
+    use(flag);
+    return current->heap_used < DTCM_HEAP_SIZE ? DTCM_HEAP_SIZE - current->heap_used : 0;
+}
+
+void *sark_alloc(uint count, uint size) {
+    return heap_alloc(count * size);
+}
+
+void sark_free(void *ptr) {
+    heap_free(ptr);
+}
+
+void rt_error(uint code, ...) {
+
+    core_t *core = current;
+
+    io_printf(IO_BUF, "rt_error %d\n", code);
+    fprintf(stderr, "core %d,%d,%d: rt_error %d\n", core->x, core->y, core->p, code);
+
+    // the callbacks that were running will not finish
+    if (core->in_callback > 0) {
+        work_done(core->in_callback);
+    }
+
+    core->rte_code = code;
+    if (atomic_exchange(&core->state, CORE_RTE) < CORE_RUNNING) {
+        atomic_fetch_add(&emulator.started, 1);
+    }
+    core_release(core);
+
+    if (core->iobuf != NULL) {
+        fflush(core->iobuf);
+    }
+    atomic_store(&core->done, 1);
+    pthread_exit(NULL);
+}
+
+//! the formats of SARK's io_printf - %f prints a 16.16 fixed point number
+static int format(char *buffer, size_t size, const char *format, va_list args) {
+
+    size_t length = 0;
+
+    for (const char *c = format; *c != '\0'; c++) {
+
+        if (*c != '%') {
+            if (length + 1 < size) {
+                buffer[length] = *c;
+            }
+            length++;
+            continue;
+        }
+
+        // flags, width and precision are handed to snprintf as they are
+        char spec[32] = "%";
+        uint spec_length = 1;
+        c++;
+        while (*c != '\0' && strchr("-+ #0123456789.", *c) != NULL && spec_length < 24) {
+            spec[spec_length++] = *c++;
+        }
+        if (*c == '\0') {
+            break;
+        }
+
+        char *out = length < size ? &buffer[length] : NULL;
+        size_t room = length < size ? size - length : 0;
+        int written;
+
+        switch (*c) {
+        case 'd': case 'i':
+            spec[spec_length++] = 'd';
+            spec[spec_length] = '\0';
+            written = snprintf(out, room, spec, va_arg(args, int));
+            break;
+        case 'u': case 'x': case 'X': case 'c':
+            spec[spec_length++] = *c;
+            spec[spec_length] = '\0';
+            written = snprintf(out, room, spec, va_arg(args, uint));
+            break;
+        case 's':
+            spec[spec_length++] = 's';
+            spec[spec_length] = '\0';
+            written = snprintf(out, room, spec, va_arg(args, char *));
+            break;
+        case 'p':
+            spec[spec_length++] = 'p';
+            spec[spec_length] = '\0';
+            written = snprintf(out, room, spec, va_arg(args, void *));
+            break;
+        case 'f': case 'k':
+            spec[spec_length++] = 'f';
+            spec[spec_length] = '\0';
+            written = snprintf(out, room, spec, va_arg(args, int) / 65536.0);
+            break;
+        case '%':
+            written = snprintf(out, room, "%%");
+            break;
+        default:
+            written = snprintf(out, room, "%%%c", *c);
+            break;
+        }
+
+        length += written;
+    }
+
+    if (size > 0) {
+        buffer[length < size ? length : size - 1] = '\0';
+    }
+
+    return (int) length;
+}
+
+void io_printf(char *stream, char *fmt, ...) {
+
+    core_t *core = current;
+    char message[1024];
+
+    va_list args;
+    va_start(args, fmt);
+    format(message, sizeof(message), fmt, args);
+    va_end(args);
+
+    if (stream == IO_NULL) {
+        return;
+    } else if (stream == IO_STD) {
+        fprintf(stdout, "%d,%d,%d: %s", core->x, core->y, core->p, message);
+    } else if (stream == IO_BUF || stream == IO_DBG) {
+        if (core->iobuf != NULL) {
+            fputs(message, core->iobuf);
+        }
+    } else {
+        strcpy(stream, message);
+    }
+}
+
+char *itoa(int value, char *buffer, int base) {
+
+    char digits[33];
+    uint magnitude = value < 0 && base == 10 ? (uint) -value : (uint) value;
+    int length = 0;
+
+    do {
+        digits[length++] = "0123456789abcdefghijklmnopqrstuvwxyz"[magnitude % base];
+        magnitude = magnitude / base;
+    } while (magnitude > 0);
+
+    char *out = buffer;
+    if (value < 0 && base == 10) {
+        *out++ = '-';
+    }
+    while (length > 0) {
+        *out++ = digits[--length];
+    }
+    *out = '\0';
+
+    return buffer;
+}
+
+// ------------------------------------------------------------------------
+// data specification
+// ------------------------------------------------------------------------
+
+address_t data_specification_get_data_address(void) {
+
+    current->ds_header[0] = DS_MAGIC_NUMBER;
+    current->ds_header[1] = DS_VERSION;
+    return current->ds_header;
+}
+
+bool data_specification_read_header(address_t data_address) {
+    return data_address[0] == DS_MAGIC_NUMBER && data_address[1] == DS_VERSION;
+}
+
+address_t data_specification_get_region(uint32_t region, address_t data_address) {
+
+    use(data_address);
+    return region < MAX_REGIONS ? current->regions[region] : NULL;
+}
+
+// ------------------------------------------------------------------------
+// recording
+// ------------------------------------------------------------------------
+
+bool recording_initialize(address_t recording_data_address, uint32_t *recording_flags) {
+
+    // the region starts with the number of recorded channels
+    uint channels = 1;
+    if (recording_data_address != NULL && recording_data_address[0] > 0 &&
+            recording_data_address[0] <= MAX_CHANNELS) {
+        channels = recording_data_address[0];
+    }
+
+    *recording_flags = (1 << channels) - 1;
+    return true;
+}
+
+bool recording_record(uint8_t channel, void *data, uint32_t size_bytes) {
+
+    if (channel >= MAX_CHANNELS) {
+        return false;
+    }
+
+    recording_t *recording = &current->recordings[channel];
+    if (recording->size + size_bytes > recording->capacity) {
+
+        size_t capacity = recording->capacity > 0 ? recording->capacity : 4096;
+        while (capacity < recording->size + size_bytes) {
+            capacity = capacity * 2;
+        }
+
+        uint8_t *grown = realloc(recording->data, capacity);
+        if (grown == NULL) {
+            return false;
+        }
+        recording->data = grown;
+        recording->capacity = capacity;
+    }
+
+    memcpy(&recording->data[recording->size], data, size_bytes);
+    recording->size += size_bytes;
+
+    return true;
+}
+
+void recording_finalise(void) {
+}
+
+void recording_do_timestep_update(uint32_t time) {
+    use(time);
+}
+
+void recording_reset(void) {
+
+    for (uint channel = 0; channel < MAX_CHANNELS; channel++) {
+        current->recordings[channel].size = 0;
+    }
+}
+
+//! <directory>/<x>_<y>_<p>_<channel>.rec for every channel that holds data
+void recording_write(core_t *core, const char *directory) {
+
+    for (uint channel = 0; channel < MAX_CHANNELS; channel++) {
+
+        recording_t *recording = &core->recordings[channel];
+
+        char filename[4096];
+        snprintf(filename, sizeof(filename), "%s/%d_%d_%d_%d.rec",
+                 directory, core->x, core->y, core->p, channel);
+
+        // nothing recorded - a recording of an earlier run must not be read as this one's
+        if (recording->size == 0) {
+            unlink(filename);
+            continue;
+        }
+
+        FILE *file = fopen(filename, "wb");
+        if (file == NULL || fwrite(recording->data, 1, recording->size, file) != recording->size) {
+            fprintf(stderr, "cannot write %s\n", filename);
+        }
+        if (file != NULL) {
+            fclose(file);
+        }
+    }
+}
+
+//! the regions as the run left them, so the host can read what the core wrote into them:
+//! the number of regions, then per region its size in bytes and its data (padded to a word)
+void regions_write(core_t *core, const char *directory) {
+
+    char filename[4096];
+    snprintf(filename, sizeof(filename), "%s/%d_%d_%d.regions",
+             directory, core->x, core->y, core->p);
+
+    FILE *file = fopen(filename, "wb");
+    if (file == NULL) {
+        fprintf(stderr, "cannot write %s\n", filename);
+        return;
+    }
+
+    uint32_t num_regions = MAX_REGIONS;
+    while (num_regions > 0 && core->regions[num_regions - 1] == NULL) {
+        num_regions--;
+    }
+    fwrite(&num_regions, sizeof(uint32_t), 1, file);
+
+    for (uint region = 0; region < num_regions; region++) {
+        uint32_t size = core->regions[region] != NULL ? core->region_sizes[region] : 0;
+        fwrite(&size, sizeof(uint32_t), 1, file);
+        fwrite(core->regions[region], 1, (size + 3) & ~3, file);
+    }
+
+    fclose(file);
+}
+
+// ------------------------------------------------------------------------
+// simulation interface
+// ------------------------------------------------------------------------
+
+//! the SDP callback of the simulation interface - it passes the message on by its port
+static void simulation_sdp_receive(uint mailbox, uint dest_port) {
+
+    uint port = (dest_port >> PORT_SHIFT) & (NUM_SDP_PORTS - 1);
+
+    if (current->sdp_callbacks[port] == NULL) {
+        current->unhandled++;
+        spin1_msg_free((sdp_msg_t *) (uintptr_t) mailbox);
+        return;
+    }
+
+    current->sdp_callbacks[port](mailbox, port);
+}
+
+bool simulation_initialise(
+        address_t address, uint32_t expected_application_magic_number,
+        uint32_t *timer_period, uint32_t *simulation_ticks_pointer,
+        uint32_t *infinite_run_pointer, int sdp_packet_callback_priority,
+        int dma_transfer_done_callback_priority) {
+
+    use(expected_application_magic_number);
+    use(dma_transfer_done_callback_priority);
+
+    core_t *core = current;
+    spin1_callback_on(SDP_PACKET_RX, simulation_sdp_receive, sdp_packet_callback_priority);
+
+    *timer_period = DEFAULT_TIMER_PERIOD;
+    if (address != NULL && core->region_sizes[0] > SIMULATION_TIMER_PERIOD * 4) {
+        *timer_period = address[SIMULATION_TIMER_PERIOD];
+    }
+
+    *simulation_ticks_pointer = emulator.run_ticks;
+    *infinite_run_pointer = emulator.run_ticks == 0 ? TRUE : FALSE;
+
+    core->simulation_ticks = simulation_ticks_pointer;
+    core->infinite_run = infinite_run_pointer;
+
+    return true;
+}
+
+void simulation_run(void) {
+    spin1_start(SYNC_WAIT);
+}
+
+void simulation_handle_pause_resume(prepare_resume_callback_t callback) {
+
+    // there is no host to resume the run - the core idles until the run ends
+    use(callback);
+    spin1_callback_off(TIMER_TICK);
+    current->paused = 1;
+}
+
+void simulation_exit(void) {
+    spin1_exit(0);
+}
+
+void simulation_sdp_callback_on(uint sdp_port, void (*callback)(uint, uint)) {
+
+    if (sdp_port < NUM_SDP_PORTS) {
+        current->sdp_callbacks[sdp_port] = callback;
+    }
+}
+
+void simulation_sdp_callback_off(uint sdp_port) {
+
+    if (sdp_port < NUM_SDP_PORTS) {
+        current->sdp_callbacks[sdp_port] = NULL;
+    }
+}
@@ -0,0 +1,242 @@
+"""
+Benchmarks of the counting, index and histogram functions on synthetic datasets
+
+Every dataset is run with every function over a sweep of chip counts on the native emulator
+(build it with make in emulator/), so the numbers do not depend on a board. The front end only
+maps the graph - set virtual_board = True in spiNNakerGraphFrontEnd.cfg.
+
+    python benchmark.py
+
+runs every benchmark in a process of its own, so that no state of the front end is carried over
+from one run to the next, and writes one entry per run to REPORT:
+    time_to_result_us    wall time until the last packet of the run (all cores share the host)
+    busy_us              thread cpu time each core spent in callbacks
+    packets_sent         multicast packets of all cores
+    dictionary_sizes     distinct values each core held
+    heap_peak            peak heap of each core in bytes, block headers included
+    profiles             the counters of the PROFILE region of each core (see vertex.c)
+    trace                Chrome trace of the phases of all cores
+    log                  the DEBUG_ messages of all cores (see log_binary in vertex.c)
+    correct              the results match a count on the host
+    error                why a run did not finish, e.g. a partition that does not fit into DTCM
+"""
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+from edges.circle import make_circle
+from vertex import Vertex
+from utilities.parser import parser
+from utilities.records import decode_ints, decode_records
+from utilities.ingest import partition_rows
+from utilities.synthetic import write_synthetic_csv
+from utilities.emulation import write_machine_image, read_recording, read_region
+from utilities.trace import write_chrome_trace
+from utilities.binary_log import write_log
+
+from spinn_front_end_common.utilities import exceptions
+
+import spinnaker_graph_front_end as front_end
+import collections
+import csv
+import json
+import logging
+import os
+import subprocess
+import sys
+
+logger = logging.getLogger(__name__)
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+'''rows, distinct values, zipf skew (0 - uniform) and characters of every value'''
+DATASETS = [
+    {"rows": 20000, "unique": 100,  "skew": 0.0, "string_length": 10},
+    {"rows": 20000, "unique": 100,  "skew": 1.0, "string_length": 10},
+    {"rows": 20000, "unique": 1000, "skew": 0.0, "string_length": 10},
+    {"rows": 20000, "unique": 1000, "skew": 1.5, "string_length": 10},
+    {"rows": 20000, "unique": 1000, "skew": 1.0, "string_length": 16},
+]
+
+'''function 2 builds the index and goes on with the histogram (function 3) by itself'''
+FUNCTIONS = [1, 2]
+CHIPS     = [1, 2, 4]
+RUN_TICKS = 10000
+
+EMULATOR    = '../../emulator/build/emulator'
+APPLICATION = '../../emulator/build/vertex.so'
+WORK_DIR    = 'benchmark'
+REPORT      = '../../resources/benchmark.json'
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+def dataset_name(dataset):
+    return "synthetic_{rows}_{unique}_{skew}_{string_length}".format(**dataset)
+
+def add_vertices(getData, number_of_chips, function_id):
+
+    #the even split of main.py
+    num_processors = number_of_chips * 16
+    partitions = list(partition_rows(getData.stream_rows(), getData.count_rows(), num_processors,
+                                     [0], 1, 16))
+
+    vertices = []
+    for core, partition in enumerate(partitions):
+        vertices.append(front_end.add_machine_vertex(
+            Vertex,
+            {
+            "columns":         1,
+            "rows":            partition.rows,
+            "string_size":     16,
+            "num_string_cols": 1,
+            "partition":       partition,
+            "initiate":        1 if core % 16 == 0 else 0,
+            "function_id":     function_id,
+            "state":           core,
+            "distinct":        partition.distinct
+            },
+            label="Data packet at x {}".format(core)))
+
+    make_circle(vertices, len(vertices), front_end)
+
+    return partitions
+
+def run_emulator(image, directory):
+
+    stats = os.path.join(directory, "stats.csv")
+    subprocess.check_call([EMULATOR, "-s", stats, APPLICATION, image, directory])
+
+    with open(stats, 'rb') as csvfile:
+        return list(csv.DictReader(csvfile))
+
+'''
+compares the recordings with the host: the last core of every ring records the rows of the ring
+(function 1), every value is recorded once with its frequency (function 2)'''
+def check_results(function_id, placements, directory, getData):
+
+    if function_id == 1:
+        rings = collections.defaultdict(int)
+        for core, placement in enumerate(placements):
+            counts = decode_ints(read_recording(directory, placement))
+            rings[core // 16] = max([rings[core // 16]] + counts)
+        return sum(rings.values()) == getData.count_rows(), None
+
+    histogram = collections.Counter()
+    for placement in placements:
+        for entry, frequency in decode_records(read_recording(directory, placement), "si"):
+            histogram[entry] += frequency
+
+    expected = collections.Counter(row[0] for row in getData.stream_rows())
+    return histogram == expected, len(histogram)
+
+def benchmark(dataset, function_id, number_of_chips):
+
+    name      = dataset_name(dataset)
+    filename  = os.path.join(WORK_DIR, name + ".csv")
+    directory = os.path.join(WORK_DIR, "{}_f{}_c{}".format(name, function_id, number_of_chips))
+    image     = directory + ".spem"
+
+    if not os.path.exists(filename):
+        write_synthetic_csv(filename, dataset["rows"], dataset["unique"], dataset["skew"],
+                            dataset["string_length"])
+    getData = parser(filename)
+
+    result = dict(dataset)
+    result.update({"function_id": function_id, "chips": number_of_chips,
+                   "cores": number_of_chips * 16})
+
+    front_end.setup(n_chips_required=number_of_chips, model_binary_folder=os.path.dirname(__file__))
+    try:
+        partitions = add_vertices(getData, number_of_chips, function_id)
+        front_end.run(RUN_TICKS)
+
+        placements = sorted([placement for placement in front_end.placements().placements
+                             if isinstance(placement.vertex, Vertex)],
+                            key=lambda p: (p.x, p.y, p.p))
+        write_machine_image(image, front_end.placements(), front_end.machine_graph(),
+                            front_end.routing_infos(), 'vertex.aplx', RUN_TICKS)
+    except exceptions.ConfigurationException as error:
+        #e.g. a partition that does not fit into DTCM
+        result["error"] = str(error)
+        return result
+    finally:
+        front_end.stop()
+
+    stats = run_emulator(image, directory)
+    correct, distinct = check_results(function_id, placements, directory, getData)
+
+    trace = os.path.join(directory, "trace.json")
+    write_chrome_trace(trace, [(placement, read_region(directory, placement, Vertex.DATA_REGIONS.TRACE.value))
+                               for placement in placements])
+
+    log = os.path.join(directory, "debug.log")
+    write_log(log, [(placement, read_region(directory, placement, Vertex.DATA_REGIONS.LOG.value))
+                    for placement in placements], Vertex.LOG_FORMATS)
+
+    result.update({
+        "time_to_result_us": max(float(core["packet_us"]) for core in stats),
+        "busy_us":           [float(core["busy_us"]) for core in stats],
+        "packets_sent":      sum(int(core["sent"]) for core in stats),
+        "packets_dropped":   sum(int(core["dropped"]) for core in stats),
+        "dictionary_sizes":  [partition.distinct for partition in partitions] if function_id != 1 else None,
+        "distinct":          distinct,
+        "heap_peak":         [int(core["heap_peak"]) for core in stats],
+        "profiles":          [Vertex.decode_profile(read_region(directory, placement,
+                                                            Vertex.DATA_REGIONS.PROFILE.value))
+                              for placement in placements],
+        "trace":             trace,
+        "log":               log,
+        "correct":           correct
+    })
+
+    return result
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+def benchmark_in_own_process(dataset_index, function_id, number_of_chips):
+
+    #a fresh interpreter for every run - the front end keeps state between setup and stop
+    name   = dataset_name(DATASETS[dataset_index])
+    output = os.path.join(WORK_DIR, "{}_f{}_c{}.json".format(name, function_id, number_of_chips))
+    if os.path.exists(output):
+        os.remove(output)
+
+    status = subprocess.call([sys.executable, os.path.abspath(__file__), "run",
+                              str(dataset_index), str(function_id), str(number_of_chips), output])
+    if status != 0 or not os.path.exists(output):
+        result = dict(DATASETS[dataset_index])
+        result.update({"function_id": function_id, "chips": number_of_chips,
+                       "cores": number_of_chips * 16,
+                       "error": "the run stopped with exit status {}".format(status)})
+        return result
+
+    with open(output, 'r') as result:
+        return json.load(result)
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+if __name__ == "__main__":
+
+    if not os.path.exists(WORK_DIR):
+        os.makedirs(WORK_DIR)
+
+    #python benchmark.py run <dataset> <function> <chips> <output>: one run, called by the sweep below
+    if len(sys.argv) == 6 and sys.argv[1] == "run":
+        result = benchmark(DATASETS[int(sys.argv[2])], int(sys.argv[3]), int(sys.argv[4]))
+        with open(sys.argv[5], 'w') as output:
+            json.dump(result, output)
+        sys.exit(0)
+
+    results = []
+    for dataset_index, dataset in enumerate(DATASETS):
+        for function_id in FUNCTIONS:
+            for number_of_chips in CHIPS:
+
+                result = benchmark_in_own_process(dataset_index, function_id, number_of_chips)
+                logger.info("%s function %d, %d cores: %s us, %s packets, correct: %s",
+                            dataset_name(dataset), function_id, result["cores"],
+                            result.get("time_to_result_us"), result.get("packets_sent"),
+                            result.get("correct", result.get("error")))
+                results.append(result)
+
+    with open(REPORT, 'w') as report:
+        json.dump(results, report, indent=1, sort_keys=True)
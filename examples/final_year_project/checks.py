@@ -0,0 +1,431 @@
+"""
+Regression checks of the applications on the native emulator (build it with make in emulator/,
+make check there builds it and runs them). The front end only maps the graph - set
+virtual_board = True in spiNNakerGraphFrontEnd.cfg.
+
+    python checks.py
+
+runs every check in a process of its own and exits with status 1 if one of them fails:
+    sort            function 4 across two rings, strings and integer keys from 2^31 on
+    append          rows appended to the resident data show up in the histogram after
+    columnar        a columnar dataset gives the same partitions and results as the csv
+    packing         the worker processes pack the same partitions as a single process
+    replay          a core fed its captured packets again records the same results
+    heat_demo       heat_demo converges in the iteration and to the temperatures of the host
+"""
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+from edges.circle import make_circle
+from vertex import Vertex
+from query_client import QueryClient
+from utilities.parser import parser
+from utilities.records import decode_records
+from utilities.ingest import partition_rows
+from utilities.columnar import ColumnarDataset, write_columnar, partition_columnar
+from utilities.synthetic import write_synthetic_csv
+from utilities.string_marshalling import convert_string_to_integer_parcel
+from utilities.emulation import write_machine_image, write_sdp_messages, read_sdp_replies, \
+                                read_recording, read_region
+from utilities.replay import decode_capture, write_capture, replay, first_divergence
+from utilities import workers
+
+import spinnaker_graph_front_end as front_end
+import benchmark
+import collections
+import logging
+import os
+import random
+import re
+import struct
+import subprocess
+import sys
+
+HEAT_DEMO_DIR = os.path.join(os.path.dirname(os.path.abspath(__file__)), '..', 'heat_demo')
+sys.path.append(HEAT_DEMO_DIR)
+
+from heat_demo_vertex import HeatDemoVertex
+from heat_demo_edge import HeatDemoEdge
+from heat_demo import grid_diameter
+
+logger = logging.getLogger(__name__)
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+WORK_DIR = os.path.join(benchmark.WORK_DIR, 'checks')
+
+HEAT_DEMO_APPLICATION = '../../emulator/build/heat_demo.so'
+
+'''the tag the emulator delivers the replies of resident mode to - any tag will do'''
+QUERY_TAG = 3
+
+'''a tag of the query traffic, as the front end would hand it to the data spec'''
+IPTag = collections.namedtuple("IPTag", ["tag", "traffic_identifier"])
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+def synthetic_dataset(rows, unique, string_length):
+
+    filename = os.path.join(WORK_DIR, "synthetic_{}_{}_{}.csv".format(rows, unique, string_length))
+    if not os.path.exists(filename):
+        write_synthetic_csv(filename, rows, unique, 0.0, string_length)
+    return parser(filename)
+
+'''
+integer keys on both sides of 2^31 and at the ends of the 32 bit range - vertex.c compares them unsigned'''
+def integer_dataset(rows):
+
+    filename = os.path.join(WORK_DIR, "integers_{}.csv".format(rows))
+    generator = random.Random(7)
+    with open(filename, 'w') as csvfile:
+        csvfile.write("Value\n")
+        for _ in range(0, rows):
+            csvfile.write("{}\n".format(generator.choice([
+                generator.randint(0, 2**31 - 1), generator.randint(2**31, 2**32 - 1), 0, 2**31, 2**32 - 1])))
+    return parser(filename)
+
+'''
+maps one vertex per partition into rings of 16 and writes the machine image - returns the placements of
+the vertices in the order of their partitions'''
+def map_vertices(image, partitions, number_of_chips, function_id, num_string_cols, run_ticks, iptags=False,
+                 **params):
+
+    front_end.setup(n_chips_required=number_of_chips, model_binary_folder=os.path.dirname(__file__))
+    try:
+        vertices = []
+        for core, partition in enumerate(partitions):
+            vertex_params = {
+                "columns":         1,
+                "rows":            partition.rows,
+                "string_size":     16,
+                "num_string_cols": num_string_cols,
+                "partition":       partition,
+                "initiate":        1 if core % 16 == 0 else 0,
+                "function_id":     function_id,
+                "state":           core,
+                "distinct":        partition.distinct
+            }
+            vertex_params.update(params)
+            vertices.append(front_end.add_machine_vertex(
+                Vertex, vertex_params, label="Data packet at x {}".format(core)))
+
+        make_circle(vertices, len(vertices), front_end)
+        front_end.run(run_ticks)
+
+        tags = None
+        if iptags:
+            tags = dict((vertex, [IPTag(QUERY_TAG, Vertex.QUERY_TRAFFIC)]) for vertex in vertices)
+        write_machine_image(image, front_end.placements(), front_end.machine_graph(),
+                            front_end.routing_infos(), 'vertex.aplx', run_ticks, iptags=tags)
+
+        return sorted([placement for placement in front_end.placements().placements
+                       if isinstance(placement.vertex, Vertex)], key=lambda p: p.vertex.state)
+    finally:
+        front_end.stop()
+
+def emulate(name, partitions, number_of_chips, function_id, num_string_cols, run_ticks=benchmark.RUN_TICKS,
+            **params):
+
+    directory = os.path.join(WORK_DIR, name)
+    placements = map_vertices(directory + ".spem", partitions, number_of_chips, function_id,
+                              num_string_cols, run_ticks, **params)
+    benchmark.run_emulator(directory + ".spem", directory)
+    return placements, directory
+
+'''-----------------------------------------------------------------------------------------------------'''
+'''
+every core records its share of the sorted rows, the cores in the order of their state hold them all'''
+def check_sort():
+
+    failures = []
+    for name, getData, num_string_cols, layout, key in [
+            ("sort_strings", synthetic_dataset(6000, 1000, 10), 1, "s", str),
+            ("sort_integers", integer_dataset(6000), 0, "i", long)]:
+
+        number_of_chips = 2
+        partitions = partition_rows(getData.stream_rows(), getData.count_rows(), number_of_chips * 16,
+                                    [0], num_string_cols, 16)
+        placements, directory = emulate(name, partitions, number_of_chips, 4, num_string_cols, 20000,
+                                        machine_cores=number_of_chips * 16)
+
+        recorded = []
+        for placement in placements:
+            recorded.extend(record[0] for record in decode_records(read_recording(directory, placement), layout))
+
+        if recorded != sorted(key(row[0]) for row in getData.stream_rows()):
+            failures.append(name)
+
+    return not failures, "not sorted: {}".format(failures) if failures else None
+
+'''
+resident mode: values new to the ring, known ones and one value appended on two cores are counted once
+in the histogram that follows'''
+def check_append():
+
+    getData = synthetic_dataset(6000, 100, 10)
+    rows = [row[0] for row in getData.stream_rows()]
+    partitions = partition_rows(getData.stream_rows(), len(rows), 16, [0], 1, 16)
+
+    directory = os.path.join(WORK_DIR, "append")
+    placements = map_vertices(directory + ".spem", partitions, 1, 0, 1, 4000, iptags=True,
+                              resident=True, append_capacity=8)
+
+    #(core, values): new values, known ones, a value new to the ring appended again on another core
+    batches = [(0, ["99:01", rows[3000]]), (5, ["99:02", rows[0], "99:01"]), (15, [rows[5999], "99:03"]),
+               (5, ["99:02"])]
+
+    def query(tick, sequence, function_id, arg1=0, arg2=0, data=()):
+        payload = struct.pack("<HHIII", function_id, sequence, arg1, arg2, 0) + \
+                  struct.pack("<{}I".format(len(data)), *data)
+        return [(tick, placement, QueryClient.QUERY_SDP_PORT, payload) for placement in placements]
+
+    messages = query(10, 1, 2)
+    for sequence, (core, values) in enumerate(batches, 2):
+        words = []
+        for value in values:
+            words.extend(convert_string_to_integer_parcel(value, 16))
+        messages.extend(query(500 * sequence, sequence, QueryClient.FUNCTION_APPEND, core, len(values), words))
+    histogram_sequence = len(batches) + 2
+    messages.extend(query(500 * histogram_sequence, histogram_sequence, 3))
+
+    write_sdp_messages(directory + ".sdp", messages)
+    subprocess.check_call([benchmark.EMULATOR, "-S", directory + ".sdp", benchmark.APPLICATION,
+                           directory + ".spem", directory])
+
+    data = bytearray()
+    done = collections.Counter()
+    for placement in placements:
+        for reply in read_sdp_replies(directory, placement):
+            cmd_rc, sequence, _, length, _ = struct.unpack_from("<HHIII", reply, QueryClient.REPLY_HEADER_OFFSET)
+            done[sequence] += cmd_rc == QueryClient.QUERY_DONE
+            if sequence == histogram_sequence:
+                data.extend(reply[QueryClient.REPLY_DATA_OFFSET:QueryClient.REPLY_DATA_OFFSET + length])
+
+    expected = collections.Counter(rows)
+    for _, values in batches:
+        expected.update(values)
+    histogram = collections.Counter()
+    for entry, frequency in decode_records(data, "si"):
+        if entry in histogram:
+            return False, "{} recorded twice".format(entry)
+        histogram[entry] = frequency
+
+    if any(done[sequence] != len(placements) for sequence in range(1, histogram_sequence + 1)):
+        return False, "not every core finished every query: {}".format(sorted(done.items()))
+    return histogram == expected, "the histogram differs from the host" if histogram != expected else None
+
+'''
+the slices of a columnar dataset are the packed blocks the csv is split into, and count the same'''
+def check_columnar():
+
+    getData = synthetic_dataset(20000, 1000, 10)
+    filename = os.path.join(WORK_DIR, "columnar.spcl")
+    write_columnar(filename, getData.stream_rows(), [0], 1, 16)
+    dataset = ColumnarDataset(filename)
+
+    slices = list(partition_columnar(dataset, 16))
+    partitions = partition_rows(getData.stream_rows(), getData.count_rows(), 16, [0], 1, 16)
+    for core, (columnar, packed) in enumerate(zip(slices, partitions)):
+        if (columnar.rows, columnar.distinct, columnar.image([core])) != \
+                (packed.rows, packed.distinct, packed.image([core])):
+            return False, "core {} gets another partition".format(core)
+
+    placements, directory = emulate("columnar", slices, 1, 2, 1)
+    correct, _ = benchmark.check_results(2, placements, directory, getData)
+    return correct, "the histogram differs from the host" if not correct else None
+
+'''
+the chunks packed by the worker processes are written in the order they were handed out'''
+def check_packing():
+
+    getData = synthetic_dataset(20000, 1000, 10)
+
+    images = []
+    for number_of_workers in (1, 4):
+        workers.WORKERS = number_of_workers
+        images.append([partition.image([core]) for core, partition in enumerate(
+            partition_rows(getData.stream_rows(), getData.count_rows(), 4, [0], 1, 16))])
+        workers.close()
+
+    return images[0] == images[1], "the partitions differ" if images[0] != images[1] else None
+
+'''
+the first, a middle and the last core of a ring are replayed from their capture of a histogram run'''
+def check_replay():
+
+    getData = synthetic_dataset(20000, 100, 10)
+    partitions = partition_rows(getData.stream_rows(), getData.count_rows(), 16, [0], 1, 16)
+    placements, directory = emulate("replay", partitions, 1, 2, 1, capture_packets=100000)
+
+    for placement in (placements[0], placements[7], placements[15]):
+        captured = read_region(directory, placement, Vertex.DATA_REGIONS.CAPTURE.value)
+        if not decode_capture(captured)[0]:
+            return False, "core {} captured no packets".format(placement.vertex.state)
+
+        replayed = directory + "_replay_{}".format(placement.vertex.state)
+        replay(benchmark.EMULATOR, benchmark.APPLICATION, directory + ".spem", placement,
+               write_capture(replayed + ".bin", captured), replayed)
+
+        divergence = first_divergence(
+            captured, read_region(replayed, placement, Vertex.DATA_REGIONS.CAPTURE.value))
+        if divergence is not None:
+            return False, "core {} diverges at packet {}".format(placement.vertex.state, divergence)
+        if read_recording(replayed, placement) != read_recording(directory, placement):
+            return False, "core {} records something else".format(placement.vertex.state)
+
+    return True, None
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+'''the grid of heat_demo.c - must match NORTH_INIT .. WEST_INIT and PARAM_CX, PARAM_CY there'''
+HEAT_BORDERS = {"north": 40 << 16, "east": 10 << 16, "south": 10 << 16, "west": 40 << 16}
+HEAT_PARAM   = 2048
+
+'''
+heat_demo.c on a single grid: the iteration the cores stop in and the mean temperature of every tile
+(row by row from the south west), all in 16.16 fixed point as there'''
+def solve_heat(width, height, converge_threshold, converge_period):
+
+    tile_rows, tile_columns = HeatDemoVertex.TILE_ROWS, HeatDemoVertex.TILE_COLUMNS
+    rows, columns = height * tile_rows, width * tile_columns
+    stride = columns + 2
+
+    grid = [0] * ((rows + 2) * stride)
+    for column in range(0, stride):
+        grid[column] = HEAT_BORDERS["south"]
+        grid[(rows + 1) * stride + column] = HEAT_BORDERS["north"]
+    for row in range(0, rows + 2):
+        grid[row * stride] = HEAT_BORDERS["west"]
+        grid[row * stride + columns + 1] = HEAT_BORDERS["east"]
+
+    #the cores check the largest change of the first iteration of the period before last
+    points = [row * stride + column for row in range(1, rows + 1) for column in range(1, columns + 1)]
+    threshold = int(round(converge_threshold * (1 << 16)))
+    changes = [None]
+    iteration = 0
+    while not (iteration >= 2 * converge_period and iteration % converge_period == 0
+               and changes[iteration - converge_period] < threshold):
+
+        new_grid = grid[:]
+        largest = 0
+        for point in points:
+            temp = grid[point]
+            new_temp = temp + ((HEAT_PARAM * (grid[point + 1] + grid[point - 1] - 2 * temp)) >> 16) + \
+                              ((HEAT_PARAM * (grid[point + stride] + grid[point - stride] - 2 * temp)) >> 16)
+            new_grid[point] = max(new_temp, 0)
+            largest = max(largest, abs(new_grid[point] - temp))
+
+        grid = new_grid
+        changes.append(largest)
+        iteration = iteration + 1
+
+    temps = []
+    for y in range(0, height):
+        for x in range(0, width):
+            total = sum(grid[(y * tile_rows + row + 1) * stride + x * tile_columns + column + 1]
+                        for row in range(0, tile_rows) for column in range(0, tile_columns))
+            temps.append(total // (tile_rows * tile_columns))
+    return iteration, temps
+
+'''
+a 3 by 3 grid with the shortest convergence period its diameter allows'''
+def check_heat_demo():
+
+    width, height, converge_threshold = 3, 3, 0.01
+
+    front_end.setup(n_chips_required=1, model_binary_folder=HEAT_DEMO_DIR)
+    try:
+        vertices = [[None] * height for _ in range(0, width)]
+        converge_period = grid_diameter([[True] * height for _ in range(0, width)]) + 1
+        for y in range(0, height):
+            for x in range(0, width):
+                vertices[x][y] = front_end.add_machine_vertex(
+                    HeatDemoVertex,
+                    {
+                    "machine_time_step":  1000,
+                    "time_scale_factor":  1,
+                    "converge_threshold": converge_threshold,
+                    "converge_period":    converge_period
+                    },
+                    label="Heat Element {}, {}".format(x, y))
+
+        HeatDemoVertex.check_converge_period(converge_period, grid_diameter(vertices))
+
+        #an edge tells the side of the receiver its sender is on
+        directions = HeatDemoEdge.DIRECTIONS
+        for x in range(0, width):
+            for y in range(0, height):
+                for dx, dy, direction in [(0, 1, directions.SOUTH), (1, 0, directions.WEST),
+                                          (0, -1, directions.NORTH), (-1, 0, directions.EAST)]:
+                    if 0 <= x + dx < width and 0 <= y + dy < height:
+                        front_end.add_machine_edge_instance(
+                            HeatDemoEdge(vertices[x][y], vertices[x + dx][y + dy], direction), "TRANSMISSION")
+
+        front_end.run(benchmark.RUN_TICKS)
+
+        directory = os.path.join(WORK_DIR, "heat_demo")
+        write_machine_image(directory + ".spem", front_end.placements(), front_end.machine_graph(),
+                            front_end.routing_infos(), 'heat_demo.aplx', 400000)
+        placements = dict((placement.vertex, placement) for placement in front_end.placements().placements)
+    finally:
+        front_end.stop()
+
+    subprocess.check_call([benchmark.EMULATOR, HEAT_DEMO_APPLICATION, directory + ".spem", directory])
+    iteration, temps = solve_heat(width, height, converge_threshold, converge_period)
+
+    for y in range(0, height):
+        for x in range(0, width):
+            placement = placements[vertices[x][y]]
+            with open(os.path.join(directory, "{}_{}_{}.iobuf".format(
+                    placement.x, placement.y, placement.p))) as iobuf:
+                output = iobuf.read()
+
+            converged = re.findall(r"converged after (\d+) iterations", output)
+            temp = re.findall(r"T = *([-\d.]+)", output)
+            expected = "{:.3f}".format(temps[y * width + x] / 65536.0)
+            if not converged or int(converged[-1]) != iteration or not temp or temp[-1] != expected:
+                return False, "element {}, {}: {} iterations, T = {} - the host {}, {}".format(
+                    x, y, converged[-1:], temp[-1:], iteration, expected)
+
+    return True, None
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+CHECKS = collections.OrderedDict([
+    ("sort",      check_sort),
+    ("append",    check_append),
+    ("columnar",  check_columnar),
+    ("packing",   check_packing),
+    ("replay",    check_replay),
+    ("heat_demo", check_heat_demo),
+])
+
+def check_in_own_process(name):
+
+    #a fresh interpreter for every check - the front end keeps state between setup and stop
+    return subprocess.call([sys.executable, os.path.abspath(__file__), "run", name]) == 0
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+if __name__ == "__main__":
+
+    logging.basicConfig(level=logging.INFO)
+
+    if not os.path.exists(WORK_DIR):
+        os.makedirs(WORK_DIR)
+
+    #python checks.py run <check>: one check, called by the loop below
+    if len(sys.argv) == 3 and sys.argv[1] == "run":
+        passed, reason = CHECKS[sys.argv[2]]()
+        if not passed:
+            logger.error("%s: %s", sys.argv[2], reason)
+        sys.exit(0 if passed else 1)
+
+    failed = []
+    for name in CHECKS:
+        passed = check_in_own_process(name)
+        logger.info("%s: %s", name, "passed" if passed else "FAILED")
+        if not passed:
+            failed.append(name)
+
+    sys.exit(1 if failed else 0)
@@ -15,6 +15,9 @@ def make_circle: Builds this cluster within a chip
 |                                  |
 ------------------------------------
 
+The machine ring joins all clusters: [15] of a chip leads to [00] of the next one and the
+last chip back to the first - the sort exchanges its rows on it
+
 '''
 
 from pacman.model.graphs.machine import MachineEdge
@@ -27,6 +30,12 @@ def make_circle(vertices, list_size, front_end):
         
         if vertices[x] is not None:           
             
+            #machine ring
+            front_end.add_machine_edge_instance(
+                MachineEdge(
+                    vertices[x], vertices[(x+1) % list_size],
+                    label=(x)), vertices[x].MACHINE_RING)
+            
             if x%16 < 15:
                 
                 #make ring
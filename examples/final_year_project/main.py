@@ -15,44 +15,61 @@ make
 
 from edges.circle import make_circle
 from vertex import Vertex 
+from query_client import QueryClient
 from utilities.parser import parser
+from utilities.bloom import bloom_parameters, bloom_false_positive_rate
+from utilities.records import decode_ints, decode_records
+from utilities.ingest import partition_rows, partition_rows_by_key, choose_splitters
+from utilities.ingest import build_dictionary, encode_rows, dictionary_id
+from utilities.ingest import partition_rows_balanced, mean_row_cost, assign_hot_values
+from utilities.workers import parallel_map, parallel_fetch
+from utilities.columnar import ColumnarDataset, write_columnar, partition_columnar
+from utilities.trace import write_chrome_trace
+from utilities.binary_log import write_log
+from utilities.replay import write_capture
+from utilities import workers
 
 import spinnaker_graph_front_end as front_end
 import logging
 import os
 import math
 
+'''packets every core keeps for a replay on the emulator (see save_captures), 0 - no capture'''
+CAPTURE_PACKETS = 0
+
 '''-----------------------------------------------------------------------------------------------------'''
 
-def display_results_function_one():
+def read_results(decode, *args):
     
-    for placement in sorted(placements.placements,
-        key=lambda p: (p.x, p.y, p.p)):
+    #the recordings of all cores are fetched one after the other - the buffer manager is not
+    #safe to call from several threads - and decoded by the worker processes in placement order
+    vertex_placements = [placement for placement in sorted(placements.placements,
+                         key=lambda p: (p.x, p.y, p.p)) if isinstance(placement.vertex, Vertex)]
+    
+    raw = [placement.vertex.read(placement, buffer_manager) for placement in vertex_placements]
+    
+    return zip(vertex_placements, parallel_map(decode, raw, *args))
 
-        if isinstance(placement.vertex, Vertex):
-            result = placement.vertex.read(placement, buffer_manager)
-            logger.info("{}, {}, {} > {}".format(
-            placement.x, placement.y, placement.p, result))
+def display_results_function_one():
+    
+    for placement, result in read_results(decode_ints):
+        logger.info("{}, {}, {} > {}".format(
+        placement.x, placement.y, placement.p, result))
 
 def display_results_function_two():
 
-    for placement in sorted(placements.placements,
-        key=lambda p: (p.x, p.y, p.p)):
-
-        if isinstance(placement.vertex, Vertex):
-        
-            result = placement.vertex.read(placement, buffer_manager)
+    for placement, result in read_results(decode_ints):
          
-            logger.info("|----------------|----|") 
-            logger.info("| Core {}, {}, {}".format(placement.x, placement.y, placement.p))   
-            logger.info("|----------------|----|") 
+        logger.info("|----------------|----|") 
+        logger.info("| Core {}, {}, {}".format(placement.x, placement.y, placement.p))   
+        logger.info("|----------------|----|") 
         
-        for x in range(0, 4):
-            start = 0  + 16*x;
-            end   = 15 + 16*x;
-            logger.info("| {}| {}".format(result[start:end],result[start+64:end+64]))
-            
-def display_results_function_three():
+        for x in range(0, len(result), 16):
+            logger.info("| {}".format(result[x:x+16]))
+        
+def display_results_function_three(dictionary=None):
+    
+    #dictionary: values of a host encoded column, the cores record (id, frequency) instead
     
     total = 0  
     
@@ -61,37 +78,20 @@ def display_results_function_three():
     
     logger.info("|------------------|----------|")
     
-    for placement in sorted(placements.placements,
-        key=lambda p: (p.x, p.y, p.p)):
+    for placement, records in read_results(decode_records, "si" if dictionary is None else "ii"):
+               
+        if dictionary is not None:
+            records = [(dictionary[id - 1], frequency) for id, frequency in records]
+               
+        for entry, frequency in records:   
 
-        if isinstance(placement.vertex, Vertex):
+            total = total + frequency
 
-            result = placement.vertex.read(placement, buffer_manager)
-                                
-            number_of_entries = len(result)/26
-                   
-            for entry in range(0,number_of_entries):   
-                            
-                string_start = 26*entry +  0;    
-                string_end   = 26*entry + 16;
-                int_start    = 26*entry + 16;
-                int_end      = 26*entry + 26;   
-                
-                temp1 = []
-                for x in range (int_start,int_end):
-                    if result[x] != 0:        
-                        temp1.append(result[x])
-                    else:
-                        break                         
-
-                total = total + int(''.join(chr(i) for i in temp1))
-
-                logger.info("| {} | {}".format(result[string_start:string_end], \
-                                               result[int_start:int_end]))
-                
-                entry_array.append(''.join(chr(i) for i in result[string_start:string_end]))
-                id_array.append(''.join(chr(i) for i in result[int_start:int_end]))
-                
+            logger.info("| {:16} | {}".format(entry, frequency))
+            
+            entry_array.append(entry)
+            id_array.append(frequency)
+            
          
     logger.info("|------------------|----------|")
     logger.info("| Total            | %d",  total)
@@ -110,123 +110,272 @@ def write_unique_ids_to_csv(getData,number_of_chips,num_data_rows):
     
     id_array = []
     
-    for placement in sorted(placements.placements,
-        key=lambda p: (p.x, p.y, p.p)):
-
-        if isinstance(placement.vertex, Vertex):
-            result = placement.vertex.read(placement, buffer_manager)
+    for placement, result in read_results(decode_ints):
         
         add_left_over = 0
         if core < leftovers:
             add_left_over = 1
 
-        for x in range(0, rows_per_core + add_left_over):
-            start = 0   + 10*x;
-            end   = 9   + 10*x;
-            id_array.append(''.join(chr(i) for i in result[start:end]))
-            #print ''.join(chr(i) for i in result[start:end])
-            
+        id_array.extend(result[0:rows_per_core + add_left_over])
+        
         core = core + 1
         
     getData.write_to_csv('../../resources/output.csv', id_array)
     
+def display_results_function_four(layout, dictionary=None):
+    
+    #layout: 's' for a sorted string column, 'i' for a sorted integer column
+    #dictionary: values of a host encoded column, sorted ids are turned back into values
+    sorted_array = []
+    
+    #the buckets follow the machine ring - core 0 holds the smallest keys, whatever its placement
+    for placement, result in sorted(read_results(decode_records, layout),
+                                    key=lambda placed: placed[0].vertex.state):
+        
+        number_of_entries = len(result)
+        
+        if dictionary is None:
+            sorted_array.extend(entry[0] for entry in result)
+        else:
+            sorted_array.extend(dictionary[entry[0] - 1] for entry in result)
+            
+        logger.info("| Core {}, {}, {} > {} rows".format(
+            placement.x, placement.y, placement.p, number_of_entries))
+        
+    getData.write_to_csv('../../resources/output_sorted.csv', sorted_array)
+    
+def display_results_function_five(queries):
+    
+    #only the leader of each ring records - one answer per query
+    for placement, result in read_results(decode_ints):
+        
+        if len(result) == 0:
+            continue
+        
+        logger.info("|------------------|-------|")
+        logger.info("| Ring led by {}, {}, {}".format(placement.x, placement.y, placement.p))
+        logger.info("|------------------|-------|")
+        
+        for query in range(0, len(queries)):
+            answer = "maybe" if result[query] == 1 else "no"
+            logger.info("| {:16} | {}".format(queries[query], answer))
+    
 def display_linked_list_size():
     
+    for placement, result in read_results(decode_ints):
+            
+        rows   = result[0]
+        length = result[1]
+         
+        logger.info("|----------------|") 
+        logger.info("| Core {}, {}, {}".format(placement.x, placement.y, placement.p))   
+        logger.info("| Rows %d",rows)
+        logger.info("| List %d",length)
+        logger.info("| TCM Memory for rows: %d bytes", (rows * 2))
+        logger.info("| TCM Memory for list: %d bytes", (length * 40))
+        logger.info("| TCM Memory total   : %d bytes", (rows * 2 + length * 40))
+def report_loads():
+    
+    #predicted share of the work next to the share of busy cycles the cores measured
+    loads = []
     for placement in sorted(placements.placements,
         key=lambda p: (p.x, p.y, p.p)):
 
         if isinstance(placement.vertex, Vertex):
-        
-            result = placement.vertex.read(placement, buffer_manager)
+            busy, packets = placement.vertex.read_load(placement, front_end.transceiver())
+            loads.append((placement, busy, packets))
+    
+    total_predicted = sum(placement.vertex.predicted_load for placement, busy, packets in loads) or 1
+    total_busy      = sum(busy for placement, busy, packets in loads) or 1
+    
+    logger.info("| Core       | Rows     | Predicted | Actual  | Packets  |")
+    for placement, busy, packets in loads:
+        logger.info("| {:3} {:2} {:2} | {:8} | {:8.2f}% | {:6.2f}% | {:8} |".format(
+            placement.x, placement.y, placement.p, placement.vertex.rows,
+            100.0 * placement.vertex.predicted_load / total_predicted,
+            100.0 * busy / total_busy, packets))
+    
+    if loads:
+        logger.info("Busiest core: %.2f times the mean",
+                    max(busy for placement, busy, packets in loads) * len(loads) / float(total_busy))
+
+def report_profiles():
+    
+    #counters every core kept during the run - no debug build needed
+    logger.info("| Core       | Sent      | Received  | Retries | Searches | Probes (max) | Inserts | Heap   | Ticks per function |")
+    for placement in sorted(placements.placements,
+        key=lambda p: (p.x, p.y, p.p)):
+
+        if isinstance(placement.vertex, Vertex):
+            profile = placement.vertex.read_profile(placement, front_end.transceiver())
+            logger.info("| {:3} {:2} {:2} | {:9} | {:9} | {:7} | {:8} | {:6.1f} ({:3}) | {:7} | {:6} | {} |".format(
+                placement.x, placement.y, placement.p,
+                profile["sent_ring"] + profile["sent_other"],
+                profile["received_ring"] + profile["received_command"] + profile["received_other"],
+                profile["send_retries"], profile["searches"],
+                profile["search_probes"] / float(profile["searches"] or 1), profile["search_probes_max"],
+                profile["inserts"], profile["heap_peak"], profile["phase_ticks"]))
             
-            temp1 = []
-            for x in range (0,10):
-                if result[x] != 0:        
-                    temp1.append(result[x])
-                else:
-                    break
+def write_trace():
+    
+    #phases, leader changes and rounds of every core on one timeline - open it in ui.perfetto.dev
+    vertex_placements = [placement for placement in placements.placements
+                         if isinstance(placement.vertex, Vertex)]
+    traces = parallel_fetch(lambda placement: placement.vertex.read_trace(placement, front_end.transceiver()),
+                            vertex_placements)
+    write_chrome_trace('../../resources/trace.json', zip(vertex_placements, traces))
+
+def write_debug_log():
+    
+    #the DEBUG_ messages of vertex.c (switched on at its top and with DEBUG_LOGGING in vertex.py),
+    #formatted here and merged by time
+    vertex_placements = [placement for placement in placements.placements
+                         if isinstance(placement.vertex, Vertex)]
+    logs = parallel_fetch(lambda placement: placement.vertex.read_log(placement, front_end.transceiver()),
+                          vertex_placements)
+    write_log('../../resources/debug.log', zip(vertex_placements, logs), Vertex.LOG_FORMATS)
+
+def save_captures(directory='../../resources/capture'):
+    
+    #the received packets of every core, one file each - replay one with utilities/replay.py
+    if not os.path.exists(directory):
+        os.makedirs(directory)
+    vertex_placements = [placement for placement in placements.placements
+                         if isinstance(placement.vertex, Vertex)]
+    captures = parallel_fetch(lambda placement: placement.vertex.read_capture(placement, front_end.transceiver()),
+                              vertex_placements)
+    for placement, capture in zip(vertex_placements, captures):
+        write_capture(os.path.join(directory, "{}_{}_{}.bin".format(placement.x, placement.y, placement.p)),
+                      capture)
             
-            temp2 = []
-            for x in range (10,20):
-                if result[x] != 0:        
-                    temp2.append(result[x])
-                else:
-                    break
-                
-            rows   = int(''.join(chr(i) for i in temp1))
-            length = int(''.join(chr(i) for i in temp2))
-         
-            logger.info("|----------------|") 
-            logger.info("| Core {}, {}, {}".format(placement.x, placement.y, placement.p))   
-            logger.info("| Rows %d",rows)
-            logger.info("| List %d",length)
-            logger.info("| TCM Memory for rows: %d bytes", (rows * 2))
-            logger.info("| TCM Memory for list: %d bytes", (length * 40))
-            logger.info("| TCM Memory total   : %d bytes", (rows * 2 + length * 40))
 '''-----------------------------------------------------------------------------------------------------'''
 
-def load_data_onto_vertices(data, number_of_chips, columns, num_string_cols, function_id):
-    
-    #get rid of the headers
-    del data[0]
+def load_data_onto_vertices(getData, number_of_chips, columns, num_string_cols, function_id,
+                            false_positive_rate=None, queries=None, resident=False, append_capacity=0,
+                            partition_mode=None, encode=False, dataset=None):
     
+    #the file is streamed - rows go straight into the packed block of their vertex
     num_processors = number_of_chips * 16
-    num_data_rows  = len(data)
+    
+    #or the csv is packed into a columnar dataset once, later runs map it and slice it
+    columnar = None
+    if dataset is not None:
+        if partition_mode is not None or encode:
+            raise Exception("a columnar dataset can only be split evenly")
+        if os.path.exists(dataset) and os.path.getmtime(dataset) >= os.path.getmtime(getData.filename):
+            columnar = ColumnarDataset(dataset)
+            if not columnar.matches(columns, num_string_cols, 16):
+                columnar.close()
+                columnar = None
+        if columnar is None:
+            logger.info("Packing %s into %s", getData.filename, dataset)
+            write_columnar(dataset, getData.stream_rows(), columns, num_string_cols, 16)
+            columnar = ColumnarDataset(dataset)
+        num_data_rows = columnar.rows
+    else:
+        num_data_rows = getData.count_rows()
     
     rows_per_core = int(math.floor(num_data_rows/num_processors))
     
-    leftovers = num_data_rows % num_processors
+    #size the membership filters for all rows of a ring
+    bloom_words  = 0
+    bloom_hashes = 0
+    if false_positive_rate is not None:
+        rows_per_ring = rows_per_core * 16 + 16
+        bloom_words, bloom_hashes = bloom_parameters(rows_per_ring, false_positive_rate)
+        logger.info("Bloom filter: %d words, %d hashes, false positive rate %f",
+                    bloom_words, bloom_hashes,
+                    bloom_false_positive_rate(rows_per_ring, bloom_words, bloom_hashes))
     
-    row_count = 0
+    #the host builds the dictionary of the first column once and ships ids instead of strings
+    rows             = getData.stream_rows()
+    packed_columns   = columns
+    packed_str_cols  = num_string_cols
+    key_column       = 0
+    dictionary       = None
+    if encode:
+        dictionary = build_dictionary(getData.stream_rows(), columns[0])
+        rows, packed_columns = encode_rows(rows, columns, num_string_cols, dictionary)
+        packed_str_cols = num_string_cols - 1
+        key_column      = num_string_cols - 1
+        logger.info("Dictionary: %d values", len(dictionary))
+    
+    #distribute the data evenly among the cores, by predicted work,
+    #or keep equal values of the first column together
+    key_partitioned = partition_mode in ('hash', 'range')
+    if columnar is not None:
+        partitions = partition_columnar(columnar, num_processors)
+    elif partition_mode is None:
+        partitions = partition_rows(rows, num_data_rows, num_processors,
+                                    packed_columns, packed_str_cols, 16, key_column)
+    elif partition_mode == 'balanced':
+        #the work of a row depends on the values around it - every row is looked at, not a sample
+        partitions = partition_rows_balanced(rows, num_data_rows, num_processors,
+                                             packed_columns, packed_str_cols, 16, key_column,
+                                             mean_row_cost(getData.stream_rows(), columns, num_string_cols,
+                                                           num_data_rows / num_processors),
+                                             Vertex.index_fits)
+    else:
+        sample    = getData.sample_rows(100 * num_processors)
+        splitters = None
+        hot       = None
+        if partition_mode == 'range':
+            splitters = choose_splitters([row[columns[0]] for row in sample], num_processors)
+            if encode:
+                splitters = [dictionary_id(dictionary, splitter) for splitter in splitters]
+        else:
+            #values too frequent for a single hash bucket get a core of their own choosing
+            hot = assign_hot_values(sample, num_data_rows, num_processors, columns, num_string_cols)
+            if encode:
+                hot = dict((dictionary_id(dictionary, value), core) for value, core in hot.items())
+            logger.info("Hot values: %d", len(hot))
+        partitions = partition_rows_by_key(rows, num_processors, packed_columns, packed_str_cols, 16,
+                                           partition_mode, splitters, key_column, hot)
 
     vertices = []
-    for core in range(0, num_processors):
+    for core, partition in enumerate(partitions):
             
         #initiate if this is the first vertex in the circle
         initiate = 0
         if core%16 == 0:
             initiate = 1
-          
-        #distribute the data evenly among the cores
-        add_leftover = 0
-        if core < leftovers:
-            add_leftover = 1
-            
-        data_parcel = [] 
-        
-        for row in range(0, rows_per_core + add_leftover):
-            
-            data_row = []  
-            for z in range(0, len(columns)):
-                data_row.append(data[row_count][columns[z]])
-            
-            row_count = row_count + 1  
-            data_parcel.append(data_row)
             
         #load information onto the vertex             
         current_vertex = front_end.add_machine_vertex(
             Vertex,
             {
             "columns":         len(columns),
-            "rows":            rows_per_core + add_leftover,
+            "rows":            partition.rows,
             "string_size":     16,
-            "num_string_cols": num_string_cols,
-            "entries":         data_parcel,
+            "num_string_cols": packed_str_cols,
+            "partition":       partition,
             "initiate":        initiate,
             "function_id":     function_id,
-            "state":           core
+            "state":           core,
+            "bloom_words":     bloom_words,
+            "bloom_hashes":    bloom_hashes,
+            "queries":         queries,
+            "resident":        resident,
+            "append_capacity": append_capacity,
+            "distinct":        partition.distinct,
+            "key_partitioned": key_partitioned,
+            "num_encoded_ids": len(dictionary) if encode else 0,
+            "predicted_load":  partition.cost,
+            "machine_cores":   num_processors,
+            "capture_packets": CAPTURE_PACKETS
             },
             label="Data packet at x {}".format(core))   
            
         vertices.append(current_vertex)   
             
     make_circle(vertices, len(vertices), front_end)
+    
+    return dictionary
         
 '''-----------------------------------------------------------------------------------------------------'''
         
 #read the csv data with help form the parser class
 getData = parser('../../resources/date.csv')
-raw_data = getData.read_data()
 
 logger = logging.getLogger(__name__)
 
@@ -239,21 +388,84 @@ calculate total number of 'free' cores for the given board
 total_number_of_cores = \
     front_end.get_number_of_available_cores_on_machine()
 
-#param1: data
-#param2: number of chips used
-#param3: what columns to use
-#param4: how many string columns exist?
-#param5: function id
-load_data_onto_vertices(raw_data, 1, [0], 1, 2)
+#the worker processes are stopped however the run ends
+try:
+    #param1: parser of the csv file
+    #param2: number of chips used
+    #param3: what columns to use
+    #param4: how many string columns exist?
+    #param5: function id
+    load_data_onto_vertices(getData, 1, [0], 1, 2)
+    #load_data_onto_vertices(getData, 1, [0], 1, 4) -> sort the first column
+    #param6: false positive rate of the membership filters (None -> no filters)
+    #param7: values to look up with function 5
+    #load_data_onto_vertices(getData, 1, [0], 1, 5, 0.01, ["01/11/2016", "31/02/2016"])
+    #param8: resident mode - load with function id 0 and send queries afterwards (see below)
+    #load_data_onto_vertices(getData, 1, [0], 1, 0, 0.01, None, True)
+    #param9: rows each core can take in after loading (resident mode, function 6)
+    #load_data_onto_vertices(getData, 1, [0], 1, 0, 0.01, None, True, 1000)
+    #param10: None -> even split, 'balanced' -> same predicted work on every core,
+    #         'hash' or 'range' -> equal values of the first column on one core
+    #load_data_onto_vertices(getData, 1, [0], 1, 2, None, None, False, 0, 'balanced')
+    #load_data_onto_vertices(getData, 1, [0], 1, 2, None, None, False, 0, 'hash')
+    #param11: ship ids instead of strings - keep the returned dictionary to decode the results
+    #dictionary = load_data_onto_vertices(getData, 1, [0], 1, 2, None, None, False, 0, None, True)
+    #param12: columnar dataset - packed from the csv on the first run (or when the csv changed), mapped after
+    #load_data_onto_vertices(getData, 1, [0], 1, 2, None, None, False, 0, None, False, '../../resources/date.spcl')
+
+    front_end.run(10000)
+
+    placements = front_end.placements()
+    buffer_manager = front_end.buffer_manager()
+
+    '''
+    resident mode: run(None) leaves the cores running, every query then takes milliseconds
+    front_end.run(None)
+    client = QueryClient(front_end.transceiver(), front_end.placements(), Vertex, Vertex.QUERY_REPLY_PORT)
+    client.query(2)               -> builds dictionary and index once, records the histogram
+    histogram = client.query(3)   -> histogram over the index kept in memory
+    words = convert_string_to_integer_parcel("01/11/2016", 16)
+    answers = client.query(5, 1, data=words)
+    client.append([["05/11/2016"], ["06/11/2016"]], 16, 1) -> new rows, index and histogram kept up to date
+    histogram = client.query(3)
+    client.close()
+    '''
+
+    '''
+    emulated run: the same cores as native threads on this machine, no board needed
+    (build the emulator and the applications with make in emulator/)
+    from utilities.emulation import write_machine_image, read_recording
+    front_end.run(10000) with virtual_board = True in spiNNakerGraphFrontEnd.cfg
+    write_machine_image('vertex.spem', front_end.placements(), front_end.machine_graph(),
+                        front_end.routing_infos(), 'vertex.aplx', 10000)
+    ../../emulator/build/emulator -v ../../emulator/build/vertex.so vertex.spem emulated
+    records = decode_records(read_recording('emulated', placement), "si")
 
-front_end.run(10000)
+    resident mode emulated: pass iptags= to write_machine_image, write the queries with their ticks
+    write_sdp_messages('queries.sdp', [(10, placement, QueryClient.QUERY_SDP_PORT, payload), ...])
+    ../../emulator/build/emulator -S queries.sdp ../../emulator/build/vertex.so vertex.spem emulated
+    replies = read_sdp_replies('emulated', placement) -> as QueryClient receives them
 
-placements = front_end.placements()
-buffer_manager = front_end.buffer_manager()
+    replay of one core: set CAPTURE_PACKETS, run on the board, save_captures(), then write the machine
+    image of the same graph as above and feed the core its packets again - off-board and repeatable
+    from utilities.replay import replay
+    replay('../../emulator/build/emulator', '../../emulator/build/vertex.so', 'vertex.spem',
+           placement, '../../resources/capture/0_0_3.bin', 'replayed')
+    '''
 
-#write_unique_ids_to_csv(getData,1,len(raw_data))
-#display_linked_list_size()
-#display_results_function_one()
-#display_results_function_two()
-display_results_function_three()
-front_end.stop()
+    #write_unique_ids_to_csv(getData,1,getData.count_rows())
+    #display_linked_list_size()
+    #display_results_function_one()
+    #display_results_function_two()
+    display_results_function_three()
+    #display_results_function_three(dictionary)
+    #display_results_function_four('s')
+    #display_results_function_five(["01/11/2016", "31/02/2016"])
+    #report_loads()
+    #report_profiles()
+    #write_trace()
+    #write_debug_log()
+    #save_captures()
+    front_end.stop()
+finally:
+    workers.close()
@@ -0,0 +1,125 @@
+"""
+Sends queries to vertices running in resident mode and collects their replies
+"""
+
+from spinnman.messages.sdp import SDPMessage, SDPHeader, SDPFlag
+from utilities.string_marshalling import convert_string_to_integer_parcel
+
+import socket
+import struct
+
+class QueryClient(object):
+    
+    #must match QUERY_SDP_PORT, server_replies and server_rejections in vertex.c
+    QUERY_SDP_PORT = 2
+    QUERY_DATA     = 1
+    QUERY_DONE     = 2
+    QUERY_REJECTED = 3
+    REJECTIONS     = {1: "another query is still running", 2: "there is no such function"}
+    
+    #must match FUNCTION_APPEND and SDP_DATA_SIZE in vertex.c
+    FUNCTION_APPEND = 6
+    MAX_DATA_WORDS  = 64
+    
+    #2 bytes padding, 8 bytes SDP header, 16 bytes command header
+    REPLY_HEADER_OFFSET = 10
+    REPLY_DATA_OFFSET   = 26
+    
+    def __init__(self, transceiver, placements, vertex_class, port, timeout=10.0):
+        
+        self._transceiver = transceiver
+        self._seq = 0
+        
+        '''
+        every core of every ring takes part in a query'''
+        self._placements = sorted(
+            [placement for placement in placements.placements
+             if isinstance(placement.vertex, vertex_class)],
+            key=lambda p: (p.x, p.y, p.p))
+        
+        self._socket = socket.socket(socket.AF_INET, socket.SOCK_DGRAM)
+        self._socket.bind(("0.0.0.0", port))
+        self._socket.settimeout(timeout)
+        
+    def query(self, function_id, arg1=0, arg2=0, arg3=0, data=None):
+        
+        '''
+        runs function_id on the loaded data and returns the bytes each core
+        would otherwise have recorded, keyed by the core's state'''
+        self._seq = (self._seq + 1) & 0xFFFF
+        
+        if data is None:
+            data = []
+        
+        payload = struct.pack("<HHIII", function_id, self._seq, arg1, arg2, arg3) + \
+                  struct.pack("<{}I".format(len(data)), *data)
+        
+        results = {}
+        for placement in self._placements:
+            
+            results[placement.vertex.state] = bytearray()
+            
+            header = SDPHeader(
+                flags=SDPFlag.REPLY_NOT_EXPECTED,
+                destination_port=self.QUERY_SDP_PORT,
+                destination_cpu=placement.p,
+                destination_chip_x=placement.x,
+                destination_chip_y=placement.y)
+            self._transceiver.send_sdp_message(SDPMessage(header, data=payload))
+            
+        #collect replies until every core has reported the query done
+        pending = set(results.keys())
+        while pending:
+            
+            packet = self._socket.recv(512)
+            
+            cmd_rc, seq, core, length, _ = struct.unpack_from(
+                "<HHIII", packet, self.REPLY_HEADER_OFFSET)
+            
+            #late replies of an earlier query
+            if seq != self._seq or core not in results:
+                continue
+            
+            if cmd_rc == self.QUERY_REJECTED:
+                raise Exception("core {} rejected query {}: {}".format(
+                    core, function_id, self.REJECTIONS.get(length, "unknown reason")))
+            
+            results[core].extend(
+                packet[self.REPLY_DATA_OFFSET:self.REPLY_DATA_OFFSET + length])
+            
+            if cmd_rc == self.QUERY_DONE:
+                pending.discard(core)
+                
+        return results
+    
+    def append(self, rows, string_size, num_string_cols):
+        
+        '''
+        adds rows to the resident data - each row goes to the core of its ring
+        holding the fewest rows, the ring keeps index and histogram up to date'''
+        row_words = num_string_cols * (string_size / 4) + \
+                    (len(rows[0]) - num_string_cols if rows else 0)
+        batch_size = max(1, self.MAX_DATA_WORDS / row_words)
+        
+        owners = [placement.vertex for placement in self._placements]
+        
+        results = {}
+        for start in range(0, len(rows), batch_size):
+            
+            batch = rows[start:start + batch_size]
+            owner = min(owners, key=lambda vertex: (vertex.rows, vertex.state))
+            
+            data = []
+            for row in batch:
+                for i in range(0, num_string_cols):
+                    data.extend(convert_string_to_integer_parcel(row[i], string_size))
+                for i in range(num_string_cols, len(row)):
+                    data.append(int(row[i]))
+                    
+            results.update(self.query(self.FUNCTION_APPEND, owner.state, len(batch), data=data))
+            owner.rows += len(batch)
+            
+        return results
+    
+    def close(self):
+        self._socket.close()
@@ -0,0 +1,111 @@
+"""
+Capacity planning for the index and histogram functions with the model of utilities/protocol_model.py
+
+    python scaling.py
+
+checks the model against the runs of benchmark.py first: the packets every core sent and
+received and the dictionary searches it made, taken from the PROFILE regions in REPORT, are
+compared with a model of the same partitions. Then every dataset of PLANNING is predicted for
+every machine size of CORES and written to PREDICTIONS:
+    time_to_result_us     until the last core recorded its values
+    packets_sent          multicast packets of all rings
+    router_packets_max    packets through the busiest router, and per second
+    link_packets_max      packets over the busiest chip to chip link (0 - rings stay on a chip)
+    distinct_per_ring     values the sampled rings hold - a histogram round for each
+"""
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+from benchmark import dataset_name, DATASETS, WORK_DIR, REPORT
+from utilities.parser import parser
+from utilities.ingest import partition_rows
+from utilities.protocol_model import ModelParameters, RingModel, ring_statistics, predict_machine
+from utilities.protocol_model import validate, RING_SIZE
+
+import json
+import logging
+import os
+
+logger = logging.getLogger(__name__)
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+'''rows, distinct values and zipf skew of the datasets to plan for'''
+PLANNING = [
+    {"rows": 200000, "unique": 2000, "skew": 0.0},
+    {"rows": 200000, "unique": 2000, "skew": 1.0},
+]
+
+CORES        = [16, 64, 256, 1024, 4096]
+SAMPLE_RINGS = 3
+PREDICTIONS  = '../../resources/scaling.json'
+
+'''model costs - calibrate them against board runs'''
+PARAMETERS = ModelParameters()
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+'''the values of every core of the first ring, split like benchmark.add_vertices()'''
+def ring_values(filename):
+
+    getData = parser(filename)
+    values  = [row[0] for row in getData.stream_rows()]
+    counts  = [partition.rows for partition in
+               partition_rows(getData.stream_rows(), getData.count_rows(), RING_SIZE, [0], 1, 16)]
+
+    cores, position = [], 0
+    for count in counts:
+        cores.append(values[position:position + count])
+        position = position + count
+
+    return cores
+
+'''compares the model with the single chip index runs of the benchmark report'''
+def validate_against_benchmark():
+
+    with open(REPORT) as report:
+        runs = json.load(report)
+
+    comparisons = []
+    for run in runs:
+
+        if run.get("function_id") != 2 or run.get("chips") != 1 or not run.get("profiles"):
+            continue
+
+        dataset  = dict((key, run[key]) for key in DATASETS[0].keys())
+        filename = os.path.join(WORK_DIR, dataset_name(dataset) + ".csv")
+        if not os.path.exists(filename):
+            continue
+
+        model = RingModel(ring_statistics(ring_values(filename)), PARAMETERS).run()
+        comparison = validate(model.prediction(), run["profiles"])
+        comparison["dataset"] = dataset_name(dataset)
+
+        logger.info("%s: %s", comparison["dataset"],
+                    ", ".join("{} {}".format(name, value["ratio"]) for name, value in
+                              sorted(comparison.items()) if isinstance(value, dict)))
+        comparisons.append(comparison)
+
+    return comparisons
+
+'''-----------------------------------------------------------------------------------------------------'''
+
+if __name__ == "__main__":
+
+    validation = validate_against_benchmark() if os.path.exists(REPORT) else []
+
+    predictions = []
+    for dataset in PLANNING:
+        for cores in CORES:
+
+            prediction = predict_machine(cores, dataset["rows"], dataset["unique"], dataset["skew"],
+                                         PARAMETERS, SAMPLE_RINGS)
+            prediction.update(dataset)
+            logger.info("%d rows, %d values, skew %s on %d cores: %.0f us, %d packets",
+                        dataset["rows"], dataset["unique"], dataset["skew"], cores,
+                        prediction["time_to_result_us"], prediction["packets_sent"])
+            predictions.append(prediction)
+
+    with open(PREDICTIONS, 'w') as output:
+        json.dump({"parameters": vars(PARAMETERS), "validation": validation,
+                   "predictions": predictions}, output, indent=1, sort_keys=True)
@@ -6,13 +6,22 @@
 #include <simulation.h>
 #include <debug.h>
 
-/* Debugging mode */
+/* Debugging mode - the messages go to the LOG region (see log_binary). Off by default: with
+ * DEBUG_1 and DEBUG_2 on, function 2 on date.csv took 9% longer in the emulator and the busiest
+ * core 20% more cycles. The flags can also be given to the compiler (-DDEBUG_1=1); the host
+ * reserves the LOG region only with DEBUG_LOGGING in vertex.py */
+#ifndef DEBUG_1
 #define DEBUG_1 0
+#endif
+#ifndef DEBUG_2
 #define DEBUG_2 0
+#endif
+#ifndef DEBUG_3
 #define DEBUG_3 0
+#endif
+#ifndef DEBUG_4
 #define DEBUG_4 0
-#define DEBUG_START 6000
-#define DEBUG_END   6050
+#endif
 /* 0 Default information about cores
  * DEBUG_1 Enables information about messages received and sent
  * DEBUG_2 Debug info on the id distribution algorithm
@@ -20,6 +29,10 @@
  * DEBUG_4 Shows timer ticks
  */
 
+/* Layout of the INPUT_DATA region and the ring */
+#define HEADER_SIZE 9
+#define RING_SIZE   16
+
 #define RECORD_IDS 0
 #define RECORD_LINKED_LIST_LENGTHS 0
 #define RECORD_UNIQUE_ITEMS 1
@@ -56,7 +69,15 @@ typedef enum regions_e {
 	OUTPUT_DATA,
     TRANSMISSIONS,
     STATE,
-    NEIGHBOUR_INITIAL_STATES
+    NEIGHBOUR_INITIAL_STATES,
+    NEIGHBOUR_KEYS,
+    BLOOM,
+    SERVER,
+    LOAD,
+    PROFILE,
+    TRACE,
+    LOG,
+    CAPTURE
 } regions_e;
 
 //! values for the priority for each callback
@@ -69,6 +90,11 @@ typedef enum transmission_region_elements {
     KEY_ONE_EXISTS, KEY_ONE, KEY_TWO_EXISTS, KEY_TWO
 } transmission_region_elements;
 
+//! human readable definitions of each element in the neighbour keys region
+typedef enum neighbour_key_elements {
+    RING_IN_KEY, COMMAND_IN_KEY, MACHINE_RING_IN_KEY, MACHINE_CORES, MACHINE_POSITION
+} neighbour_key_elements;
+
 //! values for the states
 typedef enum states_values{
     ALIVE = 1, DEAD = 0
@@ -112,16 +138,30 @@ struct header_info {
     */
    uint function_id;
    /* holds id of function to be invoked
-    * 0 - None
+    * 0 - None, wait for queries from the host (resident mode)
     * 1 - Count number of all data entries within the graph
     * 2 - Builds an index table in every core within the network
     * 3 - Extracts number of unique entries from SDRAM
+    * 4 - Sorts the first column across all cores of the ring
+    * 5 - Answers membership queries from the merged Bloom filters of the ring
+    * 6 - Appends rows sent by the host (resident mode)
+    */
+   uint key_partitioned;
+   /* if 1, the host put all rows with the same value on the same core
+    * dictionaries are disjoint and ids follow from a prefix sum over the ring
+    */
+   uint num_encoded_ids;
+   /* if not 0, the host replaced the indexed string column by ids 1..num_encoded_ids
+    * the ids are the first integer column and functions 2 and 3 count them directly
     */
 
 };
 
 struct header_info header;
 
+//start of the INPUT_DATA region
+uint *input_data;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // DATA ENTRY INDEX - assigns unqiue id's to every data entry within every column           //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -164,6 +204,7 @@ struct index_info {
 typedef struct node {
 	uint *entry;
 	char entry_size;
+	char appended; //first seen in a row appended to this core, recorded here
 	uint16_t id;
 	uint16_t frequency;
 	uint16_t global_frequency;
@@ -191,6 +232,495 @@ uint linked_list_length;
 
 uint sum;
 
+//keys of incoming edges - NO_KEY if there is no such edge
+uint ring_in_key;
+uint command_in_key;
+uint machine_ring_in_key;
+
+//the ring through every core of the machine (used by the sort) and the place of this core in it
+uint machine_cores;
+uint machine_position;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// SAMPLE SORT INFO - orders the first column across all cores of the machine                    //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define SORT_ROWS_PER_TICK 32
+/* rows handed to the machine ring on every timer tick during the exchange */
+
+#define SORT_FRAME_WORDS 16
+/* longest frame on the machine ring - the header and a key of up to 15 words */
+
+//! phases of the sample sort
+typedef enum sort_phases {
+    SORT_IDLE, SORT_WAIT_READY, SORT_GATHER, SORT_SPLIT, SORT_EXCHANGE, SORT_DONE
+} sort_phases;
+
+//! signals sent by the leader - 0 to 3 are taken by the index and histogram functions
+typedef enum sort_signals {
+    SORT_SAMPLE_REQUEST = 4
+} sort_signals;
+
+//! frames on the machine ring, header word: type << 24 | words that follow << 16 | destination
+typedef enum sort_frames {
+    SORT_FRAME_ROW = 1, SORT_FRAME_SAMPLE_REQUEST = 2, SORT_FRAME_SAMPLE = 3,
+    SORT_FRAME_SPLITTER = 4, SORT_FRAME_COUNT = 5
+} sort_frames;
+
+struct sort_info {
+
+	uint phase;
+	/* One of sort_phases
+	 */
+	uint key_words;
+	/* Number of words that make up one sort key
+	 * string_size/4 for a string column, 1 for an integer column
+	 */
+	uint is_string;
+	/* Strings compare word by word, integers as one word - both unsigned
+	 */
+	uint16_t *order;
+	/* Local row order after the local sort (SDRAM)
+	 * index < num_rows refers to a row of the column above,
+	 * index >= num_rows to a row received during the exchange
+	 */
+	uint16_t *scratch;
+	/* Second buffer used by the merge kernel (SDRAM)
+	 */
+	uint *samples;
+	uint num_sample_words;
+	/* Ring leaders: row count and RING_SIZE-1 regular samples of every core of the ring,
+	 * core 0 of the machine collects those of all cores (SDRAM)
+	 */
+	uint samples_requested;
+	/* Ring leader: core 0 of the machine has asked for the samples of the ring
+	 */
+	uint *splitters;
+	uint num_splitter_words;
+	/* machine_cores-1 keys that separate the buckets (SDRAM)
+	 * bucket b holds splitters[b-1] <= key < splitters[b]
+	 */
+	uint *bucket_start;
+	/* Local rows of bucket b (the core at position b of the machine ring) are
+	 * order[bucket_start[b]] to order[bucket_start[b+1]-1] (SDRAM)
+	 */
+	uint bucket;
+	/* Ring leader: core currently polled for samples
+	 */
+	uint counts_seen;
+	/* Count frames started, passed on or received here - rows are sent once all are through
+	 */
+	uint send_bucket;
+	uint next_to_send;
+	/* Exchange progress through the local order
+	 */
+	uint counted;
+	uint expected;
+	/* Rows this core receives from the others, known once its count frame is back
+	 */
+	uint *received;
+	uint num_received;
+	uint recorded;
+	/* The bucket has been merged and recorded
+	 */
+	uint frame[SORT_FRAME_WORDS];
+	uint frame_count;
+	/* A frame on the machine ring, collected before it is used or passed on
+	 */
+	uint command_message[5];
+	uint command_count;
+
+};
+
+struct sort_info sort;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// KEY PARTITIONED INDEX INFO - equal values were placed on the same core by the host            //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+struct partitioned_info {
+
+	uint offset;
+	/* Distinct values of all earlier cores of the ring - local ids are moved up by this
+	 */
+	uint offset_received;
+	/* Set if the offset came in before the local dictionary was complete
+	 */
+
+};
+
+struct partitioned_info partitioned;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// ENCODED HISTOGRAM INFO - the host shipped ids instead of strings                              //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! marks the end of the counts a subordinate reports
+#define ENCODED_DONE 0
+
+struct encoded_info {
+
+	uint *counts;
+	/* Occurrences of every id, indexed by the id itself (SDRAM)
+	 */
+	uint reported_done;
+	/* Leader: subordinates that have sent all their counts
+	 */
+	uint initialised;
+	uint counted;
+	/* The array is zeroed for the current query, the rows of this core are in it
+	 */
+
+};
+
+struct encoded_info encoded;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LOAD INFO - work done by the core, read by the host to compare with the predicted load        //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! human readable definitions of each element in the load region
+typedef enum load_region_elements {
+    LOAD_BUSY_LOW, LOAD_BUSY_HIGH, LOAD_PACKETS
+} load_region_elements;
+
+struct load_info {
+
+	address_t region;
+	uint64_t busy_cycles;
+	/* Cycles spent in the tick and packet callbacks, timer 2 counts them down
+	 */
+	uint packets;
+
+};
+
+struct load_info load;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PROFILE INFO - counters written at the end of the run, read by the host to find hot spots     //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! one entry of ticks per phase for each function id
+#define NUM_PHASES 7
+
+//! human readable definitions of each element in the profile region
+typedef enum profile_region_elements {
+    PROFILE_SENT_RING, PROFILE_SENT_OTHER, PROFILE_SENT_MACHINE_RING,
+    PROFILE_RECEIVED_RING, PROFILE_RECEIVED_COMMAND, PROFILE_RECEIVED_OTHER,
+    PROFILE_RECEIVED_MACHINE_RING,
+    PROFILE_SEND_RETRIES,
+    PROFILE_SEARCHES, PROFILE_SEARCH_PROBES, PROFILE_SEARCH_PROBES_MAX,
+    PROFILE_COMPARES, PROFILE_INSERTS,
+    PROFILE_HEAP_PEAK,
+    PROFILE_PHASE_TICKS
+} profile_region_elements;
+
+struct profile_info {
+
+	address_t region;
+	uint sent[3];
+	/* Packets sent on the ring partition, on the second one (commands or reports) and on the
+	 * machine ring
+	 */
+	uint received[4];
+	/* Packets received with the ring key, the command key, any other key (reports) and the
+	 * machine ring key
+	 */
+	uint send_retries;
+	uint searches;
+	uint search_probes;
+	uint search_probes_max;
+	uint compares;
+	uint inserts;
+	uint heap_free_start;
+	uint heap_free_min;
+	/* Largest free block of the DTCM heap, sampled every tick
+	 */
+	uint active;
+	uint phase_ticks[NUM_PHASES];
+	/* Ticks in which the core sent or received packets, by the function it was running
+	 */
+
+};
+
+struct profile_info profile;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TRACE INFO - timestamped events in a ring buffer, merged into a timeline by the host          //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! human readable definitions of each element in the trace region
+typedef enum trace_region_elements {
+    TRACE_CAPACITY, TRACE_WRITTEN, TRACE_TIMER_PERIOD, TRACE_EVENTS
+} trace_region_elements;
+
+//! every event is the tick, the cycles since the tick started and (event << 24 | argument)
+#define TRACE_EVENT_WORDS 3
+
+//! events - phases are the function ids, and PHASE_RECORD while results are recorded
+typedef enum trace_events {
+    TRACE_BEGIN, TRACE_END, TRACE_LEADER, TRACE_ROUND, TRACE_TIMEOUT
+} trace_events;
+
+#define PHASE_RECORD 7
+#define PHASE_NONE   0xFF
+
+struct trace_info {
+
+	address_t region;
+	uint capacity;
+	uint written;
+	uint next;
+	/* Slot of the next event - wraps without a division
+	 */
+	uint tick_start;
+	/* Timer 2 when the current tick started - it counts cycles down
+	 */
+	uint phase;
+
+};
+
+struct trace_info trace;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LOG INFO - binary debug messages in a ring buffer, formatted by the host                      //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! human readable definitions of each element in the log region
+typedef enum log_region_elements {
+    LOG_CAPACITY, LOG_WRITTEN, LOG_TIMER_PERIOD, LOG_RECORDS
+} log_region_elements;
+
+//! every record is the tick, the cycles since the tick started, the format and its arguments
+#define LOG_ARGUMENTS    5
+#define LOG_RECORD_WORDS (3 + LOG_ARGUMENTS)
+
+//! formats - the strings are LOG_FORMATS in vertex.py, in the same order
+typedef enum log_formats {
+    LOG_TICK, LOG_TIMEOUT_CHECK, LOG_PACKET,
+    LOG_SEND_STRING, LOG_FORWARD, LOG_SIGNAL, LOG_FUNCTION_SIGNAL,
+    LOG_ACKNOWLEDGE, LOG_SEND_FREQUENCY, LOG_SEND_RECORDED,
+    LOG_RECEIVED, LOG_MESSAGE, LOG_NEXT_LEADER, LOG_QUERY, LOG_OLD_LEADER,
+    LOG_SEARCH, LOG_PROBE, LOG_ADD, LOG_UPDATE, LOG_CURRENT_ENTRY,
+    LOG_FIND_ID, LOG_FIND_PROBE, LOG_FIND_RESULT, LOG_LOOKUP
+} log_formats;
+
+//! log_binary(format, up to LOG_ARGUMENTS words) - the missing arguments are 0
+#define LOG_PAD(format, a0, a1, a2, a3, a4, ...) format, a0, a1, a2, a3, a4
+#define log_binary(...) log_record(LOG_PAD(__VA_ARGS__, 0, 0, 0, 0, 0))
+
+struct log_info {
+
+	address_t region;
+	uint capacity;
+	uint written;
+	uint next;
+	/* Slot of the next record - wraps without a division
+	 */
+
+};
+
+struct log_info binary_log;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// CAPTURE INFO - every received packet, replayed on the host by the emulator                    //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! human readable definitions of each element in the capture region
+typedef enum capture_region_elements {
+    CAPTURE_CAPACITY, CAPTURE_WRITTEN, CAPTURE_PACKETS
+} capture_region_elements;
+
+//! every packet is the tick it was handled in, its key and its payload
+#define CAPTURE_PACKET_WORDS 3
+
+struct capture_info {
+
+	address_t region;
+	uint capacity;
+	uint written;
+	/* Packets received - only the first capacity of them are kept, a replay needs the start
+	 */
+
+};
+
+struct capture_info capture;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BLOOM FILTER INFO - probabilistic membership test over the string column                     //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! human readable definitions of each element in the bloom region
+typedef enum bloom_region_elements {
+    BLOOM_NUM_WORDS, BLOOM_NUM_HASHES, BLOOM_NUM_QUERIES, BLOOM_QUERIES
+} bloom_region_elements;
+
+struct bloom_info {
+
+	uint *bits;
+	/* The filter itself - built over the local rows during the initial scan
+	 * On the leader it is replaced by the OR of all filters of the ring
+	 * NULL if the host did not ask for a filter
+	 */
+	uint num_words;
+	/* Length of the filter in 32 bit words
+	 */
+	uint num_hashes;
+	/* Number of bit positions set for each value
+	 */
+	uint num_queries;
+	uint *queries;
+	/* Values to look up - string_size/4 words each, stored in SDRAM
+	 */
+	uint words_received;
+	/* Progress of the merged filter travelling the ring
+	 */
+	uint built;
+	/* 1 once all local rows have been inserted
+	 */
+
+};
+
+struct bloom_info bloom;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// QUERY SERVER INFO - resident mode, queries arrive as SDP messages from the host               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define QUERY_SDP_PORT 2
+#define SERVER_NO_TAG  0xFFFFFFFF
+#define SDP_DATA_SIZE  256
+
+//! human readable definitions of each element in the server region
+typedef enum server_region_elements {
+    SERVER_IPTAG, SERVER_APPEND_CAPACITY
+} server_region_elements;
+
+//! states of a core in resident mode - SERVER_QUEUED until server_start_query has run
+typedef enum server_states {
+    SERVER_RUNNING, SERVER_IDLE, SERVER_WAIT_GO, SERVER_QUEUED
+} server_states;
+
+//! cmd_rc of the replies sent to the host - a rejected query was not run, arg2 says why
+typedef enum server_replies {
+    QUERY_DATA = 1, QUERY_DONE = 2, QUERY_REJECTED = 3
+} server_replies;
+
+//! why a query was rejected
+typedef enum server_rejections {
+    REJECT_BUSY = 1, REJECT_FUNCTION = 2
+} server_rejections;
+
+//! signal sent by the leader once every core of the ring has the query
+#define SERVER_GO 9
+
+//! signal sent by the leader once the ring has finished the query
+#define SERVER_DONE 12
+
+struct server_info {
+
+	uint state;
+	/* One of server_states - packets are only handed to the functions while running
+	 */
+	uint iptag;
+	/* Tag that routes the replies to the host, SERVER_NO_TAG if there is none
+	 */
+	uint query_active;
+	/* 1 while results go to SDP replies instead of the recording region
+	 */
+	uint index_built;
+	/* The dictionary and index are built by the first query for function 2 only
+	 */
+	uint function_id;
+	uint seq;
+	uint args[3];
+	uint data[SDP_DATA_SIZE / 4];
+	uint data_words;
+	/* The query as sent by the host
+	 */
+	uint ready_count;
+	/* Leader: subordinates that have received the query
+	 */
+	uint command_message[5];
+	uint command_count;
+	/* Subordinates: commands of the leader, held until it is clear whether they end the query
+	 */
+	sdp_msg_t reply;
+	uint reply_bytes;
+	/* Results not yet sent to the host
+	 */
+	sdp_msg_t rejection;
+	/* Answer to a query that arrived while another one was running
+	 */
+
+};
+
+struct server_info server;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// OUTPUT INFO - results are gathered into blocks that are recorded in one go                    //
+// Block: uint16 number of fields, uint16 payload bytes, payload                                 //
+// Field: integer - 4 bytes little endian, string - 1 length byte followed by the characters     //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+#define OUTPUT_HEADER_SIZE 4
+
+struct output_info {
+
+	uint16_t num_fields;
+	uint16_t num_bytes;
+	unsigned char data[SDP_DATA_SIZE - OUTPUT_HEADER_SIZE];
+	/* A block fits into one query reply
+	 */
+
+};
+
+struct output_info output;
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// APPEND INFO - rows sent by the host after the initial load                                    //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+//! signals sent by the leader while rows are appended
+typedef enum append_signals {
+    APPEND_QUERY = 10, APPEND_ID = 11
+} append_signals;
+
+struct append_info {
+
+	uint loaded_rows;
+	/* Rows within the INPUT_DATA region - later rows live in the buffer below
+	 */
+	uint capacity;
+	/* Rows that may be appended over the lifetime of the core
+	 */
+	uint row_words;
+	/* Words per appended row: string columns followed by integer columns
+	 */
+	uint *rows;
+	/* Appended rows in SDRAM, allocated by the first append
+	 */
+	uint owner;
+	/* Core that keeps the rows of the current batch
+	 */
+	uint *batch;
+	uint num_new;
+	/* The rows of the current batch as sent by the host
+	 */
+	uint position;
+	/* Row of the batch the ring is currently resolving
+	 */
+	uint best;
+	/* Leader: best reply so far, global_frequency << 16 | id - the row counted in
+	 * once all replies are there, 0 if it does not fit into the 16 bits of either
+	 */
+	uint command_message[5];
+	uint command_count;
+
+};
+
+struct append_info append;
+
 ///////////////////////////////////////////////////////////////////////////////////////////////////
 // FUNCTION REFERENCES                                                                           //                                                                  //
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -219,9 +749,76 @@ void index_message_reached_sender();
 
 void leader_next_step();
 
+void encoded_histogram_reset();
+void encoded_histogram_start();
+void encoded_histogram_receive(uint payload);
+void encoded_histogram_record();
+
+void partitioned_index_start();
+void partitioned_index_shift(uint offset);
+void partitioned_index_receive(uint key, uint payload);
+void partitioned_index_record();
+
 void count_function_start();
 void count_function_receive(uint payload);
 
+uint *sort_key_of_row(uint index);
+uint sort_group_words();
+uint *sort_key_of_sample(uint index);
+int  sort_compare(uint *key_1, uint *key_2);
+void sort_merge_sort(uint16_t *order, uint16_t *scratch, uint n, uint *(*key_of)(uint));
+void *sort_alloc(uint bytes);
+void sort_free(void *buffer);
+uint sort_lower_bound(uint *key);
+void sort_find_buckets();
+void sort_send_frame(uint type, uint destination, uint *words, uint num_words);
+void sort_send_samples(uint partition_number);
+void sort_send_ring_samples();
+void sort_ring_ready();
+void sort_ring_gathered();
+void sort_choose_splitters();
+void sort_splitter(uint index, uint word);
+void sort_count_seen();
+void sort_start();
+void sort_ring(uint payload);
+void sort_receive(uint key, uint payload);
+void sort_exchange_step();
+void sort_finish();
+void sort_core_done();
+void sort_ring_done();
+
+void bloom_initialise();
+uint bloom_hash(uint *string, uint seed);
+void bloom_insert(uint *string);
+uint bloom_may_contain(uint *string);
+void bloom_start();
+void bloom_receive(uint key, uint payload);
+void bloom_answer_queries();
+
+void server_initialise();
+void server_sdp_receive(uint mailbox, uint port);
+void server_start_query(uint a, uint b);
+void server_try_go();
+void server_run();
+void server_receive(uint key, uint payload);
+void server_command(uint payload);
+void server_send(sdp_msg_t *reply, uint type, uint seq, uint arg2);
+void server_send_reply(uint type);
+void server_query_complete();
+void server_finish_query();
+void output_record(void *data, uint size);
+void output_flush();
+
+uint *string_entry(uint row);
+uint *int_entry(uint column, uint row);
+
+void append_initialise(uint capacity);
+void append_start();
+uint append_lookup(uint position);
+void append_apply(uint position, uint packed);
+void append_next_round();
+void append_receive(uint key, uint payload);
+
 void leader_blast();
 void leader_collects_reports(uint payload);
 void report_to_leader(uint payload);
@@ -231,6 +828,25 @@ void count_function_receive(uint payload);
 
 void send_state(uint payload, uint key);
 void receive_data(uint key, uint payload);
+void dispatch_data(uint key, uint payload);
+void dispatch_function(uint key, uint payload);
+
+void load_initialise();
+void load_add(uint start);
+
+void profile_initialise();
+void profile_tick();
+void profile_write();
+
+void trace_initialise(uint timer_period);
+void trace_event(uint event, uint argument);
+void trace_phase(uint function_id);
+
+void log_initialise(uint timer_period);
+void log_record(uint format, uint a0, uint a1, uint a2, uint a3, uint a4);
+
+void capture_initialise();
+void capture_packet(uint key, uint payload);
 
 void retrieve_header_data();
 void record_string_entry(uint *int_arr, uint size);
@@ -263,37 +879,36 @@ void iobuf_data() {
 node_t *search_dictionary(uint *string_to_search) {
 
 	node_t * item = dictionary;
+	uint probes   = 0;
+
+	profile.searches++;
 
 	#if defined(DEBUG_3) && (DEBUG_3 == 1)
-     	 if((time > DEBUG_START) && (time < DEBUG_END)) {
-     		log_info("---------SEARCH-----------");
-       	    log_info("| search: %d",item->entry[0]);
-       	    log_info("| search: %d",item->entry[1]);
-       	    log_info("| search: %d",item->entry[2]);
-       	    log_info("| search: %d",item->entry[3]);
-       	 }
+		log_binary(LOG_SEARCH, string_to_search[0], string_to_search[1],
+		           string_to_search[2], string_to_search[3]);
 	#endif
 
 	while(item->frequency != 0) {
 
 	#if defined(DEBUG_3) && (DEBUG_3 == 1)
-    	 if((time > DEBUG_START) && (time < DEBUG_END)) {
-		    log_info("|                         ");
-			log_info("| found: %d",item->entry[0]);
-			log_info("| found: %d",item->entry[1]);
-			log_info("| found: %d",item->entry[2]);
-			log_info("| found: %d",item->entry[3]);
-    	 }
-		#endif
+		log_binary(LOG_PROBE, item->entry[0], item->entry[1], item->entry[2], item->entry[3]);
+	#endif
+
+		probes++;
 
 		if(compare_two_strings(string_to_search,4, item->entry,item->entry_size) == 1) {
-			return item;
+			break;
 		}
 
 		item = item->next;
 
 	}
 
+	profile.search_probes = profile.search_probes + probes;
+	if(probes > profile.search_probes_max){profile.search_probes_max = probes;}
+
+	if(item->frequency != 0){return item;}
+
     end_of_dict = item;
 
 	return item;
@@ -331,6 +946,7 @@ void add_item_to_dictionary(uint *given_string, uint index, uint id) {
 	}
 
 	item->entry_size = count;
+	item->appended   = 0;
 
     uint *new_entry = malloc(count*sizeof(uint));
     for(int i = 0; i < count; i++){new_entry[i] = given_string[i];}
@@ -351,17 +967,12 @@ void add_item_to_dictionary(uint *given_string, uint index, uint id) {
     end_of_dict = item->next;
 
 	#if defined(DEBUG_3) && (DEBUG_3 == 1)
-	 if((time > DEBUG_START) && (time < DEBUG_END)) {
-		log_info("----------ADD------------");
-		log_info("| ENTRY: %d", item->entry[0]);
-		log_info("| FREQ : %d", item->frequency);
-		log_info("| START: %d", item->index_start);
-		log_info("| END  : %d", item->index_end);
-		log_info("| ID   : %d", item->id);
-	 }
+		log_binary(LOG_ADD, item->entry[0], item->frequency, item->index_start, item->index_end,
+		           item->id);
 	#endif
 
 	linked_list_length++;
+	profile.inserts++;
 
 }
 
@@ -371,6 +982,8 @@ uint compare_two_strings(uint *string_1, uint size_1, uint *string_2, uint size_
 	//return 1
 	//return 0 if not
 
+	profile.compares++;
+
 	uint bound = size_1;
 	if(bound > size_2){bound = size_2;}
 
@@ -390,22 +1003,14 @@ uint find_instance_of(uint given_id) {
 	node_t * item = dictionary;
 
 	#if defined(DEBUG_3) && (DEBUG_3 == 1)
-	 if((time > DEBUG_START) && (time < DEBUG_END)) {
-		log_info("ID TO FIND: %d", given_id);
-	 }
+		log_binary(LOG_FIND_ID, given_id);
 	#endif
 
 	while(item->frequency != 0) {
 
 	#if defined(DEBUG_3) && (DEBUG_3 == 1)
-		if((time > DEBUG_START) && (time < DEBUG_END)) {
-			log_info("|                         ");
-			log_info("| found: %d",item->entry[0]);
-			log_info("| found: %d",item->entry[1]);
-			log_info("| found: %d",item->entry[2]);
-			log_info("| found: %d",item->entry[3]);
-			log_info("| id   : %d",item->id);
-		}
+		log_binary(LOG_FIND_PROBE, item->entry[0], item->entry[1], item->entry[2], item->entry[3],
+		           item->id);
 	#endif
 
 		if(item->id == given_id) {
@@ -418,19 +1023,16 @@ uint find_instance_of(uint given_id) {
 	}
 
 	#if defined(DEBUG_3) && (DEBUG_3 == 1)
-	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-
-    	log_info("CHECK_1: %d", compare);
-    	uint test = -1;
-        for(uint i = 0; i < header.num_rows; i++) {
-        	if(local_index.id_index[i] == given_id){
-        		log_info("CHECK_2: %d", i);
-        	}
-        }
-
-        if(test == -1){log_info("CHECK_2: %d", test);}
+		//the first row with the id, found by a scan of the index
+		uint test = -1;
+		for(uint i = 0; i < header.num_rows; i++) {
+			if(local_index.id_index[i] == given_id){
+				test = i;
+				break;
+			}
+		}
 
-	   }
+		log_binary(LOG_FIND_RESULT, given_id, compare, test);
 	#endif
 
     return compare;
@@ -440,22 +1042,7 @@ uint find_instance_of(uint given_id) {
 void send_string(uint data_entry_position) {
 
 	//take every column of strings and assign an unique id to each string
-    address_t address = data_specification_get_data_address();
-    address_t data_address =
-        data_specification_get_region(INPUT_DATA, address);
-
-	uint start = 7  + 4 * data_entry_position;
-	uint end   = 11 + 4 * data_entry_position;
-	uint count = 0;
-
-	uint i;
-	uint entry[4];
-
-	//current entry
-    for(i = start; i < end; i++) {
-    	entry[count] = *(&data_address[i]);
-    	count++;
-    }
+	uint *entry = string_entry(data_entry_position);
 
 	//send the first data entry to the next core - 4 spikes
 	send_state(entry[0], 2);
@@ -467,14 +1054,8 @@ void send_string(uint data_entry_position) {
 	send_state(local_index.id_index[data_entry_position], 2);
 
 	#if defined(DEBUG_1) && (DEBUG_1 == 1)
-	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		log_info("SEND STRING");
-		log_info("M1: %d",entry[0]);
-		log_info("M2: %d",entry[1]);
-		log_info("M3: %d",entry[2]);
-		log_info("M4: %d",entry[3]);
-		log_info("M5: %d",local_index.id_index[data_entry_position]);
-	   }
+		log_binary(LOG_SEND_STRING, entry[0], entry[1], entry[2], entry[3],
+		           local_index.id_index[data_entry_position]);
 	#endif
 
 }
@@ -488,14 +1069,8 @@ void forward_string() {
 	send_state(local_index.message_id, 2);
 
 	#if defined(DEBUG_1) && (DEBUG_1 == 1)
-	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		log_info("FORWARD");
-		log_info("M1: %d",local_index.message[0]);
-		log_info("M2: %d",local_index.message[1]);
-		log_info("M3: %d",local_index.message[2]);
-		log_info("M4: %d",local_index.message[3]);
-		log_info("M5: %d",local_index.message_id);
-	   }
+		log_binary(LOG_FORWARD, local_index.message[0], local_index.message[1],
+		           local_index.message[2], local_index.message[3], local_index.message_id);
 	#endif
 
 }
@@ -526,14 +1101,7 @@ void send_signal(uint id, uint signal) {
 	send_state(id, 2);
 
 	#if defined(DEBUG_1) && (DEBUG_1 == 1)
-	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		log_info("SIGNAL");
-		log_info("M1: %d",signal);
-		log_info("M2: %d",signal);
-		log_info("M3: %d",signal);
-		log_info("M4: %d",header.processor_id);
-		log_info("M5: %d",id);
-	   }
+		log_binary(LOG_SIGNAL, signal, header.processor_id, id);
 	#endif
 
 }
@@ -550,14 +1118,7 @@ void send_function_signal(uint signal, uint entry1, uint entry2) {
 	send_state(entry2, 2);
 
 	#if defined(DEBUG_1) && (DEBUG_1 == 1)
-		if((time > DEBUG_START) && (time < DEBUG_END)) {
-			log_info("FUNCTION_SIGNAL");
-			log_info("M1: %d",signal);
-			log_info("M2: %d",signal);
-			log_info("M3: %d",signal);
-			log_info("M4: %d",entry1);
-			log_info("M5: %d",entry2);
-		}
+		log_binary(LOG_FUNCTION_SIGNAL, signal, entry1, entry2);
 	#endif
 
 }
@@ -569,6 +1130,14 @@ void send_function_signal(uint signal, uint entry1, uint entry2) {
 
 void start_processing() {
 
+	trace_phase(header.function_id);
+
+	//the host shipped ids - index and histogram come down to counting them
+	if(header.num_encoded_ids != 0 && (header.function_id == 2 || header.function_id == 3)) {
+		encoded_histogram_start();
+		return;
+	}
+
 	switch(header.function_id) {
 
 		case 1 :
@@ -581,6 +1150,12 @@ void start_processing() {
 
 			 initialise_index();
 
+			 //no ids have to be negotiated if the host partitioned by key
+			 if(header.key_partitioned == 1) {
+				 partitioned_index_start();
+				 break;
+			 }
+
 			 //start if index is complete - this only happens with the leader vertex in the beginning
 			 if(local_index.index_complete == 1) {
 
@@ -599,8 +1174,39 @@ void start_processing() {
 
 		case 3 :
 
+			 //resident mode - histogram over the index built by an earlier query
+			 if(header.key_partitioned == 1 && local_index.index_complete == 1) {
+				 partitioned_index_record();
+				 if(header.processor_id % RING_SIZE == 0){server_query_complete();}
+			 }
+			 else if(header.processor_id % RING_SIZE == 0 && local_index.index_complete == 1) {
+				 start_histogram_function();
+			 }
+			 else if(header.processor_id % RING_SIZE == 0) {
+				 log_error("the histogram needs the index - run function 2 first");
+				 server_query_complete();
+			 }
+
 		     break;
 
+		case 4 :
+
+			 sort_start();
+
+			 break;
+
+		case 5 :
+
+			 bloom_start();
+
+			 break;
+
+		case 6 :
+
+			 append_start();
+
+			 break;
+
 	}
 
 }
@@ -608,7 +1214,7 @@ void start_processing() {
 void initialise_index() {
 
 	//take every column of strings and assign an unique id to each string
-    local_index.id_index          = malloc(sizeof(uint) * header.num_rows);
+    local_index.id_index          = malloc(sizeof(uint) * (header.num_rows + append.capacity));
     local_index.message           = malloc(sizeof(uint) * 4);
     local_index.message_id        = 0;
     local_index.messages_received = 0;
@@ -628,27 +1234,22 @@ void initialise_index() {
 
     uint current_id = 1;
 
-    address_t address = data_specification_get_data_address();
-    address_t data_address =
-        data_specification_get_region(INPUT_DATA, address);
-
-	uint i,j,start,end,count;
-	uint *current_entry;
+	uint i,j;
+	uint current_entry[4];
 
-	if(header.initiate_send == 1) {
+	//a key partitioned core can number its values on its own
+	if(header.initiate_send == 1 || header.key_partitioned == 1) {
 
 		//read the first single entry
 	    for(i = 0; i < header.num_rows; i++) {
 
-	    	start = 7  + 4*i;
-	    	end   = 11 + 4*i;
-	    	count = 0;
+	    	uint *entry = string_entry(i);
 
-		    for(j = start; j < end; j++) {
-		    	current_entry[count] = *(&data_address[j]);
-		    	count++;
+		    for(j = 0; j < 4; j++) {
+		    	current_entry[j] = entry[j];
 		    }
 
+		    bloom_insert(current_entry);
 		    node_t *element = search_dictionary(current_entry);
 
 		    //entry exists in dictionary
@@ -659,14 +1260,8 @@ void initialise_index() {
 		    	element->index_end = i + 1;
 
 			#if defined(DEBUG_3) && (DEBUG_3 == 1)
-		 	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		    	log_info("|---------UPDATE------------");
-		    	log_info("| ENTRY: %d", element->entry[0]);
-		    	log_info("| FREQ : %d", element->frequency);
-		    	log_info("| START: %d", element->index_start);
-		    	log_info("| END  : %d", element->index_end);
-		    	log_info("| ID   : %d", element->id);
-		 	   }
+				log_binary(LOG_UPDATE, element->entry[0], element->frequency,
+				           element->index_start, element->index_end, element->id);
 			#endif
 
 		    }
@@ -692,42 +1287,32 @@ void initialise_index() {
 	}//if leader
 
 
-	if(header.initiate_send == 0) {
+	if(header.initiate_send == 0 && header.key_partitioned == 0) {
 
 		for(i = 0; i < header.num_rows; i++) {
 
 			local_index.id_index[i] = 0;
             in_charge = 0;
-	    	start = 7  + 4 * i;
-	    	end   = 11 + 4 * i;
-	    	count = 0;
+	    	uint *entry = string_entry(i);
 
-		    for(j = start; j < end; j++) {
-		    	current_entry[count] = *(&data_address[j]);
-		    	count++;
+		    for(j = 0; j < 4; j++) {
+		    	current_entry[j] = entry[j];
 		    }
 
+		    bloom_insert(current_entry);
 		    node_t *element = search_dictionary(current_entry);
 
 			#if defined(DEBUG_3) && (DEBUG_3 == 1)
-		    	if((time > DEBUG_START) && (time < DEBUG_END)) {
-		    		log_info("-CURRENT ENTRY: %d", current_entry[0]);
-		    	}
-            #endif
+				log_binary(LOG_CURRENT_ENTRY, current_entry[0]);
+			#endif
 
 		    //entry exists in dictionary
 		    if(element->frequency != 0) {
 		    	element->frequency = (element->frequency) + 1;
 		    	element->index_end = i + 1;
 				#if defined(DEBUG_3) && (DEBUG_3 == 1)
-			 	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		    		log_info("|---------UPDATE------------");
-		    		log_info("| ENTRY: %d", element->entry[0]);
-		    		log_info("| FREQ : %d", element->frequency);
-		    		log_info("| START: %d", element->index_start);
-		    		log_info("| END  : %d", element->index_end);
-		    		log_info("| ID   : %d", element->id);
-			 	   }
+					log_binary(LOG_UPDATE, element->entry[0], element->frequency,
+					           element->index_start, element->index_end, element->id);
 				#endif
 
 		    }
@@ -741,36 +1326,22 @@ void initialise_index() {
 
 	}//if not leader
 
-		#if defined(DEBUG_3) && (DEBUG_3 == 1)
-	   	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-
-	   		   uint test[4];
-	   		   test[0] = 1430986784;
-	   		   test[1] = 538976288;
-	   		   test[2] = 538976288;
-	   		   test[3] = 538976288;
-	   		   node_t *element = search_dictionary(test);
-
-	   		   if(element->frequency > 0){
-	   			   log_info("ENTRY: %d", element->entry[0]);
-	   		   }
-
-	   		   log_info("FREQ : %d", element->frequency);
-	   		   log_info("START: %d", element->index_start);
-	   		   log_info("END  : %d", element->index_end);
-	   		   log_info("ID   : %d", element->id);
-	   	   }
+	#if defined(DEBUG_3) && (DEBUG_3 == 1)
+		uint test[4];
+		test[0] = 1430986784;
+		test[1] = 538976288;
+		test[2] = 538976288;
+		test[3] = 538976288;
+		node_t *element = search_dictionary(test);
+
+		log_binary(LOG_LOOKUP, test[0], element->frequency, element->index_start,
+		           element->index_end, element->id);
 	#endif
 
 }
 
 void complete_index(uint unique_id, uint start_index) {
 
-	//get the SDRAM address
-    address_t address = data_specification_get_data_address();
-    address_t data_address =
-        data_specification_get_region(INPUT_DATA, address);
-
 	//read the first single entry
 	uint i,j;
     uint current_entry[4];
@@ -781,14 +1352,10 @@ void complete_index(uint unique_id, uint start_index) {
         //check if id has already been assigned
         if(local_index.id_index[i] == 0) {
 
-        	uint start = 7  + 4*i;
-        	uint end   = 11 + 4*i;
-        	uint count = 0;
+        	uint *entry = string_entry(i);
 
-        	//current entry
-    	    for(j = start; j < end; j++) {
-    	    	current_entry[count] = *(&data_address[j]);
-    	    	count++;
+    	    for(j = 0; j < 4; j++) {
+    	    	current_entry[j] = entry[j];
     	    }
 
     	    node_t *element = search_dictionary(current_entry);
@@ -816,6 +1383,11 @@ void complete_index(uint unique_id, uint start_index) {
 
 void update_index_upon_message_received() {
 
+	//the filter rules out that this core holds the string - nothing to update
+	if(bloom_may_contain(local_index.message) == 0) {
+		return;
+	}
+
     node_t *element = search_dictionary(local_index.message);
 
     //check if element exists
@@ -830,23 +1402,14 @@ void update_index_upon_message_received() {
     			local_index.max_id = local_index.message_id;
 			}
 
-        	//get the SDRAM address
-            address_t address = data_specification_get_data_address();
-            address_t data_address =
-                data_specification_get_region(INPUT_DATA, address);
-
-        	uint *current_entry;
+        	uint current_entry[4];
 
             for(uint i = element->index_start; i < element->index_end; i++) {
 
-            	uint start = 7  + 4*i;
-            	uint end   = 11 + 4*i;
-            	uint count = 0;
+            	uint *entry = string_entry(i);
 
-            	//current entry
-        	    for(uint j = start; j < end; j++) {
-        	    	current_entry[count] = *(&data_address[j]);
-        	    	count++;
+        	    for(uint j = 0; j < 4; j++) {
+        	    	current_entry[j] = entry[j];
         	    }
 
     		    if(compare_two_strings(current_entry,4,element->entry,element->entry_size) == 1) {
@@ -890,7 +1453,8 @@ void index_receive(uint payload) {
 				}
 				else {
 	                send_signal(global_max_id,0);
-					current_leader = 1; //-> next core becomes the leader
+					current_leader = header.processor_id + 1; //-> next core becomes the leader
+					trace_event(TRACE_LEADER, current_leader);
 					forward_mode_on = 1;
 				}
 
@@ -911,9 +1475,7 @@ void index_receive(uint payload) {
 			local_index.message[(local_index.messages_received % 5) - 1] = payload;
 
 			#if defined(DEBUG_2) && (DEBUG_2 == 1)
-				if((time > DEBUG_START) && (time < DEBUG_END)) {
-					log_info("RECEIVED: %d", payload);
-				}
+				log_binary(LOG_RECEIVED, payload);
 			#endif
 
 			//temporary fix for a glitch - band aid
@@ -927,10 +1489,8 @@ void index_receive(uint payload) {
 			local_index.message_id = payload;
 
 			#if defined(DEBUG_2) && (DEBUG_2 == 1)
-		 	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		 		   log_info("RECEIVED: %d", payload);
-		 		   log_info("------------------");
-		 	   }
+				log_binary(LOG_MESSAGE, local_index.message[0], local_index.message[1],
+				           local_index.message[2], local_index.message[3], payload);
 			#endif
 
 			if(identify_signal(0) == 0) {
@@ -941,15 +1501,13 @@ void index_receive(uint payload) {
 			if(identify_signal(0) == 1) {
 
 				current_leader++;
-				if(current_leader <= 15) {
+				trace_event(TRACE_LEADER, current_leader);
+				if(current_leader < header.processor_id + RING_SIZE) {
 
 					forward_string(); //-> next core becomes the leader
 
 				#if defined(DEBUG_2) && (DEBUG_2 == 1)
-					if((time > DEBUG_START) && (time < DEBUG_END)) {
-						log_info("max_id: %d", local_index.message_id);
-						log_info("leader: %d", local_index.message[3]);
-					}
+					log_binary(LOG_NEXT_LEADER, local_index.message_id, local_index.message[3]);
 				#endif
 
 					forward_mode_on = 1;
@@ -962,6 +1520,7 @@ void index_receive(uint payload) {
 					if(current_leader == header.processor_id + 16){
 						log_info("END OF ID ASSIGNMENT PROCESS");
 						header.function_id = 3;
+						trace_phase(3);
 						start_histogram_function();
 					}
 				#endif
@@ -981,24 +1540,21 @@ void index_receive(uint payload) {
 		if(local_index.messages_received % 5 != 0) {
 			local_index.message[(local_index.messages_received % 5) - 1] = payload;
 			#if defined(DEBUG_2) && (DEBUG_2 == 1)
-		 	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		 		   log_info("RECEIVED: %d", payload);
-		 	   }
-            #endif
+				log_binary(LOG_RECEIVED, payload);
+			#endif
 		}
 		else {
 
 			local_index.message_id = payload;
 
 			#if defined(DEBUG_2) && (DEBUG_2 == 1)
-		 	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		 		   log_info("RECEIVED: %d", payload);
-		 		   log_info("------------------");
-		 	   }
+				log_binary(LOG_MESSAGE, local_index.message[0], local_index.message[1],
+				           local_index.message[2], local_index.message[3], payload);
 			#endif
 
 			if(identify_signal(3) == 1) {
 				header.function_id = local_index.message_id;
+				trace_phase(header.function_id);
 				send_state(-1,2);
 			}
 
@@ -1052,12 +1608,7 @@ void index_receive(uint payload) {
 					send_state(-1, 2); //report ready
 
 					#if defined(DEBUG_1) && (DEBUG_1 == 1)
-						if((time > DEBUG_START) && (time < DEBUG_END)) {
-							log_info("SEND ACKNOWLEDGEMENT: -1");
-							log_info("Index complete: %d", local_index.index_complete);
-							log_info("Core in charge: %d", in_charge);
-							log_info("Processor id: %d", header.processor_id);
-						}
+						log_binary(LOG_ACKNOWLEDGE, local_index.index_complete, in_charge);
 					#endif
 
 				}
@@ -1069,11 +1620,7 @@ void index_receive(uint payload) {
 				if(identify_signal(1) == 1) {
 
 					#if defined(DEBUG_2) && (DEBUG_2 == 1)
-				 	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-				 		   log_info("SPARTA: %d", local_index.message_id);
-				 		   log_info("received: %d", local_index.message_id);
-				 		   log_info("max_id:   %d", local_index.max_id);
-				 	   }
+						log_binary(LOG_QUERY, local_index.message_id, local_index.max_id);
 					#endif
 
 					if(local_index.message_id <= local_index.max_id) {
@@ -1084,10 +1631,7 @@ void index_receive(uint payload) {
 		                send_signal(local_index.message_id,0);
 
 						#if defined(DEBUG_2) && (DEBUG_2 == 1)
-		                	if((time > DEBUG_START) && (time < DEBUG_END)) {
-		                		log_info("OLD LEADER: %d",header.processor_id);
-		                		log_info("max_id: %d", local_index.message_id);
-		                	}
+							log_binary(LOG_OLD_LEADER, local_index.message_id);
 						#endif
 					}
 				}
@@ -1122,6 +1666,8 @@ void start_histogram_function() {
 
 void leader_next_step() {
 
+	trace_event(TRACE_ROUND, current_id);
+
 	reported_ready = 0;
 
     time_out_block_start = 0;
@@ -1132,6 +1678,7 @@ void leader_next_step() {
 
 		record_unqiue_items(1,local_index.max_id);
 		current_leader++;
+		trace_event(TRACE_LEADER, current_leader);
 
 		send_function_signal(2, current_leader, local_index.max_id + 1);
 		forward_mode_on = 1;
@@ -1166,6 +1713,14 @@ void histogram_receive(uint payload) {
 			if(payload == -1){return;}
 
 			current_leader++;
+			trace_event(TRACE_LEADER, current_leader);
+
+			//every core of the ring has recorded its values
+			if(current_leader == header.processor_id + RING_SIZE) {
+				server_query_complete();
+				return;
+			}
+
 			send_function_signal(2, current_leader, payload);
 			return;
 		}
@@ -1179,120 +1734,1803 @@ void histogram_receive(uint payload) {
 			reported_ready = 0;
 			forward_mode_on = 0;
 
-			//update leaders dictionary if necessary
-			if(current_id <= local_index.max_id){
+			//the leader may hold the value too, also ids appended after the load
+			node_t *found = search_dictionary_with_id(current_id);
+			sum = sum + found->frequency;
+			if(found->frequency != 0) {
+				found->global_frequency = sum;
+			}
+
+			send_function_signal(0, sum, current_id);
+			current_id++;
+			sum = 0;
+
+		}
+
+	}
+
+	//Case 3: You are one of the subordinates
+	if(header.processor_id % 16 != 0) {
+
+		local_index.messages_received++;
+
+		//collect up to 5 messages
+		if(local_index.messages_received % 5 != 0) {
+			local_index.message[(local_index.messages_received % 5) - 1] = payload;
+		}
+		else {
+			local_index.message_id = payload;
+
+			//START - resident mode, a histogram over the index of an earlier query
+			if(identify_signal(3) == 1) {
+				send_state(-1, 2);
+			}
+
+			//UPDATE
+			if(identify_signal(0) == 1) {
+
+				node_t *found = search_dictionary_with_id(local_index.message_id);
+
+				if(found->frequency != 0) {
+					found->global_frequency = local_index.message[3];
+				}
+
+				send_state(-1, 2);
+
+				#if defined(DEBUG_1) && (DEBUG_1 == 1)
+					log_binary(LOG_ACKNOWLEDGE, local_index.index_complete, in_charge);
+				#endif
+
+			}
+
+			//QUERY
+			if(identify_signal(1) == 1) {
+
+				node_t *found = search_dictionary_with_id(local_index.message_id);
+				send_state(found->frequency, 2);
+
+				#if defined(DEBUG_1) && (DEBUG_1 == 1)
+					log_binary(LOG_SEND_FREQUENCY, local_index.message_id, found->frequency);
+				#endif
+
+			}
+
+			//RECORD
+			if(identify_signal(2) == 1){
+
+				uint the_leader = local_index.message[3];
+				if(the_leader == header.processor_id) {
+					uint start_id  = local_index.message_id;
+
+					//also without loaded ids of its own - appended values may be there
+					record_unqiue_items(start_id,local_index.max_id);
+
+					if(start_id <= local_index.max_id){
+						send_state(local_index.max_id+1,2);
+					}
+
+					if(start_id > local_index.max_id){
+						send_state(start_id,2);
+					}
+
+				#if defined(DEBUG_1) && (DEBUG_1 == 1)
+					log_binary(LOG_SEND_RECORDED, start_id, local_index.max_id);
+				#endif
+
+				}
+
+			}
+
+		}
+
+	}
+
+}
+
+void count_function_start() {
+
+	//send the first MCPL package if initiate is TRUE
+	if(header.initiate_send == 1) {
+		record_int_entry(header.num_rows);
+		send_state(header.num_rows, 1);
+	}
+
+}
+
+void count_function_receive(uint payload) {
+
+	//if we have reached the original vertex, stop the entire mechanism
+	if(header.initiate_send == 0){
+		payload = payload + header.num_rows;
+		send_state(payload, 1);
+		record_int_entry(payload);
+	}
+	else {
+		server_query_complete();
+	}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// DISTRIBUTED SAMPLE SORT                                                                       //
+// Every core sorts its rows, core 0 picks splitters from the regular samples the ring leaders   //
+// gathered, rows travel the machine ring (through every core of every chip) to the core owning  //
+// their range and each core merges what it ends up with                                         //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint *sort_key_of_row(uint index) {
+
+	if(index < header.num_rows) {
+		return (sort.is_string == 1) ? string_entry(index) : int_entry(0, index);
+	}
+
+	return &sort.received[(index - header.num_rows) * sort.key_words];
+
+}
+
+uint sort_group_words() {
+
+	//what a core hands in for the splitters: its row count and RING_SIZE-1 samples
+	return 1 + (RING_SIZE - 1) * sort.key_words;
+
+}
+
+uint *sort_key_of_sample(uint index) {
+
+	uint core = index / (RING_SIZE - 1);
+	return &sort.samples[core * sort_group_words() + 1 + (index % (RING_SIZE - 1)) * sort.key_words];
+
+}
+
+int sort_compare(uint *key_1, uint *key_2) {
+
+	//strings are packed big endian, so word order equals character order
+	for(uint i = 0; i < sort.key_words; i++) {
+		if(key_1[i] != key_2[i]) {
+			return (key_1[i] < key_2[i]) ? -1 : 1;
+		}
+	}
+
+	return 0;
+
+}
+
+void sort_merge_sort(uint16_t *order, uint16_t *scratch, uint n, uint *(*key_of)(uint)) {
+
+	//bottom up merge sort - runs over both arrays sequentially and is stable
+	uint16_t *from = order;
+	uint16_t *to   = scratch;
+	uint16_t *swap;
+
+	for(uint width = 1; width < n; width = width * 2) {
+
+		for(uint left = 0; left < n; left = left + 2 * width) {
+
+			uint mid   = (left + width     < n) ? left + width     : n;
+			uint right = (left + 2 * width < n) ? left + 2 * width : n;
+			uint i = left;
+			uint j = mid;
+			uint k = left;
+
+			while(i < mid && j < right) {
+				if(sort_compare(key_of(from[j]), key_of(from[i])) < 0) {
+					to[k++] = from[j++];
+				}
+				else {
+					to[k++] = from[i++];
+				}
+			}
+
+			while(i < mid)  {to[k++] = from[i++];}
+			while(j < right){to[k++] = from[j++];}
+
+		}
+
+		swap = from;
+		from = to;
+		to   = swap;
+
+	}
+
+	if(from != order) {
+		for(uint i = 0; i < n; i++){order[i] = from[i];}
+	}
+
+}
+
+void *sort_alloc(uint bytes) {
+
+	//the buffers of the sort grow with the rows, they live in SDRAM
+	void *buffer = sark_xalloc(sv->sdram_heap, bytes + 4, 0, ALLOC_LOCK);
+	if(buffer == NULL) {
+		log_error("cannot allocate %d bytes for the sort", bytes);
+		rt_error(RTE_MALLOC);
+	}
+
+	return buffer;
+
+}
+
+void sort_free(void *buffer) {
+
+	if(buffer != NULL){sark_xfree(sv->sdram_heap, buffer, ALLOC_LOCK);}
+
+}
+
+uint sort_lower_bound(uint *key) {
+
+	//first position in the local order whose key is not smaller than key
+	uint low  = 0;
+	uint high = header.num_rows;
+
+	while(low < high) {
+		uint mid = (low + high) / 2;
+		if(sort_compare(sort_key_of_row(sort.order[mid]), key) < 0) {
+			low = mid + 1;
+		}
+		else {
+			high = mid;
+		}
+	}
+
+	return low;
+
+}
+
+void sort_find_buckets() {
+
+	sort.bucket_start[0]             = 0;
+	sort.bucket_start[machine_cores] = header.num_rows;
+
+	for(uint b = 1; b < machine_cores; b++) {
+		sort.bucket_start[b] = sort_lower_bound(&sort.splitters[(b - 1) * sort.key_words]);
+	}
+
+}
+
+void sort_send_frame(uint type, uint destination, uint *words, uint num_words) {
+
+	send_state((type << 24) | (num_words << 16) | destination, 3);
+	for(uint w = 0; w < num_words; w++) {
+		send_state(words[w], 3);
+	}
+
+}
+
+void sort_send_samples(uint partition_number) {
+
+	//the row count first - the samples of a core without rows are left out of the splitters
+	if(partition_number == 0) {
+		sort.samples[sort.num_sample_words++] = header.num_rows;
+	}
+	else {
+		send_state(header.num_rows, partition_number);
+	}
+
+	//regular sampling - RING_SIZE-1 evenly spaced keys of the sorted local rows
+	for(uint k = 0; k < RING_SIZE - 1; k++) {
+
+		uint position = ((k + 1) * header.num_rows) / RING_SIZE;
+
+		for(uint w = 0; w < sort.key_words; w++) {
+
+			uint word = 0;
+			if(header.num_rows > 0) {
+				word = sort_key_of_row(sort.order[position])[w];
+			}
+
+			//the leader keeps its own samples
+			if(partition_number == 0) {
+				sort.samples[sort.num_sample_words++] = word;
+			}
+			else {
+				send_state(word, partition_number);
+			}
+
+		}
+
+	}
+
+}
+
+void sort_send_ring_samples() {
+
+	//a ring leader answers core 0 once the samples of its ring are there
+	if(sort.samples_requested == 0 || sort.phase != SORT_SPLIT) {
+		return;
+	}
+
+	sort.samples_requested = 0;
+
+	for(uint i = 0; i < sort.num_sample_words; i++) {
+		uint words[2] = {machine_position * sort_group_words() + i, sort.samples[i]};
+		sort_send_frame(SORT_FRAME_SAMPLE, 0, words, 2);
+	}
+
+}
+
+void sort_ring_ready() {
+
+	//poll the subordinates one after the other for their samples
+	if(sort.phase != SORT_WAIT_READY || reported_ready < RING_SIZE - 1) {
+		return;
+	}
+
+	reported_ready = 0;
+	sort.bucket    = 1;
+	sort.phase     = SORT_GATHER;
+	send_function_signal(SORT_SAMPLE_REQUEST, sort.bucket, 0);
+
+}
+
+void sort_ring_gathered() {
+
+	sort.phase     = SORT_SPLIT;
+	reported_ready = 0;
+
+	if(machine_position != 0) {
+		sort_send_ring_samples();
+		return;
+	}
+
+	if(machine_cores == RING_SIZE) {
+		sort_choose_splitters();
+		return;
+	}
+
+	//core 0 asks the leaders of the other rings for their samples
+	for(uint leader = RING_SIZE; leader < machine_cores; leader = leader + RING_SIZE) {
+		sort_send_frame(SORT_FRAME_SAMPLE_REQUEST, leader, NULL, 0);
+	}
+
+}
+
+void sort_choose_splitters() {
+
+	uint group = sort_group_words();
+
+	uint16_t *sample_order   = sort_alloc(machine_cores * (RING_SIZE - 1) * sizeof(uint16_t));
+	uint16_t *sample_scratch = sort_alloc(machine_cores * (RING_SIZE - 1) * sizeof(uint16_t));
+
+	//a core without rows sends zeros - only the samples of the others are candidates
+	uint num_samples = 0;
+	for(uint core = 0; core < machine_cores; core++) {
+		if(sort.samples[core * group] == 0){continue;}
+		for(uint k = 0; k < RING_SIZE - 1; k++) {
+			sample_order[num_samples++] = core * (RING_SIZE - 1) + k;
+		}
+	}
+
+	sort_merge_sort(sample_order, sample_scratch, num_samples, sort_key_of_sample);
+
+	//take the splitters from the middle of each group of samples, every core of the machine
+	//receives them on the way round
+	for(uint k = 0; k < machine_cores - 1; k++) {
+
+		uint position = ((k + 1) * num_samples) / machine_cores + RING_SIZE / 2 - 1;
+		if(position >= num_samples){position = num_samples - 1;}
+
+		for(uint w = 0; w < sort.key_words; w++) {
+			uint words[2] = {k * sort.key_words + w, 0};
+			if(num_samples > 0) {
+				words[1] = sort_key_of_sample(sample_order[position])[w];
+			}
+			sort_send_frame(SORT_FRAME_SPLITTER, 0, words, 2);
+			sort_splitter(words[0], words[1]);
+		}
+
+	}
+
+	sort_free(sample_order);
+	sort_free(sample_scratch);
+
+}
+
+void sort_splitter(uint index, uint word) {
+
+	sort.splitters[index] = word;
+	sort.num_splitter_words++;
+
+	if(sort.num_splitter_words < (machine_cores - 1) * sort.key_words) {
+		return;
+	}
+
+	sort_find_buckets();
+
+	//the count frame of the previous core starts here and takes in every other core on its way
+	uint previous = (machine_position + machine_cores - 1) % machine_cores;
+	uint rows     = sort.bucket_start[previous + 1] - sort.bucket_start[previous];
+	sort_send_frame(SORT_FRAME_COUNT, previous, &rows, 1);
+	sort_count_seen();
+
+}
+
+void sort_count_seen() {
+
+	//a core sends rows once every count frame is through, so each of them runs ahead of the rows
+	//to its core and the buffer is there in time
+	sort.counts_seen++;
+	if(sort.counts_seen == machine_cores) {
+		sort.phase = SORT_EXCHANGE;
+	}
+
+}
+
+void sort_start() {
+
+	//the first column is sorted - string if there are string columns, integer otherwise
+	//a host encoded column is sorted by its ids, which keep the order of the values
+	sort.is_string = (header.num_string_cols > 0 && header.num_encoded_ids == 0) ? 1 : 0;
+	sort.key_words = (sort.is_string == 1) ? header.string_size / 4 : 1;
+
+	if(sort.key_words >= SORT_FRAME_WORDS) {
+		log_error("keys of %d words do not fit into a frame of the machine ring", sort.key_words);
+		rt_error(RTE_SWERR);
+	}
+
+	//resident mode - release the buffers of an earlier sort
+	sort_free(sort.order);
+	sort_free(sort.scratch);
+	sort_free(sort.samples);
+	sort_free(sort.splitters);
+	sort_free(sort.bucket_start);
+	sort_free(sort.received);
+
+	uint samples_of = (machine_position == 0) ? machine_cores : RING_SIZE;
+
+	sort.order         = sort_alloc(header.num_rows * sizeof(uint16_t));
+	sort.scratch       = sort_alloc(header.num_rows * sizeof(uint16_t));
+	sort.samples       = NULL;
+	sort.splitters     = sort_alloc((machine_cores - 1) * sort.key_words * sizeof(uint));
+	sort.bucket_start  = sort_alloc((machine_cores + 1) * sizeof(uint));
+	sort.received      = NULL;
+	sort.num_received  = 0;
+	sort.counted       = 0;
+	sort.expected      = 0;
+	sort.recorded      = 0;
+	sort.counts_seen   = 0;
+	sort.command_count = 0;
+	sort.next_to_send  = 0;
+	sort.send_bucket   = 0;
+	sort.num_splitter_words = 0;
+
+	for(uint i = 0; i < header.num_rows; i++){sort.order[i] = i;}
+	sort_merge_sort(sort.order, sort.scratch, header.num_rows, sort_key_of_row);
+
+	if(header.processor_id % RING_SIZE == 0) {
+
+		sort.samples = sort_alloc(samples_of * sort_group_words() * sizeof(uint));
+		sort.num_sample_words = 0;
+		sort_send_samples(0);
+
+		//the subordinates may have reported ready while this core was sorting
+		sort.phase = SORT_WAIT_READY;
+		sort_ring_ready();
+
+	}
+	else {
+
+		sort.phase = SORT_WAIT_READY;
+		send_state(-1, 2); //report ready
+
+	}
+
+}
+
+void sort_ring(uint payload) {
+
+	sort.frame[sort.frame_count++] = payload;
+
+	uint words = (sort.frame[0] >> 16) & 0xFF;
+	if(words >= SORT_FRAME_WORDS) {
+		log_error("frame of %d words on the machine ring", words);
+		rt_error(RTE_SWERR);
+	}
+	if(sort.frame_count <= words){return;}
+	sort.frame_count = 0;
+
+	uint type        = sort.frame[0] >> 24;
+	uint destination = sort.frame[0] & 0xFFFF;
+
+	//pass it on - splitters and counts are taken in by every core they go through
+	if(destination != machine_position) {
+
+		if(type == SORT_FRAME_COUNT) {
+			sort.frame[1] = sort.frame[1] +
+				sort.bucket_start[destination + 1] - sort.bucket_start[destination];
+		}
+
+		for(uint w = 0; w <= words; w++) {
+			send_state(sort.frame[w], 3);
+		}
+
+		if(type == SORT_FRAME_SPLITTER){sort_splitter(sort.frame[1], sort.frame[2]);}
+		if(type == SORT_FRAME_COUNT){sort_count_seen();}
+
+		return;
+
+	}
+
+	switch(type) {
+
+		case SORT_FRAME_ROW :
+
+			for(uint w = 0; w < sort.key_words; w++) {
+				sort.received[sort.num_received * sort.key_words + w] = sort.frame[1 + w];
+			}
+			sort.num_received++;
+			if(sort.num_received == sort.expected){sort_finish();}
+			break;
+
+		case SORT_FRAME_SAMPLE_REQUEST :
+
+			sort.samples_requested = 1;
+			sort_send_ring_samples();
+			break;
+
+		case SORT_FRAME_SAMPLE :
+
+			sort.samples[sort.frame[1]] = sort.frame[2];
+			sort.num_sample_words++;
+			if(sort.num_sample_words == machine_cores * sort_group_words()) {
+				sort_choose_splitters();
+			}
+			break;
+
+		case SORT_FRAME_COUNT :
+
+			//the rows of every other core that belong here
+			sort.counted  = 1;
+			sort.expected = sort.frame[1];
+			sort.received = sort_alloc((sort.expected * sort.key_words + 1) * sizeof(uint));
+			sort_count_seen();
+			if(sort.expected == 0){sort_finish();}
+			break;
+
+	}
+
+}
+
+void sort_receive(uint key, uint payload) {
+
+	//Case 1: You are the leader and collecting reports
+	if(header.processor_id % RING_SIZE == 0) {
+
+		switch(sort.phase) {
+
+			case SORT_IDLE :
+			case SORT_WAIT_READY :
+
+				if(payload == -1){reported_ready++;}
+				sort_ring_ready();
+				break;
+
+			case SORT_GATHER :
+
+				sort.samples[sort.num_sample_words++] = payload;
+				if(sort.num_sample_words == (sort.bucket + 1) * sort_group_words()) {
+					sort.bucket++;
+					if(sort.bucket < RING_SIZE) {
+						send_function_signal(SORT_SAMPLE_REQUEST, sort.bucket, 0);
+					}
+					else {
+						sort_ring_gathered();
+					}
+				}
+				break;
+
+			//the subordinates report once they have recorded and sent all their rows
+			default :
+
+				if(payload == -1){reported_ready++;}
+				sort_ring_done();
+				break;
+
+		}
+
+		return;
+
+	}
+
+	//Case 2: You are one of the subordinates - collect 5 packets from the leader
+	if(key != command_in_key){return;}
+
+	sort.command_message[sort.command_count++] = payload;
+
+	if(sort.command_count == 5) {
+
+		sort.command_count = 0;
+
+		if(sort.command_message[0] == SORT_SAMPLE_REQUEST &&
+		   sort.command_message[1] == SORT_SAMPLE_REQUEST &&
+		   sort.command_message[2] == SORT_SAMPLE_REQUEST &&
+		   sort.command_message[3] == header.processor_id % RING_SIZE) {
+			sort_send_samples(2);
+		}
+
+	}
+
+}
+
+void sort_exchange_step() {
+
+	uint sent = 0;
+
+	while(sort.next_to_send < header.num_rows && sent < SORT_ROWS_PER_TICK) {
+
+		while(sort.next_to_send >= sort.bucket_start[sort.send_bucket + 1]) {
+			sort.send_bucket++;
+		}
+
+		//rows of the own bucket stay where they are
+		if(sort.send_bucket == machine_position) {
+			sort.next_to_send = sort.bucket_start[machine_position + 1];
+			continue;
+		}
+
+		sort_send_frame(SORT_FRAME_ROW, sort.send_bucket,
+		                sort_key_of_row(sort.order[sort.next_to_send]), sort.key_words);
+
+		sort.next_to_send++;
+		sent++;
+
+	}
+
+	sort_core_done();
+
+}
+
+void sort_finish() {
+
+	uint own_start = sort.bucket_start[machine_position];
+	uint own_rows  = sort.bucket_start[machine_position + 1] - own_start;
+	uint total     = own_rows + sort.num_received;
+
+	if(header.num_rows + sort.num_received > 0xFFFF) {
+		log_error("too many rows to sort on one core: %d", total);
+		rt_error(RTE_SWERR);
+	}
+
+	uint16_t *final_order   = sort_alloc(total * sizeof(uint16_t));
+	uint16_t *final_scratch = sort_alloc(total * sizeof(uint16_t));
+
+	for(uint i = 0; i < own_rows; i++) {
+		final_order[i] = sort.order[own_start + i];
+	}
+	for(uint i = 0; i < sort.num_received; i++) {
+		final_order[own_rows + i] = header.num_rows + i;
+	}
+
+	sort_merge_sort(final_order, final_scratch, total, sort_key_of_row);
+
+	for(uint i = 0; i < total; i++) {
+		uint *key = sort_key_of_row(final_order[i]);
+		if(sort.is_string == 1) {
+			record_string_entry(key, sort.key_words);
+		}
+		else {
+			record_int_entry(key[0]);
+		}
+	}
+
+	sort_free(final_order);
+	sort_free(final_scratch);
+
+	sort.recorded = 1;
+	log_info("SORTED %d ROWS", total);
+
+	sort_core_done();
+
+}
+
+void sort_core_done() {
+
+	//done once the own bucket is recorded and the rows of all others are on their way
+	if(sort.phase != SORT_EXCHANGE || sort.recorded == 0 || sort.next_to_send < header.num_rows) {
+		return;
+	}
+
+	sort.phase = SORT_DONE;
+
+	if(header.processor_id % RING_SIZE != 0) {
+		send_state(-1, 2); //report done
+	}
+	else {
+		sort_ring_done();
+	}
+
+}
+
+void sort_ring_done() {
+
+	//each ring finishes the query on its own, its cores still pass on the frames of the others
+	if(sort.phase == SORT_DONE && reported_ready == RING_SIZE - 1) {
+		reported_ready = 0;
+		server_query_complete();
+	}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// ENCODED HISTOGRAM                                                                             //
+// Every core counts its ids in an array, subordinates report (count << 16 | id) for each id   //
+// they hold and the leader records the sums. Ids are 16 bit, and so are the counts of a core    //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void encoded_histogram_reset() {
+
+	//resident mode counts again for every query
+	if(encoded.counts == NULL) {
+		encoded.counts = sark_xalloc(sv->sdram_heap,
+			(header.num_encoded_ids + 1) * sizeof(uint), 0, ALLOC_LOCK);
+		if(encoded.counts == NULL) {
+			log_error("cannot allocate counts for %d ids", header.num_encoded_ids);
+			rt_error(RTE_MALLOC);
+		}
+	}
+
+	for(uint id = 0; id <= header.num_encoded_ids; id++) {
+		encoded.counts[id] = 0;
+	}
+
+	encoded.initialised = 1;
+
+}
+
+void encoded_histogram_start() {
+
+	//counts of subordinates that were quicker than this core are already in the array
+	if(encoded.initialised == 0) {
+		encoded_histogram_reset();
+	}
+
+	for(uint i = 0; i < header.num_rows; i++) {
+		encoded.counts[*int_entry(0, i)]++;
+	}
+
+	//Case 1: the leader waits for the counts of the ring
+	if(header.processor_id % RING_SIZE == 0) {
+		encoded.counted = 1;
+		if(encoded.reported_done == RING_SIZE - 1) {
+			encoded_histogram_record();
+		}
+		return;
+	}
+
+	//Case 2: a subordinate hands its counts to the leader
+	for(uint id = 1; id <= header.num_encoded_ids; id++) {
+		if(encoded.counts[id] != 0) {
+			send_state((encoded.counts[id] << 16) | id, 2);
+		}
+	}
+
+	send_state(ENCODED_DONE, 2);
+	encoded.initialised = 0;
+
+}
+
+void encoded_histogram_receive(uint payload) {
+
+	if(header.processor_id % RING_SIZE != 0){return;}
+
+	if(payload == ENCODED_DONE) {
+		encoded.reported_done++;
+		if(encoded.reported_done == RING_SIZE - 1 && encoded.counted == 1) {
+			encoded_histogram_record();
+		}
+		return;
+	}
+
+	if(encoded.initialised == 0) {
+		encoded_histogram_reset();
+	}
+
+	encoded.counts[payload & 0xFFFF] += payload >> 16;
+
+}
+
+void encoded_histogram_record() {
+
+	encoded.reported_done = 0;
+	encoded.initialised   = 0;
+	encoded.counted       = 0;
+
+	uint unique = 0;
+	for(uint id = 1; id <= header.num_encoded_ids; id++) {
+		if(encoded.counts[id] != 0) {
+			record_int_entry(id);
+			record_int_entry(encoded.counts[id]);
+			unique++;
+		}
+	}
+
+	log_info("END OF HISTOGRAM - %d UNIQUE ITEMS", unique);
+	server_query_complete();
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// KEY PARTITIONED INDEX                                                                         //
+// Every value lives on one core only, so local ids become global ids once they are moved up by  //
+// the number of distinct values of all earlier cores. One packet travels once round the ring    //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void partitioned_index_start() {
+
+	if(header.processor_id % RING_SIZE == 0) {
+		partitioned_index_shift(0);
+		send_state(local_index.max_id, 1);
+		partitioned_index_record();
+		return;
+	}
+
+	//the offset came in while the dictionary was built
+	if(partitioned.offset_received == 1) {
+		partitioned_index_receive(ring_in_key, partitioned.offset);
+	}
+
+}
+
+void partitioned_index_shift(uint offset) {
+
+	partitioned.offset = offset;
+
+	for(node_t *item = dictionary; item->frequency != 0; item = item->next) {
+		item->id = item->id + offset;
+	}
+
+	for(uint i = 0; i < header.num_rows; i++) {
+		local_index.id_index[i] = local_index.id_index[i] + offset;
+	}
+
+	local_index.max_id = local_index.max_id + offset;
+
+}
+
+void partitioned_index_receive(uint key, uint payload) {
+
+	if(key != ring_in_key){return;}
+
+	//Case 1: the prefix sum is back at the leader - payload holds all distinct values of the ring
+	if(header.processor_id % RING_SIZE == 0) {
+		global_max_id = payload;
+		log_info("END OF ID ASSIGNMENT PROCESS - %d UNIQUE ITEMS", global_max_id);
+		server_query_complete();
+		return;
+	}
+
+	//Case 2: a subordinate whose dictionary is not complete yet
+	if(local_index.index_complete == 0) {
+		partitioned.offset          = payload;
+		partitioned.offset_received = 1;
+		return;
+	}
+
+	//Case 3: move the ids up and pass the sum on
+	partitioned.offset_received = 0;
+	partitioned_index_shift(payload);
+	send_state(local_index.max_id, 1);
+	partitioned_index_record();
+
+}
+
+void partitioned_index_record() {
+
+	//frequencies are global already - no other core holds these values
+	#if defined(RECORD_UNIQUE_ITEMS) && (RECORD_UNIQUE_ITEMS == 1)
+		if(local_index.max_id > partitioned.offset) {
+			record_unqiue_items(partitioned.offset + 1, local_index.max_id);
+		}
+	#endif
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// BLOOM FILTERS                                                                                 //
+// Every core inserts its strings during the initial scan, the filters are OR-merged around the  //
+// ring and the leader answers membership queries from the merged filter                         //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void bloom_initialise() {
+
+    address_t address = data_specification_get_data_address();
+    address_t bloom_region =
+        data_specification_get_region(BLOOM, address);
+
+	bloom.num_words      = bloom_region[BLOOM_NUM_WORDS];
+	bloom.num_hashes     = bloom_region[BLOOM_NUM_HASHES];
+	bloom.num_queries    = bloom_region[BLOOM_NUM_QUERIES];
+	bloom.queries        = &bloom_region[BLOOM_QUERIES];
+	bloom.words_received = 0;
+	bloom.built          = 0;
+	bloom.bits           = NULL;
+
+	if(bloom.num_words == 0) {
+		return;
+	}
+
+	bloom.bits = malloc(bloom.num_words * sizeof(uint));
+	if(bloom.bits == NULL) {
+		log_error("cannot allocate a bloom filter of %d words", bloom.num_words);
+		rt_error(RTE_MALLOC);
+	}
+
+	for(uint i = 0; i < bloom.num_words; i++){bloom.bits[i] = 0;}
+
+}
+
+uint bloom_hash(uint *string, uint seed) {
+
+	//FNV-1a over the packed words, seeded to get two independent hashes
+	uint hash = seed;
+
+	for(uint i = 0; i < header.string_size / 4; i++) {
+		hash = (hash ^ string[i]) * 16777619;
+		hash = hash ^ (hash >> 15);
+	}
+
+	return hash;
+
+}
+
+void bloom_insert(uint *string) {
+
+	if(bloom.bits == NULL){return;}
+
+	uint num_bits = bloom.num_words * 32;
+	uint hash_1   = bloom_hash(string, 2166136261u);
+	uint hash_2   = bloom_hash(string, 3323198485u) | 1;
+
+	//double hashing - position i is hash_1 + i * hash_2
+	for(uint i = 0; i < bloom.num_hashes; i++) {
+		uint position = (hash_1 + i * hash_2) % num_bits;
+		bloom.bits[position >> 5] |= (1 << (position & 31));
+	}
+
+}
+
+uint bloom_may_contain(uint *string) {
+
+	//without a filter every string may be present
+	if(bloom.bits == NULL){return 1;}
+
+	uint num_bits = bloom.num_words * 32;
+	uint hash_1   = bloom_hash(string, 2166136261u);
+	uint hash_2   = bloom_hash(string, 3323198485u) | 1;
+
+	for(uint i = 0; i < bloom.num_hashes; i++) {
+		uint position = (hash_1 + i * hash_2) % num_bits;
+		if((bloom.bits[position >> 5] & (1 << (position & 31))) == 0) {
+			return 0;
+		}
+	}
+
+	return 1;
+
+}
+
+void bloom_start() {
+
+	if(bloom.bits == NULL) {
+		log_error("membership queries need a bloom filter");
+		if(header.processor_id % RING_SIZE == 0){server_query_complete();}
+		return;
+	}
+
+	if(header.num_encoded_ids != 0) {
+		log_error("membership of encoded values is answered by the host dictionary");
+		if(header.processor_id % RING_SIZE == 0){server_query_complete();}
+		return;
+	}
+
+	//resident mode keeps the filter of an earlier query
+	if(bloom.built == 0) {
+		for(uint i = 0; i < header.num_rows; i++) {
+			bloom_insert(string_entry(i));
+		}
+		bloom.built = 1;
+	}
+
+	reported_ready = 0;
+
+	//subordinates report ready, the leader waits for all of them
+	if(header.processor_id % RING_SIZE != 0) {
+		send_state(-1, 2);
+	}
+
+}
+
+void bloom_receive(uint key, uint payload) {
+
+	if(bloom.bits == NULL){return;}
+
+	//Case 1: You are the leader and waiting for reports
+	if(header.processor_id % RING_SIZE == 0 && key != ring_in_key) {
+
+		if(payload == -1){reported_ready++;}
+
+		//everyone is ready - send the own filter around the ring
+		if(reported_ready == RING_SIZE - 1) {
+			reported_ready = 0;
+			for(uint i = 0; i < bloom.num_words; i++) {
+				send_state(bloom.bits[i], 1);
+			}
+		}
+
+		return;
+
+	}
+
+	//Case 2: You are the leader and the merged filter has come back
+	if(header.processor_id % RING_SIZE == 0) {
+
+		bloom.bits[bloom.words_received++] = payload;
+
+		if(bloom.words_received == bloom.num_words) {
+			bloom_answer_queries();
+		}
+
+		return;
+
+	}
+
+	//Case 3: You are one of the subordinates - merge and pass on
+	send_state(payload | bloom.bits[bloom.words_received], 1);
+	bloom.words_received++;
+
+}
+
+void bloom_answer_queries() {
+
+	uint maybe = 0;
+
+	for(uint q = 0; q < bloom.num_queries; q++) {
+		uint answer = bloom_may_contain(&bloom.queries[(header.string_size / 4) * q]);
+		record_int_entry(answer);
+		maybe = maybe + answer;
+	}
+
+	log_info("MEMBERSHIP: %d of %d queries may be present", maybe, bloom.num_queries);
+	server_query_complete();
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// ROW ACCESS                                                                                    //
+// Rows up to append.loaded_rows live in the INPUT_DATA region, appended rows in SDRAM           //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+uint *string_entry(uint row) {
+
+	//first string column
+	if(row < append.loaded_rows) {
+		return &input_data[HEADER_SIZE + (header.string_size / 4) * row];
+	}
+
+	return &append.rows[(row - append.loaded_rows) * append.row_words];
+
+}
+
+uint *int_entry(uint column, uint row) {
+
+	//column counts the integer columns only
+	if(row < append.loaded_rows) {
+		uint int_block = HEADER_SIZE +
+			append.loaded_rows * header.num_string_cols * (header.string_size / 4);
+		return &input_data[int_block + column * append.loaded_rows + row];
+	}
+
+	return &append.rows[(row - append.loaded_rows) * append.row_words +
+		header.num_string_cols * (header.string_size / 4) + column];
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// INCREMENTAL APPEND                                                                            //
+// Every core of the ring sees the new rows. For each row the leader asks the ring whether the   //
+// value is known, picks its id (or the next free one) and the owning core stores the row. The   //
+// cost is one ring round per appended row                                                       //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void append_initialise(uint capacity) {
+
+	append.loaded_rows = header.num_rows;
+	append.capacity    = capacity;
+	append.row_words   = header.num_string_cols * (header.string_size / 4) +
+	                     (header.num_cols - header.num_string_cols);
+	append.rows        = NULL;
+
+}
+
+void append_start() {
+
+	append.owner         = server.args[0];
+	append.num_new       = server.args[1];
+	append.batch         = server.data;
+	append.position      = 0;
+	append.command_count = 0;
+
+	if(append.num_new * append.row_words > server.data_words) {
+		append.num_new = server.data_words / append.row_words;
+	}
+
+	//appended rows extend an existing index - run function 2 first
+	if(server.index_built == 0) {
+		log_error("rows can only be appended once the index is built");
+		append.num_new = 0;
+	}
+
+	//only the ring of the owning core takes part
+	if(append.owner / RING_SIZE != header.processor_id / RING_SIZE) {
+		append.num_new = 0;
+	}
+
+	if(header.processor_id % RING_SIZE == 0) {
+		append_next_round();
+	}
+
+}
+
+uint append_lookup(uint position) {
+
+	//reply: global_frequency << 16 | id, 0 if this core does not hold the value
+	uint *row = &append.batch[position * append.row_words];
+
+	if(dictionary == NULL || bloom_may_contain(row) == 0) {
+		return 0;
+	}
+
+	node_t *element = search_dictionary(row);
+	if(element->frequency == 0) {
+		return 0;
+	}
+
+	return (element->global_frequency << 16) | element->id;
+
+}
+
+void append_apply(uint position, uint packed) {
+
+	//the leader refused the row
+	if(packed == 0){return;}
+
+	uint *batch_row = &append.batch[position * append.row_words];
+
+	//the histogram of every core holding the value stays up to date
+	if(header.processor_id != append.owner) {
+		if(dictionary != NULL && bloom_may_contain(batch_row) == 1) {
+			node_t *element = search_dictionary(batch_row);
+			if(element->frequency != 0) {
+				element->global_frequency = packed >> 16;
+			}
+		}
+		return;
+	}
+
+	uint row = header.num_rows;
+	uint id  = packed & 0xFFFF;
+
+	if(row >= append.loaded_rows + append.capacity) {
+		log_error("no room left to append row %d", row);
+		return;
+	}
+
+	if(append.rows == NULL) {
+		append.rows = sark_xalloc(sv->sdram_heap,
+			append.capacity * append.row_words * sizeof(uint), 0, ALLOC_LOCK);
+		if(append.rows == NULL) {
+			log_error("cannot allocate %d rows to append to", append.capacity);
+			rt_error(RTE_MALLOC);
+		}
+	}
+
+	uint *new_row   = &append.rows[(row - append.loaded_rows) * append.row_words];
+	for(uint w = 0; w < append.row_words; w++){new_row[w] = batch_row[w];}
+
+	header.num_rows++;
+
+	bloom_insert(new_row);
+	node_t *element = search_dictionary(new_row);
+
+	if(element->frequency != 0) {
+		element->frequency = (element->frequency) + 1;
+		element->index_end = row + 1;
+	}
+	else {
+		add_item_to_dictionary(new_row, row, id);
+		element->appended = (packed >> 16 == 1);
+	}
+	element->global_frequency = packed >> 16;
+
+	//max_id stays at the loaded ids - the record chain passes it on to the next core
+	local_index.id_index[row] = id;
+
+}
+
+void append_next_round() {
+
+	if(append.position == append.num_new) {
+		log_info("APPENDED %d ROWS, MAX ID %d", append.num_new, global_max_id);
+		server_query_complete();
+		return;
+	}
+
+	reported_ready = 0;
+	append.best    = append_lookup(append.position);
+	send_function_signal(APPEND_QUERY, append.position, 0);
+
+}
+
+void append_receive(uint key, uint payload) {
+
+	//Case 1: You are the leader and collecting ids
+	if(header.processor_id % RING_SIZE == 0) {
+
+		if(key == ring_in_key){return;}
+
+		if((payload & 0xFFFF) > (append.best & 0xFFFF)) {
+			append.best = payload;
+		}
+
+		reported_ready++;
+
+		if(reported_ready == RING_SIZE - 1) {
+
+			//nobody holds the value - it gets the next free id
+			if((append.best & 0xFFFF) == 0) {
+				if(global_max_id == 0xFFFF) {
+					log_error("no id left for row %d of the batch", append.position);
+					append.best = 0;
+				}
+				else {
+					global_max_id++;
+					append.best = (1 << 16) | global_max_id;
+				}
+			}
+			else if((append.best >> 16) == 0xFFFF) {
+				log_error("the frequency of row %d of the batch does not fit", append.position);
+				append.best = 0;
+			}
+			else {
+				append.best = append.best + (1 << 16);
+			}
+
+			send_function_signal(APPEND_ID, append.position, append.best);
+			append_apply(append.position, append.best);
+
+			append.position++;
+			append_next_round();
+
+		}
+
+		return;
+
+	}
+
+	//Case 2: You are one of the subordinates - collect 5 packets from the leader
+	if(key != command_in_key){return;}
+
+	append.command_message[append.command_count++] = payload;
+
+	if(append.command_count == 5) {
+
+		append.command_count = 0;
+
+		if(append.command_message[0] != append.command_message[1] ||
+		   append.command_message[1] != append.command_message[2]) {
+			return;
+		}
+
+		if(append.command_message[0] == APPEND_QUERY) {
+			send_state(append_lookup(append.command_message[3]), 2);
+		}
+
+		if(append.command_message[0] == APPEND_ID) {
+			append_apply(append.command_message[3], append.command_message[4]);
+		}
+
+	}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// QUERY SERVER                                                                                  //
+// In resident mode every core keeps its data, dictionary and index between queries. The host    //
+// sends each query to every core of the ring, the leader waits until all of them are ready and  //
+// then starts the function on the whole ring. Results are returned as SDP replies               //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void server_initialise() {
+
+    address_t address = data_specification_get_data_address();
+    address_t server_region =
+        data_specification_get_region(SERVER, address);
+
+	server.iptag         = server_region[SERVER_IPTAG];
+	server.query_active  = 0;
+	server.ready_count   = 0;
+	server.command_count = 0;
+	server.reply_bytes   = 0;
+	server.index_built   = 0;
+
+	append_initialise(server_region[SERVER_APPEND_CAPACITY]);
+
+	//nothing to do until the host sends a query
+	server.state = (header.function_id == 0) ? SERVER_IDLE : SERVER_RUNNING;
+
+	simulation_sdp_callback_on(QUERY_SDP_PORT, server_sdp_receive);
+
+}
+
+void server_sdp_receive(uint mailbox, uint port) {
+
+	use(port);
+
+	sdp_msg_t *msg = (sdp_msg_t *) (uintptr_t) mailbox;
+
+	//a message without a command header is not a query
+	if(msg->length < sizeof(sdp_hdr_t) + sizeof(cmd_hdr_t)) {
+		log_error("query of %d bytes is too short", msg->length);
+		spin1_msg_free(msg);
+		return;
+	}
+
+	//one query at a time - the ring (and a load without function id 0) must finish first
+	if(server.state != SERVER_IDLE) {
+		server_send(&server.rejection, QUERY_REJECTED, msg->seq, REJECT_BUSY);
+		spin1_msg_free(msg);
+		return;
+	}
+
+	//a function that does not exist would never report done
+	if(msg->cmd_rc < 1 || msg->cmd_rc > 6) {
+		server_send(&server.rejection, QUERY_REJECTED, msg->seq, REJECT_FUNCTION);
+		spin1_msg_free(msg);
+		return;
+	}
+
+	server.state       = SERVER_QUEUED;
+	server.function_id = msg->cmd_rc;
+	server.seq         = msg->seq;
+	server.args[0]     = msg->arg1;
+	server.args[1]     = msg->arg2;
+	server.args[2]     = msg->arg3;
+
+	//optional payload, e.g. the strings of a membership query
+	server.data_words = (msg->length - sizeof(sdp_hdr_t) - sizeof(cmd_hdr_t)) / 4;
+	if(server.data_words > SDP_DATA_SIZE / 4) {
+		server.data_words = SDP_DATA_SIZE / 4;
+	}
+	spin1_memcpy(server.data, msg->data, server.data_words * 4);
+
+	spin1_msg_free(msg);
+
+	//leave the preemptive SDP callback as quickly as possible
+	spin1_schedule_callback(server_start_query, 0, 0, USER);
+
+}
+
+void server_start_query(uint a, uint b) {
+
+	use(a);
+	use(b);
+
+	//results of earlier work still belong to the recording region
+	output_flush();
+
+	header.function_id  = server.function_id;
+	trace_phase(header.function_id);
+	server.query_active = 1;
+	server.reply_bytes  = 0;
+	server.command_count = 0;
+
+	//forget the progress of the previous query
+	local_index.messages_received = 0;
+	reported_ready                = 0;
+	forward_mode_on               = 0;
+	bloom.words_received          = 0;
 
-				node_t *found = search_dictionary_with_id(current_id);
-				if(found->frequency != 0) {
-					found->global_frequency = found->frequency + sum;
-				}
+	if(server.function_id == 5) {
+		bloom.queries     = server.data;
+		bloom.num_queries = server.args[0];
+	}
 
-			}
+	server.state = SERVER_WAIT_GO;
 
-			send_function_signal(0, sum, current_id);
-			current_id++;
-			sum = 0;
+	if(header.processor_id % RING_SIZE != 0) {
+		send_state(-1, 2); //report ready
+	}
+	else {
+		server_try_go();
+	}
+
+}
+
+void server_try_go() {
+
+	//the leader starts once its own query and all subordinates are there
+	if(server.state != SERVER_WAIT_GO || server.ready_count < RING_SIZE - 1) {
+		return;
+	}
+
+	server.ready_count = server.ready_count - (RING_SIZE - 1);
+	send_function_signal(SERVER_GO, server.seq, server.function_id);
+	server_run();
 
+}
+
+void server_run() {
+
+	server.state = SERVER_RUNNING;
+
+	//the index is built once and kept for every later query
+	if(header.function_id == 2) {
+		if(server.index_built == 1) {
+			if(header.processor_id % RING_SIZE == 0){server_query_complete();}
+			return;
+		}
+		server.index_built = 1;
+	}
+
+	start_processing();
+
+}
+
+void server_receive(uint key, uint payload) {
+
+	//Case 1: You are the leader and collecting ready reports
+	if(header.processor_id % RING_SIZE == 0) {
+
+		if(key != ring_in_key && payload == -1) {
+			server.ready_count++;
+			server_try_go();
 		}
 
+		return;
+
 	}
 
-	//Case 3: You are one of the subordinates
-	if(header.processor_id % 16 != 0) {
+	//Case 2: You are one of the subordinates and waiting for the go
+	if(key != command_in_key){return;}
 
-		local_index.messages_received++;
+	server.command_message[server.command_count++] = payload;
 
-		//collect up to 5 messages
-		if(local_index.messages_received % 5 != 0) {
-			local_index.message[(local_index.messages_received % 5) - 1] = payload;
+	if(server.command_count == 5) {
+
+		server.command_count = 0;
+
+		if(server.command_message[0] == SERVER_GO &&
+		   server.command_message[1] == SERVER_GO &&
+		   server.command_message[2] == SERVER_GO &&
+		   server.state == SERVER_WAIT_GO) {
+			server_run();
 		}
-		else {
-			local_index.message_id = payload;
 
-			//UPDATE
-			if(identify_signal(0) == 1) {
+	}
 
-				node_t *found = search_dictionary_with_id(local_index.message_id);
+}
 
-				if(found->frequency != 0) {
-					found->global_frequency = local_index.message[3];
-				}
+void server_command(uint payload) {
 
-				send_state(-1, 2);
+	server.command_message[server.command_count++] = payload;
+	if(server.command_count < 5){return;}
 
-				#if defined(DEBUG_1) && (DEBUG_1 == 1)
-					if((time > DEBUG_START) && (time < DEBUG_END)) {
-						log_info("SEND ACKNOWLEDGEMENT: -1");
-					}
-				#endif
+	server.command_count = 0;
 
-			}
+	if(server.command_message[0] == SERVER_DONE &&
+	   server.command_message[1] == SERVER_DONE &&
+	   server.command_message[2] == SERVER_DONE) {
+		server_finish_query();
+		return;
+	}
 
-			//QUERY
-			if(identify_signal(1) == 1) {
+	//any other command goes to the function as it came in
+	for(uint i = 0; i < 5; i++) {
+		dispatch_function(command_in_key, server.command_message[i]);
+	}
 
-				node_t *found = search_dictionary_with_id(local_index.message_id);
-				send_state(found->frequency, 2);
+}
 
-				#if defined(DEBUG_1) && (DEBUG_1 == 1)
-					if((time > DEBUG_START) && (time < DEBUG_END)) {
-						log_info("SEND FREQUENCY: %d", found->frequency);
-					}
-				#endif
+void server_send(sdp_msg_t *reply, uint type, uint seq, uint arg2) {
 
-			}
+	//arg2 - bytes of data that follow, or the reason of a rejection
+	uint bytes = (type == QUERY_REJECTED) ? 0 : arg2;
 
-			//RECORD
-			if(identify_signal(2) == 1){
+	if(server.iptag == SERVER_NO_TAG) {
+		log_error("resident mode needs an IP tag to reply to");
+		return;
+	}
 
-				uint the_leader = local_index.message[3];
-				if(the_leader == header.processor_id) {
-					uint start_id  = local_index.message_id;
+	reply->tag       = server.iptag;
+	reply->dest_port = PORT_ETH;
+	reply->dest_addr = sv->eth_addr;
+	reply->flags     = 0x07;
+	reply->srce_port = (QUERY_SDP_PORT << 5) | spin1_get_core_id();
+	reply->srce_addr = sv->p2p_addr;
 
-					if(start_id <= local_index.max_id){
-						record_unqiue_items(start_id,local_index.max_id);
-						send_state(local_index.max_id+1,2);
-					}
+	reply->cmd_rc = type;
+	reply->seq    = seq;
+	reply->arg1   = header.processor_id;
+	reply->arg2   = arg2;
+	reply->arg3   = 0;
+	reply->length = sizeof(sdp_hdr_t) + sizeof(cmd_hdr_t) + bytes;
 
-					if(start_id > local_index.max_id){
-						send_state(start_id,2);
-					}
+	(void) spin1_send_sdp_msg(reply, 100); // 100ms timeout
 
-				#if defined(DEBUG_1) && (DEBUG_1 == 1)
-					if((time > DEBUG_START) && (time < DEBUG_END)) {
-						log_info("SEND RECORDED: %d", local_index.max_id);
-					}
-				#endif
+}
 
-				}
+void server_send_reply(uint type) {
 
-			}
+	server_send(&server.reply, type, server.seq, server.reply_bytes);
+	server.reply_bytes = 0;
 
-		}
+}
+
+void server_query_complete() {
+
+	//a function started by the load (not by a query) records until the end of the run
+	if(server.query_active == 0){return;}
+
+	//the leader tells the ring, every core then answers the host for itself
+	send_function_signal(SERVER_DONE, server.seq, 0);
+	server_finish_query();
+
+}
+
+void server_finish_query() {
+
+	output_flush();
+	profile_write();
+	server_send_reply(QUERY_DONE);
+
+	server.query_active = 0;
+	server.state        = SERVER_IDLE;
+
+}
+
+void output_record(void *data, uint size) {
 
+	if(output.num_bytes + size > sizeof(output.data)) {
+		output_flush();
 	}
 
+	spin1_memcpy(&output.data[output.num_bytes], data, size);
+	output.num_bytes  = output.num_bytes + size;
+	output.num_fields = output.num_fields + 1;
+
 }
 
-void count_function_start() {
+void output_flush() {
 
-	//send the first MCPL package if initiate is TRUE
-	if(header.initiate_send == 1) {
-		record_int_entry(header.num_rows);
-		send_state(header.num_rows, 1);
+	if(output.num_fields == 0){return;}
+
+	uint size = OUTPUT_HEADER_SIZE + output.num_bytes;
+
+	//outside of a query everything goes to the recording region
+	if(server.query_active == 0) {
+		recording_record(0, &output, size);
 	}
+	else {
+		spin1_memcpy(server.reply.data, &output, size);
+		server.reply_bytes = size;
+		server_send_reply(QUERY_DATA);
+	}
+
+	output.num_fields = 0;
+	output.num_bytes  = 0;
 
 }
 
-void count_function_receive(uint payload) {
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LOAD                                                                                          //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void load_initialise() {
+
+    address_t address = data_specification_get_data_address();
+    load.region = data_specification_get_region(LOAD, address);
+
+    load.busy_cycles = 0;
+    load.packets     = 0;
+
+    load.region[LOAD_BUSY_LOW]  = 0;
+    load.region[LOAD_BUSY_HIGH] = 0;
+    load.region[LOAD_PACKETS]   = 0;
+
+    //timer 2 free running, 32 bit, no prescaler - one count per cpu cycle
+    tc[T2_CONTROL] = 0x82;
+
+}
+
+void load_add(uint start) {
+
+	//the timer counts down
+	load.busy_cycles = load.busy_cycles + (start - tc[T2_COUNT]);
+
+	load.region[LOAD_BUSY_LOW]  = (uint) load.busy_cycles;
+	load.region[LOAD_BUSY_HIGH] = (uint) (load.busy_cycles >> 32);
+	load.region[LOAD_PACKETS]   = load.packets;
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// PROFILE                                                                                       //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void profile_initialise() {
+
+    address_t address = data_specification_get_data_address();
+    profile.region = data_specification_get_region(PROFILE, address);
+
+    profile.heap_free_start = sark_heap_max(sark.heap, 0);
+    profile.heap_free_min   = profile.heap_free_start;
+
+    profile_write();
+
+}
+
+void profile_tick() {
+
+	uint heap_free = sark_heap_max(sark.heap, 0);
+	if(heap_free < profile.heap_free_min){profile.heap_free_min = heap_free;}
+
+	if(profile.active == 1 && header.function_id < NUM_PHASES) {
+		profile.phase_ticks[header.function_id]++;
+	}
+	profile.active = 0;
+
+}
+
+void profile_write() {
+
+	profile.region[PROFILE_SENT_RING]         = profile.sent[0];
+	profile.region[PROFILE_SENT_OTHER]        = profile.sent[1];
+	profile.region[PROFILE_SENT_MACHINE_RING] = profile.sent[2];
+	profile.region[PROFILE_RECEIVED_RING]     = profile.received[0];
+	profile.region[PROFILE_RECEIVED_COMMAND]  = profile.received[1];
+	profile.region[PROFILE_RECEIVED_OTHER]    = profile.received[2];
+	profile.region[PROFILE_RECEIVED_MACHINE_RING] = profile.received[3];
+	profile.region[PROFILE_SEND_RETRIES]      = profile.send_retries;
+	profile.region[PROFILE_SEARCHES]          = profile.searches;
+	profile.region[PROFILE_SEARCH_PROBES]     = profile.search_probes;
+	profile.region[PROFILE_SEARCH_PROBES_MAX] = profile.search_probes_max;
+	profile.region[PROFILE_COMPARES]          = profile.compares;
+	profile.region[PROFILE_INSERTS]           = profile.inserts;
+	profile.region[PROFILE_HEAP_PEAK]         = profile.heap_free_start - profile.heap_free_min;
+
+	for(uint i = 0; i < NUM_PHASES; i++) {
+		profile.region[PROFILE_PHASE_TICKS + i] = profile.phase_ticks[i];
+	}
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// TRACE                                                                                         //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void trace_initialise(uint timer_period) {
+
+    address_t address = data_specification_get_data_address();
+    trace.region = data_specification_get_region(TRACE, address);
+
+    //the host wrote the number of events that fit
+    trace.capacity   = trace.region[TRACE_CAPACITY];
+    trace.written    = 0;
+    trace.next       = 0;
+    trace.tick_start = tc[T2_COUNT];
+    trace.phase      = PHASE_NONE;
+
+    trace.region[TRACE_WRITTEN]      = 0;
+    trace.region[TRACE_TIMER_PERIOD] = timer_period;
+
+}
+
+void trace_event(uint event, uint argument) {
+
+	if(trace.capacity == 0){return;}
+
+	//the oldest events are overwritten once the buffer is full
+	address_t entry = &trace.region[TRACE_EVENTS + trace.next * TRACE_EVENT_WORDS];
+
+	entry[0] = time;
+	entry[1] = trace.tick_start - tc[T2_COUNT];
+	entry[2] = (event << 24) | (argument & 0xFFFFFF);
+
+	trace.next++;
+	if(trace.next == trace.capacity){trace.next = 0;}
+
+	trace.written++;
+	trace.region[TRACE_WRITTEN] = trace.written;
+
+}
+
+void trace_phase(uint function_id) {
+
+	if(function_id == trace.phase){return;}
+
+	if(trace.phase != PHASE_NONE){trace_event(TRACE_END, trace.phase);}
+	if(function_id != PHASE_NONE){trace_event(TRACE_BEGIN, function_id);}
+
+	trace.phase = function_id;
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// LOG                                                                                           //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void log_initialise(uint timer_period) {
+
+    address_t address = data_specification_get_data_address();
+    binary_log.region = data_specification_get_region(LOG, address);
+
+    //the host wrote the number of records that fit
+    binary_log.capacity = binary_log.region[LOG_CAPACITY];
+    binary_log.written  = 0;
+    binary_log.next     = 0;
+
+    binary_log.region[LOG_WRITTEN]      = 0;
+    binary_log.region[LOG_TIMER_PERIOD] = timer_period;
+
+}
+
+void log_record(uint format, uint a0, uint a1, uint a2, uint a3, uint a4) {
+
+	if(binary_log.capacity == 0){return;}
+
+	//the oldest records are overwritten once the buffer is full
+	address_t record = &binary_log.region[LOG_RECORDS + binary_log.next * LOG_RECORD_WORDS];
+
+	record[0] = time;
+	record[1] = trace.tick_start - tc[T2_COUNT];
+	record[2] = format;
+	record[3] = a0;
+	record[4] = a1;
+	record[5] = a2;
+	record[6] = a3;
+	record[7] = a4;
+
+	binary_log.next++;
+	if(binary_log.next == binary_log.capacity){binary_log.next = 0;}
+
+	binary_log.written++;
+	binary_log.region[LOG_WRITTEN] = binary_log.written;
+
+}
+
+///////////////////////////////////////////////////////////////////////////////////////////////////
+// CAPTURE                                                                                       //
+///////////////////////////////////////////////////////////////////////////////////////////////////
+
+void capture_initialise() {
+
+    address_t address = data_specification_get_data_address();
+    capture.region = data_specification_get_region(CAPTURE, address);
+
+    //the host wrote the number of packets that fit, 0 - no capture
+    capture.capacity = capture.region[CAPTURE_CAPACITY];
+    capture.written  = 0;
+
+    capture.region[CAPTURE_WRITTEN] = 0;
+
+}
+
+void capture_packet(uint key, uint payload) {
+
+	if(capture.written < capture.capacity) {
+
+		address_t packet = &capture.region[CAPTURE_PACKETS + capture.written * CAPTURE_PACKET_WORDS];
+
+		packet[0] = time;
+		packet[1] = key;
+		packet[2] = payload;
 
-	//if we have reached the original vertex, stop the entire mechanism
-	if(header.initiate_send == 0){
-		payload = payload + header.num_rows;
-		send_state(payload, 1);
-		record_int_entry(payload);
 	}
 
+	//counted beyond the capacity, so the host sees that the capture is cut short
+	capture.written++;
+	capture.region[CAPTURE_WRITTEN] = capture.written;
+
 }
 
 ///////////////////////////////////////////////////////////////////////////////////////////////////
@@ -1306,8 +3544,12 @@ void send_state(uint payload, uint partition_number) {
     alive_states_recieved_this_tick = 0;
     dead_states_recieved_this_tick = 0;
 
+    profile.sent[partition_number-1]++;
+    profile.active = 1;
+
     // send my new state to the simulation neighbours
     while (!spin1_send_mc_packet(key_values[partition_number-1], payload, WITH_PAYLOAD)) {
+        profile.send_retries++;
         spin1_delay_us(1);
     }
 
@@ -1315,6 +3557,18 @@ void send_state(uint payload, uint partition_number) {
 
 void receive_data(uint key, uint payload) {
 
+	uint start = tc[T2_COUNT];
+
+	load.packets++;
+	capture_packet(key, payload);
+	dispatch_data(key, payload);
+
+	load_add(start);
+
+}
+
+void dispatch_data(uint key, uint payload) {
+
    //uint key: packet routing key - provided by the RTS
    //uint payload: packet payload - provided by the RTS
 
@@ -1322,22 +3576,68 @@ void receive_data(uint key, uint payload) {
    //log_info("the payload i've received is %d\n", payload);
 
 	#if defined(DEBUG_1) && (DEBUG_1 == 1)
-	   if((time > DEBUG_START) && (time < DEBUG_END)) {
-		   log_info("--package arrived-- %d", payload);
-	   }
+		log_binary(LOG_PACKET, key, payload);
 	#endif
 
+   if(key == ring_in_key){profile.received[0]++;}
+   else if(key == command_in_key){profile.received[1]++;}
+   else if(key == machine_ring_in_key){profile.received[3]++;}
+   else {profile.received[2]++;}
+   profile.active = 1;
+
+   //the sort passes frames round the machine ring, also through rings busy with something else
+   if(key == machine_ring_in_key) {
+	   sort_ring(payload);
+	   return;
+   }
+
+   //resident mode - no function runs until the whole ring has the query
+   if(server.state != SERVER_RUNNING) {
+	   server_receive(key, payload);
+	   return;
+   }
+
+   //resident mode - a subordinate learns from the leader that the query is done
+   if(server.query_active == 1 && key == command_in_key) {
+	   server_command(payload);
+	   return;
+   }
+
+   dispatch_function(key, payload);
+
+}
+
+void dispatch_function(uint key, uint payload) {
+
+   if(header.num_encoded_ids != 0 && (header.function_id == 2 || header.function_id == 3)) {
+	   encoded_histogram_receive(payload);
+	   return;
+   }
+
    //depending on the function, select a way to handle the incoming message
    switch(header.function_id) {
 		case 1 :
 			 count_function_receive(payload);
 	         break;
 		case 2 :
+			 if(header.key_partitioned == 1) {
+				 partitioned_index_receive(key, payload);
+				 break;
+			 }
 			 index_receive(payload);
 	         break;
 		case 3 :
 			 histogram_receive(payload);
 			 break;
+		case 4 :
+			 sort_receive(key, payload);
+			 break;
+		case 5 :
+			 bloom_receive(key, payload);
+			 break;
+		case 6 :
+			 append_receive(key, payload);
+			 break;
 	}
 
 }
@@ -1361,6 +3661,8 @@ void retrieve_header_data() {
     //header data that contains:
     //- The data description
     //- Processing instructions
+    input_data = data_address;
+
     header.processor_id    = data_address[0];
     header.num_cols        = data_address[1];
 	header.num_rows        = data_address[2];
@@ -1368,6 +3670,8 @@ void retrieve_header_data() {
 	header.num_string_cols = data_address[4];
 	header.initiate_send   = data_address[5];
 	header.function_id     = data_address[6];
+	header.key_partitioned = data_address[7];
+	header.num_encoded_ids = data_address[8];
 
 	reported_ready  = 0;
 	forward_mode_on = 0;
@@ -1394,6 +3698,8 @@ void record_unqiue_items(uint start, uint end) {
 
 	node_t *item = dictionary;
 
+	trace_event(TRACE_BEGIN, PHASE_RECORD);
+
 	while(item->frequency != 0) {
 
 		if(item->id < start) {
@@ -1409,58 +3715,54 @@ void record_unqiue_items(uint start, uint end) {
 			}
 
 			if(item->id > end) {
-				return;
+				break;
 			}
 
 		}
 
 	}
 
+	//values appended later come after every loaded one, whatever their id
+	while(item->frequency != 0) {
+		if(item->appended == 1) {
+			record_string_entry(item->entry,item->entry_size);
+			record_int_entry(item->global_frequency);
+		}
+		item = item->next;
+	}
+
+	trace_event(TRACE_END, PHASE_RECORD);
+
 }
 
 void record_string_entry(uint *int_arr, uint size) {
 
-	//convert the array of [size] integers to a 4*[size] char array
-	unsigned char buffer[header.string_size];
-
-	uint num_ints = header.string_size/4;
+	//convert the array of [size] big endian integers to a length prefixed char array
+	unsigned char buffer[1 + header.string_size];
 
-	uint i = 0;
-	for(i = 0; i < size; i++) {
-      buffer[num_ints*i + 0] = (int_arr[i] >> 24) & 0xFF;
-	  buffer[num_ints*i + 1] = (int_arr[i] >> 16) & 0xFF;
-	  buffer[num_ints*i + 2] = (int_arr[i] >> 8) & 0xFF;
-	  buffer[num_ints*i + 3] =  int_arr[i] & 0xFF;
+	uint length = 0;
+	for(uint i = 0; i < size; i++) {
+		buffer[1 + length++] = (int_arr[i] >> 24) & 0xFF;
+		buffer[1 + length++] = (int_arr[i] >> 16) & 0xFF;
+		buffer[1 + length++] = (int_arr[i] >> 8) & 0xFF;
+		buffer[1 + length++] =  int_arr[i] & 0xFF;
 	}
 
-
-	if(size < header.string_size/4) {
-
-		uint remain = (header.string_size/4) - size;
-
-		for(uint k = i; k < header.string_size/4; k++) {
-			buffer[num_ints*k + 0] = 32;
-			buffer[num_ints*k + 1] = 32;
-			buffer[num_ints*k + 2] = 32;
-			buffer[num_ints*k + 3] = 32;
-		}
-
+	//the padding is not recorded
+	while(length > 0 && (buffer[length] == 32 || buffer[length] == 0)) {
+		length--;
 	}
 
-    //log_info("String Entry : %s", buffer);
+	buffer[0] = length;
 
-    //record the data entry in the first recording region (which is OUTPUT)
-    bool recorded = recording_record(0, buffer, header.string_size * sizeof(unsigned char));
+	output_record(buffer, 1 + length);
 
 }
 
 void record_int_entry(uint solution) {
 
-	char result[10];
-	itoa(solution,result,10);
-
-    //uintegers take 10 chars if represented as char arrays
-    bool recorded = recording_record(0, result, 10 * sizeof(unsigned char));
+	//4 bytes, little endian like the core itself
+	output_record(&solution, sizeof(uint));
 
 }
 
@@ -1474,26 +3776,31 @@ void update(uint ticks, uint b) {
     use(ticks);
 
     time++;
+    trace.tick_start = tc[T2_COUNT];
 
-    if(DEBUG_1 == 1 || DEBUG_2 == 1 || DEBUG_3 == 1 || DEBUG_4 == 1){
-    	if((time > DEBUG_START) && (time < DEBUG_END)) {
-    		 log_info("on tick %d of %d", time, simulation_ticks);
-    	}
-    }
+	#if defined(DEBUG_4) && (DEBUG_4 == 1)
+		log_binary(LOG_TICK, time, simulation_ticks);
+	#endif
 
     if(header.function_id == 3) {
     	if(time_out_block_start != 0 && time_out_block_end != 0) {
 
-    		log_info("timeout");
+    		log_binary(LOG_TIMEOUT_CHECK, time_out_block_start, time_out_block_end);
     		uint time_taken  = time_out_block_end - time_out_block_start;
     		uint time_passed = time - time_out_block_end;
 
     		if(time_taken == 0){
-    			if(time_passed == 5){leader_next_step();}
+    			if(time_passed == 5){
+    				trace_event(TRACE_TIMEOUT, time_passed);
+    				leader_next_step();
+    			}
     		}
 
     		if(time_taken != 0){
-    			if(time_passed == time_taken * 5){leader_next_step();}
+    			if(time_passed == time_taken * 5){
+    				trace_event(TRACE_TIMEOUT, time_passed);
+    				leader_next_step();
+    			}
     		}
 
     	}
@@ -1505,9 +3812,13 @@ void update(uint ticks, uint b) {
 
         if (recording_flags > 0) {
             log_info("updating recording regions");
+            output_flush();
             recording_finalise();
         }
 
+        profile_write();
+        trace_phase(PHASE_NONE);
+
         // falls into the pause resume mode of operating
         simulation_handle_pause_resume(resume_callback);
 
@@ -1515,14 +3826,33 @@ void update(uint ticks, uint b) {
 
     }
 
+    uint start = tc[T2_COUNT];
+
     if (time == 1) {
     	retrieve_header_data();
-    	start_processing();
+    	bloom_initialise();
+    	server_initialise();
+    	if(server.state == SERVER_RUNNING) {
+    		start_processing();
+    	}
     }
     else if(time == runtime) {
         iobuf_data();
     }
 
+    //hand the next rows of the sort to the machine ring
+    if(header.function_id == 4 && sort.phase == SORT_EXCHANGE) {
+    	sort_exchange_step();
+    }
+
+    profile_tick();
+    load_add(start);
+
+    //runs without an end stream every tick, otherwise blocks are recorded once full
+    if(infinite_run == TRUE && server.query_active == 0) {
+    	output_flush();
+    }
+
     // trigger buffering_out_mechanism
     if (recording_flags > 0) {
         //log_info("doing timer tick update\n");
@@ -1595,6 +3925,21 @@ static bool initialize(uint32_t *timer_period) {
     alive_states_recieved_this_tick = my_neigbhour_state_region_address[0];
     dead_states_recieved_this_tick = my_neigbhour_state_region_address[1];
 
+    // read the keys of incoming edges
+    address_t neighbour_keys_region_address = data_specification_get_region(
+        NEIGHBOUR_KEYS, address);
+    ring_in_key         = neighbour_keys_region_address[RING_IN_KEY];
+    command_in_key      = neighbour_keys_region_address[COMMAND_IN_KEY];
+    machine_ring_in_key = neighbour_keys_region_address[MACHINE_RING_IN_KEY];
+    machine_cores       = neighbour_keys_region_address[MACHINE_CORES];
+    machine_position    = neighbour_keys_region_address[MACHINE_POSITION];
+
+    load_initialise();
+    profile_initialise();
+    trace_initialise(*timer_period);
+    log_initialise(*timer_period);
+    capture_initialise();
+
     return true;
 }
 
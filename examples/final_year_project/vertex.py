@@ -3,6 +3,7 @@ from pacman.model.decorators import overrides
 from pacman.model.graphs.machine import MachineVertex
 from pacman.model.resources import CPUCyclesPerTickResource, DTCMResource
 from pacman.model.resources import ResourceContainer, SDRAMResource
+from pacman.model.resources import IPtagResource
 from pacman.utilities import utility_calls
 
 from spinn_front_end_common.utilities import globals_variables
@@ -19,25 +20,115 @@ from spinn_front_end_common.utilities.utility_objs import ExecutableStartType
 
 from enum import Enum
 import logging
+import struct
 import time
 
 logger = logging.getLogger(__name__)
 
 from utilities.string_marshalling import _32intarray_to_int
-from utilities.string_marshalling import convert_string_to_integer_parcel
+from utilities.string_marshalling import pack_string_column
 
 class Vertex(
         MachineVertex, MachineDataSpecableVertex, AbstractHasAssociatedBinary,
         AbstractReceiveBuffersToHost):
     
-    #different edge partitions
+    #different edge partitions - the machine ring runs through every core of every chip
     RING    = "RING"
     REPORT  = "REPORT"
     COMMAND = "COMMAND"
-
-    TRANSMISSION_DATA_SIZE = 4 * 4  # has key and key
-    STATE_DATA_SIZE = 2 * 4  # 1 or 2 based off dead or alive
-    NEIGHBOUR_INITIAL_STATES_SIZE = 4 * 4 # alive states, dead states
+    MACHINE_RING = "MACHINE_RING"
+
+    TRANSMISSION_DATA_SIZE = 6 * 4  # has key and key, for each of the three partitions
+    STATE_DATA_SIZE = 3 * 4  # 1 or 2 based off dead or alive
+    NEIGHBOUR_INITIAL_STATES_SIZE = 6 * 4 # alive states, dead states
+    NEIGHBOUR_KEYS_SIZE = 5 * 4 # incoming ring, command and machine ring key, cores and position in the machine ring
+    SERVER_DATA_SIZE = 2 * 4 # reply iptag, rows that may be appended
+    LOAD_DATA_SIZE = 3 * 4 # busy cycles (low, high word), received packets
+
+    # counters vertex.c writes at the end of the run, in the order of profile_region_elements
+    PROFILE_COUNTERS = ["sent_ring", "sent_other", "sent_machine_ring",
+                        "received_ring", "received_command", "received_other",
+                        "received_machine_ring",
+                        "send_retries",
+                        "searches", "search_probes", "search_probes_max",
+                        "compares", "inserts",
+                        "heap_peak"]
+    PROFILE_PHASES = 7 # ticks with packets for every function id
+    PROFILE_DATA_SIZE = (len(PROFILE_COUNTERS) + PROFILE_PHASES) * 4
+
+    # ring buffer of timestamped events (see utilities/trace.py)
+    TRACE_HEADER_SIZE = 3 * 4 # capacity, events written, timer period
+    TRACE_EVENT_SIZE  = 3 * 4 # tick, cycles since the tick started, event and argument
+    TRACE_EVENTS      = 1024
+
+    # ring buffer of binary debug messages (see utilities/binary_log.py), only reserved when
+    # vertex.c is built with one of its DEBUG_ flags on
+    DEBUG_LOGGING   = False # must match DEBUG_1 .. DEBUG_4 in vertex.c
+    LOG_HEADER_SIZE = 3 * 4 # capacity, records written, timer period
+    LOG_RECORD_SIZE = 8 * 4 # tick, cycles since the tick started, format, 5 arguments
+    LOG_RECORDS     = 1024 if DEBUG_LOGGING else 0
+
+    # received packets for a replay on the emulator (see utilities/replay.py)
+    CAPTURE_HEADER_SIZE = 2 * 4 # capacity, packets received
+    CAPTURE_PACKET_SIZE = 3 * 4 # tick, key, payload
+
+    # messages of log_binary in vertex.c, in the order of log_formats
+    LOG_FORMATS = ["tick %u of %u",
+                   "timeout check, block of ticks %u-%u",
+                   "packet key %08x payload %d",
+                   "send string %08x %08x %08x %08x id %d",
+                   "forward %08x %08x %08x %08x id %d",
+                   "signal %d from core %d id %d",
+                   "function signal %d: %d %d",
+                   "acknowledge, index complete %d, in charge %d",
+                   "send frequency of id %d: %d",
+                   "send recorded ids %d-%d",
+                   "received %d",
+                   "message %d %d %d %d id %d",
+                   "max id %d, next leader after %d",
+                   "query id %d, max id %d",
+                   "hand over the lead at id %d",
+                   "search %08x %08x %08x %08x",
+                   "probe %08x %08x %08x %08x",
+                   "add %08x frequency %d rows %d-%d id %d",
+                   "update %08x frequency %d rows %d-%d id %d",
+                   "current entry %08x",
+                   "find id %d",
+                   "probe %08x %08x %08x %08x id %d",
+                   "id %d starts at row %d, index scan: %d",
+                   "lookup %08x frequency %d rows %d-%d id %d"]
+
+    #resident mode - replies to queries are sent to this port on the host
+    QUERY_TRAFFIC = "QUERY"
+    QUERY_REPLY_PORT = 17895
+
+    #recorded results - blocks of up to 252 bytes behind a 4 byte header (see OUTPUT INFO in vertex.c)
+    OUTPUT_BLOCK_HEADER  = 4
+    OUTPUT_BLOCK_PAYLOAD = 252
+    MIN_OUTPUT_DATA_SIZE = 256
+
+    #memory model of vertex.c - tells the placer what a core really needs
+    DTCM_AVAILABLE     = 64 * 1024
+    DTCM_STATIC        = 8 * 1024 # stack, globals, output block and query reply
+    HEAP_BLOCK_HEADER  = 8        # bookkeeping of every malloc/sark_xalloc
+    NODE_SIZE          = 20       # node_t of the dictionary
+    SORT_ROWS_PER_TICK = 32       # must match vertex.c
+    SORT_FRAME_WORDS   = 16       # must match vertex.c, a header and the key
+    RING_SIZE          = 16
+    CPU_CYCLES_BASE       = 45
+    CPU_CYCLES_PER_PACKET = 40
+
+    #must match the RECORD_ flags in vertex.c
+    RECORD_IDS = False
+    RECORD_LINKED_LIST_LENGTHS = False
+
+    #function ids understood by vertex.c
+    FUNCTION_COUNT = 1
+    FUNCTION_INDEX = 2
+    FUNCTION_HISTOGRAM = 3
+    FUNCTION_SORT = 4
+    FUNCTION_MEMBERSHIP = 5
+    FUNCTION_APPEND = 6
 
     # Regions for populations
     DATA_REGIONS = Enum(
@@ -47,11 +138,23 @@ class Vertex(
                ('OUTPUT_DATA', 2),
                ('TRANSMISSIONS', 3),
                ('STATE', 4),
-               ('NEIGHBOUR_INITIAL_STATES', 5)])
+               ('NEIGHBOUR_INITIAL_STATES', 5),
+               ('NEIGHBOUR_KEYS', 6),
+               ('BLOOM', 7),
+               ('SERVER', 8),
+               ('LOAD', 9),
+               ('PROFILE', 10),
+               ('TRACE', 11),
+               ('LOG', 12),
+               ('CAPTURE', 13)])
 
     CORE_APP_IDENTIFIER = 0xBEEF
 
-    def __init__(self, label, columns, rows, string_size, num_string_cols, entries, initiate, function_id, state, constraints=None):
+    def __init__(self, label, columns, rows, string_size, num_string_cols, partition, initiate, function_id, state,
+                 bloom_words=0, bloom_hashes=0, queries=None, resident=False,
+                 append_capacity=0, distinct=None, key_partitioned=False,
+                 num_encoded_ids=0, predicted_load=0, trace_events=TRACE_EVENTS, log_records=LOG_RECORDS,
+                 capture_packets=0, machine_cores=16, constraints=None):
         MachineVertex.__init__(self, label=label, constraints=constraints)
 
         config = globals_variables.get_simulator().config
@@ -72,30 +175,225 @@ class Vertex(
         self.rows            = rows
         self.string_size     = string_size
         self.num_string_cols = num_string_cols 
-        self.entries         = entries 
+        self.partition       = partition
         self.initiate        = initiate
         self.function_id     = function_id
 
         '''
-        allocate space for entries and 24 bytes for the 6 integers that make up the header information'''
+        membership filter - no filter is built if bloom_words is 0'''
+        self.bloom_words     = bloom_words
+        self.bloom_hashes    = bloom_hashes
+        self.queries         = queries if queries is not None else []
+
+        '''
+        resident mode - keep data, dictionary and index and wait for queries over SDP'''
+        self.resident        = resident
+        self.append_capacity = append_capacity
+
+        '''
+        estimate of the distinct values in the first column - every row may be new if unknown'''
+        self.distinct        = distinct if distinct is not None else rows
+
+        '''
+        equal values of the first column were placed on this core only - ids follow without negotiation'''
+        self.key_partitioned = key_partitioned
+
+        '''
+        the host replaced the first string column by ids 1..num_encoded_ids (0 - not encoded)'''
+        self.num_encoded_ids = num_encoded_ids
+
+        '''
+        work the host expects this core to do (see row_cost and search_cost in utilities/ingest.py)'''
+        self.predicted_load  = predicted_load
+
+        '''
+        events the trace keeps - the oldest are overwritten, 0 turns tracing off'''
+        self.trace_events    = trace_events
+        self._trace_data_size = self.TRACE_HEADER_SIZE + self.TRACE_EVENT_SIZE * trace_events
+
+        '''
+        debug messages the log keeps - the oldest are overwritten, 0 turns logging off'''
+        self.log_records     = log_records
+        self._log_data_size  = self.LOG_HEADER_SIZE + self.LOG_RECORD_SIZE * log_records
+
+        '''
+        received packets the capture keeps for a replay - the first ones, 0 turns it off'''
+        self.capture_packets = capture_packets
+        self._capture_data_size = self.CAPTURE_HEADER_SIZE + self.CAPTURE_PACKET_SIZE * capture_packets
+
+        '''
+        cores of the machine ring (see make_circle) - the sort exchanges rows between all of them'''
+        self.machine_cores   = machine_cores
+
+        '''
+        allocate space for the packed block and 36 bytes for the 9 integers that make up the header information'''
         self._input_data_size  = (string_size * rows * num_string_cols) + \
-                                 (4           * rows * (columns - num_string_cols)) + 28
-        self._output_data_size = 10 * 1000
+                                 (4           * rows * (columns - num_string_cols)) + 36
+
+        '''
+        filter size, number of hashes and number of queries followed by the queries'''
+        self._bloom_data_size  = 12 + string_size * len(self.queries)
+
+        '''
+        buffered recording streams the results to the host, the region only has to hold
+        what has not been read yet'''
+        self._recorded_data_size = self._output_size()
+        self._output_data_size   = self._recorded_data_size
+        if self._buffer_size_before_receive is not None:
+            self._output_data_size = min(self._recorded_data_size,
+                                         2 * self._buffer_size_before_receive)
 
         # app specific elements
         self.placement = None
         self.state = state
 
+        '''
+        a partition that cannot fit is rejected here rather than by a failing core'''
+        if self._runs(self.FUNCTION_SORT) and self._key_words() >= self.SORT_FRAME_WORDS:
+            raise exceptions.ConfigurationException(
+                "strings of {} bytes do not fit into a frame of the sort".format(string_size))
+        
+        if self._dtcm_required() > self.DTCM_AVAILABLE:
+            raise exceptions.ConfigurationException(
+                "{} rows need {} bytes of DTCM on core {} - {} are available, use more cores".format(
+                    rows, self._dtcm_required(), state, self.DTCM_AVAILABLE))
+
+    def _output_size(self):
+        
+        '''
+        bytes recorded by the function - strings carry a length byte, integers take 4 bytes'''
+        string_field = 1 + self.string_size
+        payload = 0
+        
+        if self.resident:
+            #query results are sent over SDP
+            payload = 0
+        elif self.function_id == self.FUNCTION_COUNT:
+            payload = 2 * 4
+        elif self.num_encoded_ids and self.function_id in (self.FUNCTION_INDEX, self.FUNCTION_HISTOGRAM):
+            #the leader records every id of the ring with its count
+            payload = 2 * 4 * self.num_encoded_ids if self.initiate else 0
+        elif self.function_id in (self.FUNCTION_INDEX, self.FUNCTION_HISTOGRAM):
+            #each unique value of the core with its frequency
+            payload = (self.distinct + self.append_capacity) * (string_field + 4)
+            if self.RECORD_IDS:
+                payload = payload + 4 * self.rows
+            if self.RECORD_LINKED_LIST_LENGTHS:
+                payload = payload + 2 * 4
+        elif self.function_id == self.FUNCTION_SORT:
+            #a sorted bucket can hold up to twice the rows of a core (regular sampling bound)
+            field = string_field if self.num_string_cols > 0 and not self.num_encoded_ids else 4
+            payload = 2 * self.rows * field
+        elif self.function_id == self.FUNCTION_MEMBERSHIP:
+            payload = 4 * len(self.queries)
+            
+        #blocks are full apart from the last, a field never spans two blocks
+        blocks = payload / (self.OUTPUT_BLOCK_PAYLOAD - string_field) + 1
+        
+        return max(self.MIN_OUTPUT_DATA_SIZE, payload + blocks * self.OUTPUT_BLOCK_HEADER)
+
+    def _runs(self, *function_ids):
+        
+        #resident mode may run any function
+        return self.resident or self.function_id in function_ids
+
+    def _key_words(self):
+        
+        #words per key of the sorted column
+        return self.string_size / 4 if self.num_string_cols > 0 and not self.num_encoded_ids else 1
+
+    def _dtcm_required(self):
+        
+        '''
+        bytes vertex.c mallocs for the functions it runs'''
+        key_words = self._key_words()
+        dtcm = self.DTCM_STATIC
+        
+        if self._runs(self.FUNCTION_INDEX, self.FUNCTION_HISTOGRAM) and not self.num_encoded_ids:
+            dtcm = dtcm + self.index_dtcm(self.rows + self.append_capacity,
+                                          self.distinct + self.append_capacity, self.string_size)
+        
+        #the buffers of the sort are in SDRAM
+        
+        if self.bloom_words:
+            dtcm = dtcm + 4 * self.bloom_words
+            
+        return dtcm
+
+    @classmethod
+    def index_dtcm(cls, rows, values, string_size):
+        
+        '''
+        dictionary (one node per distinct value plus the end node) and id per row'''
+        return (values + 1) * (cls.NODE_SIZE + cls.HEAP_BLOCK_HEADER) + \
+               values * (string_size + cls.HEAP_BLOCK_HEADER) + 4 * rows + 4 * 4
+    
+    @classmethod
+    def index_fits(cls, rows, values, string_size=16):
+        
+        '''
+        a partition of rows with values distinct values leaves room for the index in DTCM'''
+        return cls.DTCM_STATIC + cls.index_dtcm(rows, values, string_size) <= cls.DTCM_AVAILABLE
+
+    def _sdram_required(self):
+        
+        '''
+        regions (apart from the recorded one) and the buffers vertex.c takes from the SDRAM heap'''
+        sdram = constants.SYSTEM_BYTES_REQUIREMENT + self._input_data_size + \
+                self.TRANSMISSION_DATA_SIZE + self.STATE_DATA_SIZE + \
+                self.NEIGHBOUR_INITIAL_STATES_SIZE + self.NEIGHBOUR_KEYS_SIZE + \
+                self._bloom_data_size + self.SERVER_DATA_SIZE + self.LOAD_DATA_SIZE + \
+                self.PROFILE_DATA_SIZE + self._trace_data_size + self._log_data_size + \
+                self._capture_data_size
+        
+        #order of the own rows and of up to twice the rows at the end, received rows of the bucket
+        #(up to twice the own rows), splitters and buckets of all cores, samples of a ring (core 0:
+        #of all cores) and their order
+        if self._runs(self.FUNCTION_SORT):
+            key_words = self._key_words()
+            cores = self.machine_cores if self.state == 0 else self.RING_SIZE
+            sdram = sdram + 2 * 2 * self.rows + 2 * 2 * (2 * self.rows) + \
+                            4 * (2 * self.rows * key_words + 1) + \
+                            4 * key_words * (self.machine_cores - 1) + 4 * (self.machine_cores + 1) + \
+                            4 * cores * (1 + (self.RING_SIZE - 1) * key_words) + \
+                            2 * 2 * cores * (self.RING_SIZE - 1) + 9 * (self.HEAP_BLOCK_HEADER + 4)
+            
+        #appended rows
+        if self.append_capacity:
+            row_words = self.num_string_cols * (self.string_size / 4) + (self.columns - self.num_string_cols)
+            sdram = sdram + 4 * self.append_capacity * row_words + self.HEAP_BLOCK_HEADER
+            
+        #counts of a host encoded column
+        if self.num_encoded_ids:
+            sdram = sdram + 4 * (self.num_encoded_ids + 1) + self.HEAP_BLOCK_HEADER
+            
+        return sdram
+
+    def _cpu_cycles_required(self):
+        
+        '''
+        steady work per tick - a sort hands SORT_ROWS_PER_TICK rows to the ring on every tick'''
+        cycles = self.CPU_CYCLES_BASE
+        if self._runs(self.FUNCTION_SORT):
+            cycles = cycles + self.SORT_ROWS_PER_TICK * (self._key_words() + 1) * self.CPU_CYCLES_PER_PACKET
+        return cycles
+
     @property
     @overrides(MachineVertex.resources_required)
     def resources_required(self):
         resources = ResourceContainer(
-            cpu_cycles=CPUCyclesPerTickResource(45),
-            dtcm=DTCMResource(100), sdram=SDRAMResource(100))
+            cpu_cycles=CPUCyclesPerTickResource(self._cpu_cycles_required()),
+            dtcm=DTCMResource(self._dtcm_required()),
+            sdram=SDRAMResource(self._sdram_required()))
 
         resources.extend(recording_utilities.get_recording_resources(
            [self._output_data_size],
             self._receive_buffer_host, self._receive_buffer_port))
+
+        if self.resident:
+            resources.extend(ResourceContainer(iptags=[IPtagResource(
+                self._receive_buffer_host, self.QUERY_REPLY_PORT, strip_sdp=False,
+                traffic_identifier=self.QUERY_TRAFFIC)]))
         
         return resources
 
@@ -111,39 +409,65 @@ class Vertex(
         
         # recording data (output) region
         spec.switch_write_focus(self.DATA_REGIONS.OUTPUT_DATA.value)
+        buffer_size_before_request = self._output_data_size
+        if self._buffer_size_before_receive is not None:
+            buffer_size_before_request = self._buffer_size_before_receive
         spec.write_array(recording_utilities.get_recording_header_array(
             [self._output_data_size], self._time_between_requests,
-            self._output_data_size, iptags))   
+            buffer_size_before_request, iptags))   
         
         # input data region
         spec.switch_write_focus(self.DATA_REGIONS.INPUT_DATA.value)
         
-        #write header information - 16bytes of information  
-        spec.write_array([self.state,
-                          self.columns, 
-                          self.rows,
-                          self.string_size,
-                          self.num_string_cols,
-                          self.initiate,
-                          self.function_id])   
-        
-        #write the string data entries
-        for i in range (0, self.num_string_cols):
-            for j in range (0, self.rows):
-                spec.write_array(
-                                 convert_string_to_integer_parcel(self.entries[j][i], #-> entry converted to integers
-                                                                  self.string_size))  #-> number of integers used for string
-
-        #write the integer data entries
-        for i in range (self.num_string_cols, self.columns):
-            for k in range (0, self.rows):
-                spec.write_value(int(self.entries[k][i])) #-> those are 32-bit integers by default
+        #header information (36 bytes) followed by the string and integer data entries
+        #packed while the file was read - the whole region is written in one go
+        spec.write_array(self.partition.image([self.state,
+                                               self.columns, 
+                                               self.rows,
+                                               self.string_size,
+                                               self.num_string_cols,
+                                               self.initiate,
+                                               self.function_id,
+                                               int(self.key_partitioned),
+                                               self.num_encoded_ids]))
+
+        # resident mode - tag for the replies, 0xFFFFFFFF if there is none
+        spec.switch_write_focus(self.DATA_REGIONS.SERVER.value)
+        query_tags = [tag.tag for tag in iptags if tag.traffic_identifier == self.QUERY_TRAFFIC]
+        if query_tags:
+            spec.write_value(query_tags[0])
+        else:
+            spec.write_value(0xFFFFFFFF)
+        spec.write_value(self.append_capacity)
+
+        # membership filter parameters and queries
+        spec.switch_write_focus(self.DATA_REGIONS.BLOOM.value)
+        spec.write_array([self.bloom_words, self.bloom_hashes, len(self.queries)])
+        if self.queries:
+            spec.write_array(pack_string_column(self.queries, self.string_size))
+
+        # trace buffer - the core fills in the rest
+        spec.switch_write_focus(self.DATA_REGIONS.TRACE.value)
+        spec.write_value(self.trace_events)
+
+        # log buffer - the core fills in the rest
+        spec.switch_write_focus(self.DATA_REGIONS.LOG.value)
+        spec.write_value(self.log_records)
+
+        # packet capture - the core fills in the rest
+        spec.switch_write_focus(self.DATA_REGIONS.CAPTURE.value)
+        spec.write_value(self.capture_packets)
                     
     def configure_ring_edges(self,spec,routing_info,machine_graph):
         
         #edge related information
         # check got right number of keys and edges going into me
-        partitions = machine_graph.get_outgoing_edge_partitions_starting_at_vertex(self)
+        # the ring partition is always written first and the machine ring last, vertex.c sends
+        # ring traffic on key one and the frames of the sort on key three
+        partitions = sorted(
+            machine_graph.get_outgoing_edge_partitions_starting_at_vertex(self),
+            key=lambda partition: (partition.identifier == self.MACHINE_RING,
+                                   partition.identifier != self.RING))
             
         # check for duplicates - there is only one edge at the moment for each vertex
         edges = list(machine_graph.get_edges_ending_at_vertex(self))
@@ -209,6 +533,28 @@ class Vertex(
             spec.write_value(alive)
             spec.write_value(dead)            
 
+        #incoming keys - lets the vertex tell ring traffic apart from leader commands
+        #0xFFFFFFFF -> no such edge ends at this vertex
+        spec.switch_write_focus(region=self.DATA_REGIONS.NEIGHBOUR_KEYS.value)
+
+        ring_in_key         = 0xFFFFFFFF
+        command_in_key      = 0xFFFFFFFF
+        machine_ring_in_key = 0xFFFFFFFF
+        for edge in edges:
+            identifier = machine_graph.get_outgoing_partition_for_edge(edge).identifier
+            if identifier == self.RING:
+                ring_in_key = routing_info.get_first_key_for_edge(edge)
+            if identifier == self.COMMAND:
+                command_in_key = routing_info.get_first_key_for_edge(edge)
+            if identifier == self.MACHINE_RING:
+                machine_ring_in_key = routing_info.get_first_key_for_edge(edge)
+
+        spec.write_value(ring_in_key)
+        spec.write_value(command_in_key)
+        spec.write_value(machine_ring_in_key)
+        spec.write_value(self.machine_cores)
+        spec.write_value(self.state)
+
     @overrides(MachineDataSpecableVertex.generate_machine_data_specification)
     def generate_machine_data_specification(
             self, spec, placement, machine_graph, routing_info, iptags,
@@ -268,6 +614,38 @@ class Vertex(
             region=self.DATA_REGIONS.NEIGHBOUR_INITIAL_STATES.value,
             size=self.NEIGHBOUR_INITIAL_STATES_SIZE, label="neighour_states")    
 
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.NEIGHBOUR_KEYS.value,
+            size=self.NEIGHBOUR_KEYS_SIZE, label="neighbour_keys")
+
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.BLOOM.value,
+            size=self._bloom_data_size, label="bloom")
+
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.SERVER.value,
+            size=self.SERVER_DATA_SIZE, label="server")
+
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.LOAD.value,
+            size=self.LOAD_DATA_SIZE, label="load")
+
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.PROFILE.value,
+            size=self.PROFILE_DATA_SIZE, label="profile")
+
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.TRACE.value,
+            size=self._trace_data_size, label="trace")
+
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.LOG.value,
+            size=self._log_data_size, label="log")
+
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.CAPTURE.value,
+            size=self._capture_data_size, label="capture")
+
     def read(self, placement, buffer_manager):
         """ Get the data written into sdram
         :param placement: the location of this vertex
@@ -283,6 +661,72 @@ class Vertex(
         output = str(record_raw)
         return record_raw
 
+    def read_load(self, placement, transceiver):
+        """ Get the load vertex.c measured
+        :param placement: the location of this vertex
+        :param transceiver: the transceiver
+        :return: busy cycles and received packets
+        """
+        address = helpful_functions.locate_memory_region_for_placement(
+            placement, self.DATA_REGIONS.LOAD.value, transceiver)
+        
+        busy_low, busy_high, packets = struct.unpack(
+            "<III", str(transceiver.read_memory(placement.x, placement.y, address, self.LOAD_DATA_SIZE)))
+        return (busy_high << 32) | busy_low, packets
+
+    def read_profile(self, placement, transceiver):
+        """ Get the counters vertex.c wrote at the end of the run
+        :param placement: the location of this vertex
+        :param transceiver: the transceiver
+        :return: dictionary of the counters, phase_ticks per function id
+        """
+        address = helpful_functions.locate_memory_region_for_placement(
+            placement, self.DATA_REGIONS.PROFILE.value, transceiver)
+        
+        return self.decode_profile(
+            transceiver.read_memory(placement.x, placement.y, address, self.PROFILE_DATA_SIZE))
+
+    def read_trace(self, placement, transceiver):
+        """ Get the trace region for utilities/trace.py
+        :param placement: the location of this vertex
+        :param transceiver: the transceiver
+        :return: the raw region
+        """
+        address = helpful_functions.locate_memory_region_for_placement(
+            placement, self.DATA_REGIONS.TRACE.value, transceiver)
+        
+        return transceiver.read_memory(placement.x, placement.y, address, self._trace_data_size)
+
+    def read_log(self, placement, transceiver):
+        """ Get the log region for utilities/binary_log.py
+        :param placement: the location of this vertex
+        :param transceiver: the transceiver
+        :return: the raw region
+        """
+        address = helpful_functions.locate_memory_region_for_placement(
+            placement, self.DATA_REGIONS.LOG.value, transceiver)
+        
+        return transceiver.read_memory(placement.x, placement.y, address, self._log_data_size)
+
+    def read_capture(self, placement, transceiver):
+        """ Get the capture region for utilities/replay.py
+        :param placement: the location of this vertex
+        :param transceiver: the transceiver
+        :return: the raw region
+        """
+        address = helpful_functions.locate_memory_region_for_placement(
+            placement, self.DATA_REGIONS.CAPTURE.value, transceiver)
+        
+        return transceiver.read_memory(placement.x, placement.y, address, self._capture_data_size)
+
+    @classmethod
+    def decode_profile(cls, raw):
+        
+        words = struct.unpack("<{}I".format(len(raw) / 4), str(raw))
+        profile = dict(zip(cls.PROFILE_COUNTERS, words))
+        profile["phase_ticks"] = list(words[len(cls.PROFILE_COUNTERS):])
+        return profile
+
     def get_minimum_buffer_sdram_usage(self):
         return self._input_data_size + self._output_data_size
 
@@ -2,7 +2,8 @@
  *
  * SUMMARY
  *  a very, very simple 2D Heat equation SpiNNaker application
- *  one core does one point!
+ *  one core does a tile of TILE_ROWS x TILE_COLUMNS points, the neighbours
+ *  only exchange the rows and columns on the borders of their tiles
  *
  * AUTHOR
  *  Luis Plana - luis.plana@manchester.ac.uk
@@ -37,6 +38,14 @@
 // the visualiser has a bug with negative temperatures!
 #define POSITIVE_TEMP      TRUE
 
+// iterate as soon as the borders of all neighbours have arrived, instead of
+// once every timer tick with whatever has arrived by then
+//#define EVENT_DRIVEN       TRUE
+
+// queued priority of an event driven iteration - no other callback of this
+// application is queued at it, so nothing can hold an iteration back
+#define ITERATE_PRIORITY   1
+
 // ------------------------------------------------------------------------
 // simulation parameters
 // ------------------------------------------------------------------------
@@ -44,6 +53,11 @@
 #define TIMER_TICK_PERIOD  2500
 //#define TIMER_TICK_PERIOD  25000
 
+// points of the tile of every core - more points cost DTCM and
+// computation, but the packets only grow with the border of the tile
+#define TILE_ROWS          16
+#define TILE_COLUMNS       16
+
 #define PARAM_CX           0.03125
 #define PARAM_CY           0.03125
 
@@ -57,14 +71,33 @@
 #define EAST               1
 #define WEST               0
 
-#define NORTH_ARRIVED      (1 << NORTH)
-#define SOUTH_ARRIVED      (1 << SOUTH)
-#define EAST_ARRIVED       (1 << EAST)
-#define WEST_ARRIVED       (1 << WEST)
-#define NONE_ARRIVED       0
-#define NS_ARRIVED         (NORTH_ARRIVED | SOUTH_ARRIVED)
-#define EW_ARRIVED         (EAST_ARRIVED | WEST_ARRIVED)
-#define ALL_ARRIVED        (NS_ARRIVED | EW_ARRIVED)
+// a border point travels with the key of its core, the parity of the
+// iteration it belongs to, the border it comes from and its position along
+// that border, so the key of a core must leave the lowest KEY_PARITY_SHIFT + 1
+// bits free. Routes that give each border its own key range send it to one
+// neighbour only
+#define KEY_EDGE_SHIFT     8
+#define KEY_PARITY_SHIFT   10
+#define KEY_INDEX_MASK     ((1 << KEY_EDGE_SHIFT) - 1)
+#define KEY_POINT_MASK     ((2 << KEY_PARITY_SHIFT) - 1)
+
+#define EDGE_POINTS_MAX    ((TILE_ROWS > TILE_COLUMNS) ? TILE_ROWS : TILE_COLUMNS)
+
+// the last two positions of every border carry the residual of the even
+// and the odd convergence periods
+#define RESIDUAL_INDEX(p)  (KEY_INDEX_MASK - (p))
+
+// ticks the temperatures are still reported after convergence, so that the
+// lead core of every board sends them once more
+#define REPORT_TICKS       64
+
+#if EDGE_POINTS_MAX > RESIDUAL_INDEX(1)
+#error "a border of the tile has more points than its keys"
+#endif
+
+#if TILE_COLUMNS % 4
+#error "the update of a row is unrolled four times, TILE_COLUMNS must be a multiple of 4"
+#endif
 
 // ------------------------------------------------------------------------
 // variables
@@ -97,28 +130,58 @@ uint is_easternmost;
 uint is_westernmost;
 
 /* temperature values */
-int my_temp = 0;  // any initial value will do!
-int old_temp = 0;  // any initial value will do!
-
-// get temperatures from 4 neighbours
-// make sure to have room for two values from each neighbour
+int my_temp = 0;  // the mean of the tile, what the host sees
+
+// the tile, twice - one holds the temperatures of this iteration, the next
+// iteration is computed into the other. Row 1 is the southern, column 1 the
+// western border, the rows and columns around them are the halo that holds
+// the borders of the neighbours
+int tile[2][TILE_ROWS + 2][TILE_COLUMNS + 2];
+uint current_tile = 0;
+
+// points on each border of the tile
+const uint edge_points[4] = {
+    [NORTH] = TILE_COLUMNS, [SOUTH] = TILE_COLUMNS,
+    [EAST]  = TILE_ROWS,    [WEST]  = TILE_ROWS
+};
+
+// get the borders of 4 neighbours
+// make sure to have room for two borders from each neighbour
 // given that the communication is asynchronous
-volatile int neighbours_temp[2][4];
+volatile int neighbours_temp[2][4][EDGE_POINTS_MAX];
 
 /* coefficients to compute new temperature value */
 /* adjust for 16.16 fixed-point representation  */
 int cx_adj = (int) (PARAM_CX * (1 << 16));
 int cy_adj = (int) (PARAM_CY * (1 << 16));
 
-/* keep track of which neighbours have sent data */
+/* convergence: the largest change of a point in the last checked
+   iteration, of this core and of all the cores whose residual reached it */
+uint converge_threshold;  // 16.16, 0 - never stop
+uint converge_period;     // iterations - more than the cores across the grid
+volatile uint residual[2];
+volatile uint iteration = 0;
+volatile uint converged = FALSE;
+uint report_ticks = REPORT_TICKS;
+
+/* keep track of how many points of each neighbour's border have arrived */
 /* cores in the border need special values! */
-volatile uint arrived[2];
-uint init_arrived;
+volatile uint arrived[2][4];
+uint init_arrived[4];
 volatile uint now = 0;
 volatile uint next = 1;
 
 volatile uchar updating = TRUE;
 
+#ifdef EVENT_DRIVEN
+/* an iteration - or at first the borders of the start - is waiting for
+   its turn: the neighbours' borders may be complete before this core's
+   first ones are sent */
+volatile uint scheduled = TRUE;
+
+void schedule_iteration();
+#endif
+
 sdp_msg_t my_msg;
 
 /* report results in shared memory */
@@ -131,6 +194,27 @@ uint dbg_timeouts = 0;
 uint * dbg_stime;
 #endif
 
+/****f* heat_demo.c/set_border
+ *
+ * SUMMARY
+ *  This function is used to hold a border of the whole grid at a fixed
+ *  temperature: the halo on that side never waits for a neighbour
+ *
+ * SYNOPSIS
+ *  void set_border (uint edge, int temp)
+ *
+ * SOURCE
+ */
+void set_border(uint edge, int temp) {
+    for (uint i = 0; i < edge_points[edge]; i++) {
+        neighbours_temp[now][edge][i]  = temp;
+        neighbours_temp[next][edge][i] = temp;
+    }
+    init_arrived[edge] = edge_points[edge];
+}
+/*
+ *******/
+
 void data_init() {
 
     // Get the address this core's DTCM data starts at from SRAM
@@ -160,39 +244,40 @@ void data_init() {
     temp_south_key = data[13];
     temp_east_key = data[14];
     temp_west_key = data[15];
+    converge_threshold = data[16];
+    converge_period = data[17];
+    if (converge_period == 0) {
+        converge_threshold = 0;
+    }
 
     io_printf(IO_BUF,
         "my_key = 0x%08x, north_key = 0x%08x, south_key = 0x%08x,"
         " east_key = 0x%08x, west_key = 0x%08x\n",
         my_key, north_key, south_key, east_key, west_key);
 
-    init_arrived = NONE_ARRIVED;
+    for (uint edge = 0; edge < 4; edge++) {
+        init_arrived[edge] = 0;
+    }
     if (is_northernmost) {
         io_printf(IO_BUF, "North\n");
-        neighbours_temp[now][NORTH]  = NORTH_INIT;
-        neighbours_temp[next][NORTH] = NORTH_INIT;
-        init_arrived |= NORTH_ARRIVED;
+        set_border(NORTH, NORTH_INIT);
     }
     if (is_southernmost) {
         io_printf(IO_BUF, "South\n");
-        neighbours_temp[now][SOUTH]  = SOUTH_INIT;
-        neighbours_temp[next][SOUTH] = SOUTH_INIT;
-        init_arrived |= SOUTH_ARRIVED;
+        set_border(SOUTH, SOUTH_INIT);
     }
     if (is_easternmost) {
         io_printf(IO_BUF, "East\n");
-        neighbours_temp[now][EAST]  = EAST_INIT;
-        neighbours_temp[next][EAST] = EAST_INIT;
-        init_arrived |= EAST_ARRIVED;
+        set_border(EAST, EAST_INIT);
     }
     if (is_westernmost) {
         io_printf(IO_BUF, "West\n");
-        neighbours_temp[now][WEST]  = WEST_INIT;
-        neighbours_temp[next][WEST] = WEST_INIT;
-        init_arrived |= WEST_ARRIVED;
+        set_border(WEST, WEST_INIT);
+    }
+    for (uint edge = 0; edge < 4; edge++) {
+        arrived[now][edge] = init_arrived[edge];
+        arrived[next][edge] = init_arrived[edge];
     }
-    arrived[now] = init_arrived;
-    arrived[next] = init_arrived;
 }
 
 /****f* heat_demo.c/send_temps_to_host
@@ -288,6 +373,69 @@ void report_results() {
 //  /* skew io_printfs to avoid overloading tubotron */
 //  spin1_delay_us (200 * ((chipID << 5) + coreID));
     io_printf(IO_BUF, "T = %7.3f\n", my_temp);
+    if (converged) {
+        io_printf(IO_BUF, "converged after %u iterations\n", iteration);
+    }
+}
+/*
+ *******/
+
+/****f* heat_demo.c/receive_residual
+ *
+ * SUMMARY
+ *  This function is used to merge the residual of a neighbour into this
+ *  core's - after a period every core holds the largest of the machine
+ *
+ * SYNOPSIS
+ *  void receive_residual (uint parity, uint payload)
+ *
+ * SOURCE
+ */
+void receive_residual(uint parity, uint payload) {
+    if (payload > residual[parity]) {
+        residual[parity] = payload;
+    }
+}
+/*
+ *******/
+
+/****f* heat_demo.c/receive_point
+ *
+ * SUMMARY
+ *  This function is used to store a point of a neighbour's border.
+ *  Event driven, the parity of its key tells the iteration it belongs to:
+ *  a neighbour is never more than one iteration ahead, as it needs this
+ *  core's border to get there. Otherwise the points belong to the next
+ *  iteration once the whole border of this one has arrived
+ *
+ * SYNOPSIS
+ *  void receive_point (uint edge, uint index, uint parity, uint payload)
+ *
+ * SOURCE
+ */
+void receive_point(uint edge, uint index, uint parity, uint payload) {
+    if (index >= RESIDUAL_INDEX(1)) {
+        receive_residual(KEY_INDEX_MASK - index, payload);
+        return;
+    }
+    if (index >= edge_points[edge]) {
+        return;
+    }
+
+#ifdef EVENT_DRIVEN
+    neighbours_temp[parity][edge][index] = payload;
+    if (++arrived[parity][edge] == edge_points[edge]) {
+        schedule_iteration();
+    }
+#else
+    if (arrived[now][edge] < edge_points[edge]) {
+        neighbours_temp[now][edge][index] = payload;
+        arrived[now][edge]++;
+    } else {
+        neighbours_temp[next][edge][index] = payload;
+        arrived[next][edge]++;
+    }
+#endif
 }
 /*
  *******/
@@ -296,7 +444,7 @@ void report_results() {
  *
  * SUMMARY
  *  This function is used as a callback for packet received events.
- * receives data from 4 (NSEW) neighbours and updates the checklist
+ * receives the borders of 4 (NSEW) neighbours and updates the checklist
  *
  * SYNOPSIS
  *  void receive_data (uint key, uint payload)
@@ -317,57 +465,35 @@ void receive_data(uint key, uint payload) {
     }
 #endif
 
-    if (key == north_key) {
-        if (arrived[now] & NORTH_ARRIVED) {
-            neighbours_temp[next][NORTH] = payload;
-            arrived[next] |= NORTH_ARRIVED;
-        } else {
-            neighbours_temp[now][NORTH] = payload;
-            arrived[now] |= NORTH_ARRIVED;
-        }
-    } else if (key == south_key) {
-        if (arrived[now] & SOUTH_ARRIVED) {
-            neighbours_temp[next][SOUTH] = payload;
-            arrived[next] |= SOUTH_ARRIVED;
-        } else {
-            neighbours_temp[now][SOUTH] = payload;
-            arrived[now] |= SOUTH_ARRIVED;
-        }
-    } else if (key == east_key) {
-        if (arrived[now] & EAST_ARRIVED) {
-            neighbours_temp[next][EAST] = payload;
-            arrived[next] |= EAST_ARRIVED;
-        } else {
-            neighbours_temp[now][EAST] = payload;
-            arrived[now] |= EAST_ARRIVED;
-        }
-    } else if (key == west_key) {
-        if (arrived[now] & WEST_ARRIVED) {
-            neighbours_temp[next][WEST] = payload;
-            arrived[next] |= WEST_ARRIVED;
-        } else {
-            neighbours_temp[now][WEST] = payload;
-            arrived[now] |= WEST_ARRIVED;
-        }
+    // a border of a neighbour - the one that faces this core
+    uint source = key & ~KEY_POINT_MASK;
+    uint edge = (key >> KEY_EDGE_SHIFT) & 3;
+    uint index = key & KEY_INDEX_MASK;
+    uint parity = (key >> KEY_PARITY_SHIFT) & 1;
+
+    if (source == north_key && edge == SOUTH) {
+        receive_point(NORTH, index, parity, payload);
+    } else if (source == south_key && edge == NORTH) {
+        receive_point(SOUTH, index, parity, payload);
+    } else if (source == east_key && edge == WEST) {
+        receive_point(EAST, index, parity, payload);
+    } else if (source == west_key && edge == EAST) {
+        receive_point(WEST, index, parity, payload);
     } else if (key == temp_north_key) {
         if (is_northernmost) {
-            neighbours_temp[now][NORTH] = payload;
-            neighbours_temp[next][NORTH] = payload;
+            set_border(NORTH, payload);
         }
     } else if (key == temp_east_key) {
         if (is_easternmost) {
-            neighbours_temp[now][EAST] = payload;
-            neighbours_temp[next][EAST] = payload;
+            set_border(EAST, payload);
         }
     } else if (key == temp_south_key) {
         if (is_southernmost) {
-            neighbours_temp[now][SOUTH] = payload;
-            neighbours_temp[next][SOUTH] = payload;
+            set_border(SOUTH, payload);
         }
     } else if (key == temp_west_key) {
         if (is_westernmost) {
-            neighbours_temp[now][WEST] = payload;
-            neighbours_temp[next][WEST] = payload;
+            set_border(WEST, payload);
         }
     } else if (key == stop_key) {
         spin1_exit(0);
@@ -375,6 +501,9 @@ void receive_data(uint key, uint payload) {
         updating = FALSE;
     } else if (key == resume_key) {
         updating = TRUE;
+#ifdef EVENT_DRIVEN
+        schedule_iteration();
+#endif
     } else {
         // unexpected packet!
 #ifdef DEBUG
@@ -385,6 +514,111 @@ void receive_data(uint key, uint payload) {
 /*
  *******/
 
+/****f* heat_demo.c/send_borders
+ *
+ * SUMMARY
+ *  This function is used to send the borders of the tile to the neighbours,
+ *  one packet for every point
+ *
+ * SYNOPSIS
+ *  void send_borders (int grid[][TILE_COLUMNS + 2])
+ *
+ * SOURCE
+ */
+void send_borders(int grid[][TILE_COLUMNS + 2]) {
+    uint key = my_key | ((iteration & 1) << KEY_PARITY_SHIFT);
+    uint north = key | (NORTH << KEY_EDGE_SHIFT);
+    uint south = key | (SOUTH << KEY_EDGE_SHIFT);
+    uint east = key | (EAST << KEY_EDGE_SHIFT);
+    uint west = key | (WEST << KEY_EDGE_SHIFT);
+
+    // a full queue of outgoing packets only has to drain
+    for (uint i = 0; i < TILE_COLUMNS; i++) {
+        while (!spin1_send_mc_packet(north | i, grid[TILE_ROWS][i + 1],
+                WITH_PAYLOAD)) {
+            spin1_delay_us(1);
+        }
+        while (!spin1_send_mc_packet(south | i, grid[1][i + 1],
+                WITH_PAYLOAD)) {
+            spin1_delay_us(1);
+        }
+    }
+    for (uint i = 0; i < TILE_ROWS; i++) {
+        while (!spin1_send_mc_packet(east | i, grid[i + 1][TILE_COLUMNS],
+                WITH_PAYLOAD)) {
+            spin1_delay_us(1);
+        }
+        while (!spin1_send_mc_packet(west | i, grid[i + 1][1],
+                WITH_PAYLOAD)) {
+            spin1_delay_us(1);
+        }
+    }
+}
+/*
+ *******/
+
+/****f* heat_demo.c/send_residual
+ *
+ * SUMMARY
+ *  This function is used to pass the residual of the current period on
+ *  to the neighbours, along with the borders of every iteration
+ *
+ * SYNOPSIS
+ *  void send_residual ()
+ *
+ * SOURCE
+ */
+void send_residual() {
+    uint parity = (iteration / converge_period) & 1;
+    uint value = residual[parity];
+
+    for (uint edge = 0; edge < 4; edge++) {
+        uint key = my_key | (edge << KEY_EDGE_SHIFT) | RESIDUAL_INDEX(parity);
+        while (!spin1_send_mc_packet(key, value, WITH_PAYLOAD)) {
+            spin1_delay_us(1);
+        }
+    }
+}
+/*
+ *******/
+
+/****f* heat_demo.c/check_convergence
+ *
+ * SUMMARY
+ *  This function is used at the first iteration of every period. The
+ *  residual of the period before last has now reached every core, so all
+ *  of them take the same decision in the same iteration. The residual of
+ *  this iteration starts the next round.
+ *  Only the change of this one iteration of the period is sampled: a later
+ *  one would not reach every core before the next check. The stencil is an
+ *  average with positive weights, so with fixed borders the largest change
+ *  of the grid does not grow from one iteration to the next (up to the
+ *  rounding of 16.16) and the first iteration of a period holds its largest
+ *  change. A new border temperature is caught by the next period instead
+ *
+ * SYNOPSIS
+ *  uint check_convergence (uint change)
+ *
+ * INPUTS
+ *   uint change: largest change of a point of this tile in this iteration
+ *
+ * SOURCE
+ */
+uint check_convergence(uint change) {
+    uint period = iteration / converge_period;
+    uint parity = period & 1;
+
+    if (period >= 2 && residual[1 - parity] < converge_threshold) {
+        return TRUE;
+    }
+
+    residual[1 - parity] = 0;
+    receive_residual(parity, change);
+    return FALSE;
+}
+/*
+ *******/
+
 /****f* heat_demo.c/send_first_value
  *
  * SUMMARY
@@ -396,75 +630,269 @@ void receive_data(uint key, uint payload) {
  */
 void send_first_value(uint a, uint b) {
     /* send data to neighbours */
-    spin1_send_mc_packet(my_key, my_temp, WITH_PAYLOAD);
+    send_borders(tile[current_tile]);
+
+#ifdef EVENT_DRIVEN
+    // the first iteration may already have all it needs
+    scheduled = FALSE;
+    schedule_iteration();
+#endif
 }
 /*
  *******/
 
-/****f* heat_demo.c/update
+/****f* heat_demo.c/load_halo
  *
  * SUMMARY
+ *  This function is used to copy the borders of the neighbours into the
+ *  halo around the tile. If a core does not receive a whole border it uses
+ *  its own border as an estimate for the neighbour's
  *
  * SYNOPSIS
- *  void update (uint ticks, uint b)
+ *  void load_halo (int grid[][TILE_COLUMNS + 2])
  *
  * SOURCE
  */
-void update(uint ticks, uint b) {
-    sark.vcpu->user0++;
+void load_halo(int grid[][TILE_COLUMNS + 2]) {
+    volatile int (*border)[EDGE_POINTS_MAX] = neighbours_temp[now];
+
+    for (uint i = 0; i < TILE_COLUMNS; i++) {
+        grid[TILE_ROWS + 1][i + 1] =
+            (arrived[now][NORTH] == TILE_COLUMNS) ?
+                border[NORTH][i] : grid[TILE_ROWS][i + 1];
+        grid[0][i + 1] =
+            (arrived[now][SOUTH] == TILE_COLUMNS) ?
+                border[SOUTH][i] : grid[1][i + 1];
+    }
+    for (uint i = 0; i < TILE_ROWS; i++) {
+        grid[i + 1][TILE_COLUMNS + 1] =
+            (arrived[now][EAST] == TILE_ROWS) ?
+                border[EAST][i] : grid[i + 1][TILE_COLUMNS];
+        grid[i + 1][0] =
+            (arrived[now][WEST] == TILE_ROWS) ?
+                border[WEST][i] : grid[i + 1][1];
+    }
+}
+/*
+ *******/
 
-    if (updating) {
-        /* report if not all neighbours' data arrived */
+// new temperature of one point, in 16.16 fixed-point representation
+#ifdef POSITIVE_TEMP
+// avoids a problem with negative temperatures in the visualiser!
+#define CLAMP_TEMP(t)      (((t) > 0) ? (t) : 0)
+#else
+#define CLAMP_TEMP(t)      (t)
+#endif
+
+#define STENCIL(c) {                                                      \
+    int t = row[c];                                                       \
+    int tmp1 = row[(c) + 1] + row[(c) - 1] - 2 * t;                       \
+    int tmp2 = above[c] + below[c] - 2 * t;                               \
+    t += (int) (((long long) cx_adj * (long long) tmp1) >> 16)            \
+        + (int) (((long long) cy_adj * (long long) tmp2) >> 16);          \
+    t = CLAMP_TEMP(t);                                                    \
+    uint delta = (t > row[c]) ? t - row[c] : row[c] - t;                  \
+    change = (delta > change) ? delta : change;                           \
+    result[c] = t;                                                        \
+    sum += t;                                                             \
+}
+
+/****f* heat_demo.c/update_tile
+ *
+ * SUMMARY
+ *  This function is used to compute the next iteration of the tile,
+ *  four points of a row at a time. Returns the mean temperature and
+ *  leaves the largest change of a point in residual_out
+ *
+ * SYNOPSIS
+ *  int update_tile (int in[][TILE_COLUMNS + 2], int out[][TILE_COLUMNS + 2],
+ *                   uint *residual_out)
+ *
+ * SOURCE
+ */
+int update_tile(int in[][TILE_COLUMNS + 2], int out[][TILE_COLUMNS + 2],
+        uint *residual_out) {
+    long long sum = 0;
+    uint change = 0;
+
+    for (uint r = 1; r <= TILE_ROWS; r++) {
+        const int *above = in[r + 1];
+        const int *row = in[r];
+        const int *below = in[r - 1];
+        int *result = out[r];
+
+        for (uint c = 1; c <= TILE_COLUMNS; c += 4) {
+            STENCIL(c);
+            STENCIL(c + 1);
+            STENCIL(c + 2);
+            STENCIL(c + 3);
+        }
+    }
+
+    *residual_out = change;
+    return (int) (sum / (TILE_ROWS * TILE_COLUMNS));
+}
+/*
+ *******/
+
+/****f* heat_demo.c/next_borders
+ *
+ * SUMMARY
+ *  This function is used to hand the border buffers on to the next
+ *  iteration once the current borders have been used
+ *
+ * SYNOPSIS
+ *  void next_borders ()
+ *
+ * SOURCE
+ */
+void next_borders() {
+    for (uint edge = 0; edge < 4; edge++) {
+        arrived[now][edge] = init_arrived[edge];
+    }
+    now = 1 - now;
+    next = 1 - next;
+}
+/*
+ *******/
+
+/****f* heat_demo.c/iterate
+ *
+ * SUMMARY
+ *  This function is used to compute the next iteration of the tile and
+ *  send its borders to the neighbours
+ *
+ * SYNOPSIS
+ *  void iterate ()
+ *
+ * SOURCE
+ */
+void iterate() {
+    /* report if not all neighbours' data arrived */
 #ifdef DEBUG
-        if (arrived[now] != ALL_ARRIVED) {
+    for (uint edge = 0; edge < 4; edge++) {
+        if (arrived[now][edge] != edge_points[edge]) {
             io_printf (IO_STD, "@\n");
             dbg_timeouts++;
+            break;
         }
+    }
 #endif
 
-        // if a core does not receive temperature from a neighbour
-        // it uses it's own as an estimate for the nieghbour's.
-        if (arrived[now] != ALL_ARRIVED) {
-            if (!(arrived[now] & NORTH_ARRIVED)) {
-                neighbours_temp[now][NORTH] = my_temp;
-            }
+    load_halo(tile[current_tile]);
 
-            if (!(arrived[now] & SOUTH_ARRIVED)) {
-                neighbours_temp[now][SOUTH] = my_temp;
-            }
+#ifdef EVENT_DRIVEN
+    /* the borders are in the halo now, their buffer takes the iteration
+       after next - which needs the borders this one sends, so it has to
+       be free before they go out */
+    next_borders();
+#endif
 
-            if (!(arrived[now] & EAST_ARRIVED)) {
-                neighbours_temp[now][EAST] = my_temp;
-            }
+    /* compute new temperatures */
+    uint change;
+    my_temp = update_tile(tile[current_tile], tile[1 - current_tile],
+            &change);
+    current_tile = 1 - current_tile;
+    iteration++;
+
+    /* stop once the whole grid has settled */
+    if (converge_threshold && (iteration % converge_period) == 0
+            && check_convergence(change)) {
+        converged = TRUE;
+        return;
+    }
 
-            if (!(arrived[now] & WEST_ARRIVED)) {
-                neighbours_temp[now][WEST] = my_temp;
-            }
-        }
+    /* send new borders to neighbours */
+    send_borders(tile[current_tile]);
+    if (converge_threshold) {
+        send_residual();
+    }
 
-        /* compute new temperature */
-        /* adjust for 16.16 fixed-point representation  */
-        int tmp1 = neighbours_temp[now][EAST] + neighbours_temp[now][WEST]
-                - 2 * my_temp;
-        int tmp2 = neighbours_temp[now][NORTH] + neighbours_temp[now][SOUTH]
-                - 2 * my_temp;
-        /* adjust for 16.16 fixed-point representation  */
-        int tmp3 = (int) (((long long) cx_adj * (long long) tmp1) >> 16);
-        int tmp4 = (int) (((long long) cy_adj * (long long) tmp2) >> 16);
-        my_temp = my_temp + tmp3 + tmp4;
+#ifndef EVENT_DRIVEN
+    /* prepare for next iteration */
+    next_borders();
+#endif
+}
+/*
+ *******/
 
-#ifdef POSITIVE_TEMP
-        // avoids a problem with negative temperatures in the visualiser!
-        my_temp = (my_temp > 0) ? my_temp : 0;
+#ifdef EVENT_DRIVEN
+/****f* heat_demo.c/iterate_event
+ *
+ * SUMMARY
+ *  This function is used as the callback of an event driven iteration.
+ *  The borders of the next one may already be complete
+ *
+ * SYNOPSIS
+ *  void iterate_event (uint a, uint b)
+ *
+ * SOURCE
+ */
+void iterate_event(uint a, uint b) {
+    iterate();
+
+    scheduled = FALSE;
+    schedule_iteration();
+}
+/*
+ *******/
+
+/****f* heat_demo.c/schedule_iteration
+ *
+ * SUMMARY
+ *  This function is used to start the next iteration once the borders of
+ *  all neighbours for it have arrived - packets keep arriving while it runs
+ *
+ * SYNOPSIS
+ *  void schedule_iteration ()
+ *
+ * SOURCE
+ */
+void schedule_iteration() {
+    uint cpsr = spin1_int_disable();
+
+    uint ready = updating && !converged && !scheduled;
+    for (uint edge = 0; ready && edge < 4; edge++) {
+        ready = (arrived[now][edge] == edge_points[edge]);
+    }
+    if (ready) {
+        scheduled = TRUE;
+        spin1_schedule_callback(iterate_event, 0, 0, ITERATE_PRIORITY);
+    }
+
+    spin1_mode_restore(cpsr);
+}
+/*
+ *******/
 #endif
 
-        /* send new data to neighbours */
-        spin1_send_mc_packet(my_key, my_temp, WITH_PAYLOAD);
+/****f* heat_demo.c/update
+ *
+ * SUMMARY
+ *  Every timer tick: an iteration, or event driven only the report of
+ *  the temperature
+ *
+ * SYNOPSIS
+ *  void update (uint ticks, uint b)
+ *
+ * SOURCE
+ */
+void update(uint ticks, uint b) {
+    sark.vcpu->user0++;
+
+    // converged: the final temperatures stay reported for a while
+    if (converged) {
+        report_temp(ticks);
+        if (--report_ticks == 0) {
+            spin1_exit(0);
+        }
+        return;
+    }
 
-        /* prepare for next iteration */
-        arrived[now] = init_arrived;
-        now = 1 - now;
-        next = 1 - next;
+    if (updating) {
+#ifndef EVENT_DRIVEN
+        iterate();
+#endif
 
         /* report current temp */
         report_temp(ticks);
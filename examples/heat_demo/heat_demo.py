@@ -23,14 +23,41 @@ from heat_demo_vertex import HeatDemoVertex
 from heat_demo_edge import HeatDemoEdge
 
 # Python system imports
-from collections import defaultdict
+from collections import defaultdict, deque
 import sys
 from threading import Condition
 
+def grid_diameter(vertices):
+    """ The most neighbour to neighbour hops between two elements of the\
+        grid, which may have holes where cores are missing
+
+    :param vertices: the elements, indexed [x][y], None where missing
+    """
+    present = set(
+        (x, y) for x, column in enumerate(vertices)
+        for y, vertex in enumerate(column) if vertex is not None)
+    diameter = 0
+    for start in present:
+        hops = {start: 0}
+        queue = deque([start])
+        while queue:
+            x, y = queue.popleft()
+            for neighbour in ((x, y + 1), (x + 1, y), (x, y - 1), (x - 1, y)):
+                if neighbour in present and neighbour not in hops:
+                    hops[neighbour] = hops[x, y] + 1
+                    queue.append(neighbour)
+        diameter = max(diameter, max(hops.values()))
+    return diameter
+
+
 # Script borken Suspected reinjector problem
 def run_broken():
     machine_time_step = 1000
     time_scale_factor = 1
+    # stop once no point changes by more than this in an iteration, checked
+    # every converge_period iterations
+    converge_threshold = 0.001
+    converge_period = 256
     # machine_port = 11111
     machine_receive_port = 22222
     machine_host = "0.0.0.0"
@@ -103,7 +130,9 @@ def run_broken():
                         HeatDemoVertex,
                         {
                             'machine_time_step': machine_time_step,
-                            'time_scale_factor': time_scale_factor
+                            'time_scale_factor': time_scale_factor,
+                            'converge_threshold': converge_threshold,
+                            'converge_period': converge_period
                         },
                         label="Heat Element {}, {}".format(
                             x, y))
@@ -126,6 +155,9 @@ def run_broken():
                         semantic_label="TRANSMISSION")
                     receive_labels.append(vertices[x][y].label)
 
+    HeatDemoVertex.check_converge_period(
+        converge_period, grid_diameter(vertices))
+
     # build edges
     for x in range(0, max_x_element_id):
         for y in range(0, max_y_element_id):
@@ -146,7 +178,7 @@ def run_broken():
                         semantic_label="TRANSMISSION")
 
                 # Add an east link if not at the right
-                if x+1 < max_y_element_id and vertices[x+1][y] is not None:
+                if x+1 < max_x_element_id and vertices[x+1][y] is not None:
                     front_end.add_machine_edge(
                         HeatDemoEdge,
                         {
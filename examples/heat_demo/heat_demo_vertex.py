@@ -2,6 +2,8 @@
 from data_specification.enums import DataType
 
 # pacman imports
+from pacman.model.constraints.key_allocator_constraints \
+    import FixedMaskConstraint
 from pacman.model.decorators import overrides
 from pacman.model.graphs.machine import MachineVertex
 from pacman.model.resources import CPUCyclesPerTickResource, DTCMResource
@@ -12,13 +14,13 @@ from heat_demo_edge import HeatDemoEdge
 
 # FEC imports
 from spinn_front_end_common.utilities import globals_variables
-from spinn_front_end_common.interface.simulation import simulation_utilities
-from spinn_front_end_common.utility_models import LivePacketGather
 from spinn_front_end_common.utility_models import ReverseIpTagMultiCastSource
-from spinn_front_end_common.utilities import constants, exceptions
+from spinn_front_end_common.utilities import exceptions
 from spinn_front_end_common.abstract_models.impl \
     import MachineDataSpecableVertex
 from spinn_front_end_common.abstract_models import AbstractHasAssociatedBinary
+from spinn_front_end_common.abstract_models import \
+    AbstractProvidesOutgoingPartitionConstraints
 from spinn_front_end_common.utilities.utility_objs import ExecutableStartType
 
 # general imports
@@ -29,48 +31,97 @@ logger = logging.getLogger(__name__)
 
 
 class HeatDemoVertex(
-        MachineVertex, MachineDataSpecableVertex, AbstractHasAssociatedBinary):
-    """ A vertex partition for a heat demo; represents a heat element.
+        MachineVertex, MachineDataSpecableVertex, AbstractHasAssociatedBinary,
+        AbstractProvidesOutgoingPartitionConstraints):
+    """ A vertex partition for a heat demo; represents a tile of heat\
+        elements.
     """
 
     CORE_APP_IDENTIFIER = 0xABCD
 
-    # Regions for populations
+    # heat_demo.c reads a single region: its own key, the keys of the
+    # neighbours in NORTH, SOUTH, EAST, WEST order, whether it lies on the
+    # northern, southern, eastern and western border of the grid, the keys of
+    # STOP, PAUSE and RESUME, the keys of the new border temperatures in
+    # NORTH, SOUTH, EAST, WEST order, the convergence threshold and period
     DATA_REGIONS = Enum(
         value="DATA_REGIONS",
-        names=[('SYSTEM', 0),
-               ('TRANSMISSIONS', 1),
-               ('NEIGHBOUR_KEYS', 2),
-               ('COMMAND_KEYS', 3),
-               ('TEMP_VALUE', 4)])
-
-    # one key for each incoming edge.
-    NEIGHBOUR_DATA_SIZE = 10 * 4
-    TRANSMISSION_DATA_SIZE = 2 * 4
-    COMMAND_KEYS_SIZE = 3 * 4
-    TEMP_VALUE_SIZE = 1 * 4
+        names=[('DATA', 0)])
+    DATA_SIZE = 18 * 4
+
+    # a key of heat_demo.c carries the point of a border (bits 0-7), the
+    # border (bits 8-9) and the parity of the iteration (bit 10) - must
+    # match KEY_EDGE_SHIFT and KEY_PARITY_SHIFT there
+    KEY_MASK = 0xFFFFF800
+
+    # the tile of every core - must match TILE_ROWS and TILE_COLUMNS in
+    # heat_demo.c
+    TILE_ROWS = 16
+    TILE_COLUMNS = 16
+
+    # must match EVENT_DRIVEN in heat_demo.c. Event driven, the residual of a
+    # neighbour can miss the iteration it arrives in, so it takes up to two
+    # iterations per core it crosses
+    EVENT_DRIVEN = False
+
+    # two tiles with their halo, two borders from every neighbour and the
+    # stack and globals of heat_demo.c
+    DTCM_REQUIRED = \
+        2 * (TILE_ROWS + 2) * (TILE_COLUMNS + 2) * 4 + \
+        2 * 4 * max(TILE_ROWS, TILE_COLUMNS) * 4 + 4 * 1024
 
     _model_based_max_atoms_per_core = 1
     _model_n_atoms = 1
 
     def __init__(self, label, machine_time_step, time_scale_factor,
-                 heat_temperature=0, constraints=None):
+                 converge_threshold=0.0, converge_period=0, constraints=None):
+        """
+
+        :param converge_threshold: the run stops once no point of the grid\
+                changes by more than this in an iteration, 0 never stops it
+        :param converge_period: iterations between two convergence checks,\
+                more than the grid diameter (see check_converge_period)
+        """
 
         config = globals_variables.get_simulator().config
         # resources used by a heat element vertex
         sdram = SDRAMResource(
-            23 + config.getint("Buffers", "minimum_buffer_sdram"))
+            self.DATA_SIZE + config.getint("Buffers", "minimum_buffer_sdram"))
         self._resources = \
             ResourceContainer(cpu_cycles=CPUCyclesPerTickResource(45),
-                              dtcm=DTCMResource(34), sdram=sdram)
+                              dtcm=DTCMResource(self.DTCM_REQUIRED),
+                              sdram=sdram)
 
         MachineVertex.__init__(self, label=label, constraints=constraints)
 
-        # app specific data items
-        self._heat_temperature = heat_temperature
+        if converge_threshold and converge_period <= 0:
+            raise exceptions.ConfigurationException(
+                "a convergence threshold needs a period of at least one "
+                "iteration")
+
+        # app specific data items, the threshold in 16.16 fixed point
+        self._converge_threshold = int(round(converge_threshold * (1 << 16)))
+        self._converge_period = converge_period
         self._time_between_requests = config.getint(
             "Buffers", "time_between_requests")
 
+    @classmethod
+    def check_converge_period(cls, converge_period, diameter):
+        """ The largest residual of the grid has to reach every core before\
+            the check at the end of a period, or the cores do not all stop\
+            in the same iteration
+
+        :param converge_period: iterations between two convergence checks
+        :param diameter: the most cores a residual crosses, from any core to\
+                any other
+        """
+        hops = 2 * diameter if cls.EVENT_DRIVEN else diameter
+        if converge_period <= hops:
+            raise exceptions.ConfigurationException(
+                "a convergence period of {} iterations does not reach across "
+                "a grid of diameter {} - it needs more than {}".format(
+                    converge_period, diameter, hops))
+
     @property
     @overrides(MachineVertex.resources_required)
     def resources_required(self):
@@ -82,7 +133,13 @@ class HeatDemoVertex(
 
     @overrides(AbstractHasAssociatedBinary.get_binary_start_type)
     def get_binary_start_type(self):
-        return ExecutableStartType.USES_SIMULATION_INTERFACE
+        # heat_demo.c runs until it is stopped or has converged
+        return ExecutableStartType.SYNC
+
+    @overrides(AbstractProvidesOutgoingPartitionConstraints.
+               get_outgoing_partition_constraints)
+    def get_outgoing_partition_constraints(self, partition):
+        return [FixedMaskConstraint(self.KEY_MASK)]
 
     @overrides(MachineDataSpecableVertex.generate_machine_data_specification)
     def generate_machine_data_specification(
@@ -99,90 +156,20 @@ class HeatDemoVertex(
         :param spec: the writer interface
         """
 
-        # Setup words + 1 for flags + 1 for recording size
-        setup_size = constants.SYSTEM_BYTES_REQUIREMENT
-
-        spec.comment("\n*** Spec for SpikeSourceArray Instance ***\n\n")
-
-        # ###################################################################
-        # Reserve SDRAM space for memory areas:
+        spec.comment("\n*** Spec for HeatDemoVertex Instance ***\n\n")
 
-        spec.comment("\nReserving memory space for spike data region:\n\n")
-
-        # Create the data regions for the spike source array:
-        self._reserve_memory_regions(spec, setup_size)
-
-        # handle simulation.c items
-        spec.switch_write_focus(self.DATA_REGIONS.SYSTEM.value)
-        spec.write_array(simulation_utilities.get_simulation_header_array(
-            self.get_binary_file_name(), machine_time_step,
-            time_scale_factor))
+        spec.reserve_memory_region(
+            region=self.DATA_REGIONS.DATA.value,
+            size=self.DATA_SIZE, label="data")
+        spec.switch_write_focus(region=self.DATA_REGIONS.DATA.value)
 
-        # application specific data items
-        self._write_transmission_keys(spec, routing_info, machine_graph)
         self._write_key_data(spec, routing_info, machine_graph)
-        self._write_temp_data(spec)
+        spec.write_value(data=self._converge_threshold)
+        spec.write_value(data=self._converge_period)
 
         # End-of-Spec:
         spec.end_specification()
 
-    def _write_temp_data(self, spec):
-        spec.switch_write_focus(region=self.DATA_REGIONS.TEMP_VALUE.value)
-        spec.comment("writing initial temp for this heat element \n")
-        spec.write_value(data=self._heat_temperature)
-
-    def _reserve_memory_regions(self, spec, system_size):
-        """
-
-        :param spec:
-        :param system_size:
-        """
-        spec.reserve_memory_region(
-            region=self.DATA_REGIONS.SYSTEM.value,
-            size=system_size, label='systemInfo')
-        spec.reserve_memory_region(
-            region=self.DATA_REGIONS.TRANSMISSIONS.value,
-            size=self.TRANSMISSION_DATA_SIZE, label="inputs")
-        spec.reserve_memory_region(
-            region=self.DATA_REGIONS.NEIGHBOUR_KEYS.value,
-            size=self.NEIGHBOUR_DATA_SIZE, label="inputs")
-        spec.reserve_memory_region(
-            region=self.DATA_REGIONS.COMMAND_KEYS.value,
-            size=self.COMMAND_KEYS_SIZE, label="commands")
-        spec.reserve_memory_region(
-            region=self.DATA_REGIONS.TEMP_VALUE.value,
-            size=self.TEMP_VALUE_SIZE, label="temp")
-
-    def _write_transmission_keys(self, spec, routing_info, graph):
-        """
-
-        :param spec:
-        :param routing_info:
-        :param graph:
-        :rtype: None
-        """
-
-        # Every edge should have the same key
-        partitions = graph.get_outgoing_edge_partitions_starting_at_vertex(
-            self)
-        for partition in partitions:
-            key = routing_info.get_first_key_from_partition(partition)
-            spec.switch_write_focus(
-                region=self.DATA_REGIONS.TRANSMISSIONS.value)
-
-            # Write Key info for this core:
-            if key is None:
-
-                # if there's no key, then two false's will cover it.
-                spec.write_value(data=0)
-                spec.write_value(data=0)
-
-            else:
-
-                # has a key, thus set has key to 1 and then add key
-                spec.write_value(data=1)
-                spec.write_value(data=key)
-
     def _write_key_data(self, spec, routing_info, graph):
         """
 
@@ -191,85 +178,74 @@ class HeatDemoVertex(
         :param graph:
         :rtype: None
         """
-        spec.switch_write_focus(region=self.DATA_REGIONS.NEIGHBOUR_KEYS.value)
+        directions = HeatDemoEdge.DIRECTIONS
 
         # get incoming edges
         incoming_edges = graph.get_edges_ending_at_vertex(self)
-        spec.comment("\n the keys for the neighbours in EAST, NORTH, WEST, "
-                     "SOUTH. order:\n\n")
-        direction_edges = list()
-        fake_temp_edges = list()
+        direction_edges = dict()
+        fake_temp_edges = dict()
         command_edge = None
-        output_edge = None
         for incoming_edge in incoming_edges:
             if (isinstance(incoming_edge, HeatDemoEdge) and
                     isinstance(incoming_edge.pre_vertex,
                                ReverseIpTagMultiCastSource)):
-                fake_temp_edges.append(incoming_edge)
+                fake_temp_edges[incoming_edge.direction] = incoming_edge
             elif (isinstance(incoming_edge, HeatDemoEdge) and
                     isinstance(incoming_edge.pre_vertex,
                                HeatDemoVertex)):
-                direction_edges.append(incoming_edge)
-
-        out_going_edges = graph.get_edges_starting_at_vertex(self)
-        for out_going_edge in out_going_edges:
-            if isinstance(out_going_edge.post_vertex, LivePacketGather):
-                if output_edge is not None:
+                # the edge comes from the neighbour on its side of this one
+                direction_edges[incoming_edge.direction] = incoming_edge
+            elif not isinstance(incoming_edge, HeatDemoEdge):
+                if command_edge is not None:
                     raise exceptions.ConfigurationException(
-                        "already found a outgoing edge."
+                        "already found a command edge."
                         " Can't have more than one!")
-                output_edge = out_going_edge
-
-        direction_edges = {
-            edge.direction.value: edge for edge in direction_edges
-        }
+                command_edge = incoming_edge
 
-        # write each key that this module should expect packets from in order
-        # of EAST, NORTH, WEST, SOUTH.
-        loaded_keys = 0
-        for current_direction in range(4):
-            edge = direction_edges.get(current_direction, None)
-            if edge is not None:
-                key = routing_info.get_first_key_for_edge(edge)
-                spec.write_value(data=key)
-                loaded_keys += 1
-            else:
-                spec.write_value(data_type=DataType.INT32, data=-1)
-
-        if loaded_keys == 0:
+        if not direction_edges:
             raise exceptions.ConfigurationException(
-                "This heat element  {} does not receive any data from other "
-                "elements. Please fix and try again.  It currently has"
-                " incoming edges of {} directional edges of {} and fake edges"
-                " of {} and command edge of {} and output edge of {}"
-                .format(self.label, incoming_edges, direction_edges,
-                        fake_temp_edges, command_edge, output_edge))
-
-        # write each key that this model should expect packets from in order of
-        # EAST, NORTH, WEST, SOUTH for injected temperatures
-        fake_temp_edges = {
-            edge.direction.value: edge for edge in fake_temp_edges
-        }
-        current_direction = 0
-        for current_direction in range(4):
-            edge = fake_temp_edges.get(current_direction, None)
+                "This heat element {} does not receive any data from other "
+                "elements. Please fix and try again. It currently has"
+                " incoming edges of {} and fake edges of {} and command edge"
+                " of {}".format(self.label, incoming_edges, fake_temp_edges,
+                                command_edge))
+
+        # heat_demo.c tells the borders of the neighbours apart by the key of
+        # the sender, which is the key of its only partition
+        spec.comment("\n the key of this element:\n\n")
+        spec.write_value(data=routing_info.get_first_key_from_pre_vertex(
+            self, "TRANSMISSION"))
+
+        order = [directions.NORTH, directions.SOUTH, directions.EAST,
+                 directions.WEST]
+        spec.comment("\n the keys for the neighbours in NORTH, SOUTH, EAST, "
+                     "WEST order:\n\n")
+        for direction in order:
+            edge = direction_edges.get(direction, None)
             if edge is not None:
-                key = routing_info.get_first_key_for_edge(edge)
-                spec.write_value(data=key)
+                spec.write_value(
+                    data=routing_info.get_first_key_for_edge(edge))
             else:
                 spec.write_value(data_type=DataType.INT32, data=-1)
 
+        # without a neighbour, that side is a border of the grid
+        spec.comment("\n whether the element is on the grid border in "
+                     "NORTH, SOUTH, EAST, WEST order:\n\n")
+        for direction in order:
+            spec.write_value(data=int(direction not in direction_edges))
+
         # write keys for commands
-        spec.switch_write_focus(region=self.DATA_REGIONS.COMMAND_KEYS.value)
         spec.comment(
             "\n the command keys in order of STOP, PAUSE, RESUME:\n\n")
-        commands_keys_and_masks = \
-            routing_info.get_routing_info_for_edge(command_edge)
+        commands_keys_and_masks = None
+        if command_edge is not None:
+            commands_keys_and_masks = \
+                routing_info.get_routing_info_for_edge(command_edge)
 
         # get just the keys
         keys = list()
         if commands_keys_and_masks is not None:
-            for key_and_mask in commands_keys_and_masks:
+            for key_and_mask in commands_keys_and_masks.keys_and_masks:
                 keys_given, _ = key_and_mask.get_keys(n_keys=3)
                 keys.extend(keys_given)
             # sort keys in ascending order
@@ -283,6 +259,15 @@ class HeatDemoVertex(
         else:
             for _ in range(0, 3):
                 spec.write_value(data_type=DataType.INT32, data=-1)
-#             logger.warn(
-#                 "Set up to not use commands. If commands are needed, "
-#                 "Please create a command sender and wire it to this vertex.")
+
+        # write each key that this model should expect packets from in order of
+        # NORTH, SOUTH, EAST, WEST for injected temperatures
+        spec.comment("\n the keys for the injected temperatures in NORTH, "
+                     "SOUTH, EAST, WEST order:\n\n")
+        for direction in order:
+            edge = fake_temp_edges.get(direction, None)
+            if edge is not None:
+                spec.write_value(
+                    data=routing_info.get_first_key_for_edge(edge))
+            else:
+                spec.write_value(data_type=DataType.INT32, data=-1)
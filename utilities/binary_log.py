@@ -0,0 +1,58 @@
+"""
+Binary debug logs - the log regions of the cores (see log_binary in vertex.c) hold a format id
+and its arguments, the strings are only formatted here on the host
+"""
+
+from utilities.ring_buffer import decode_ring
+
+import re
+import struct
+
+'''after the ring header every record: tick, cycles since its start, format id
+and LOG_ARGUMENTS words'''
+LOG_ARGUMENTS = 5
+LOG_RECORD    = struct.Struct("<III{}I".format(LOG_ARGUMENTS))
+
+_CONVERSION = re.compile(r"%[-0-9]*([a-z])")
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Records of one log region, oldest first: (microseconds since the start, format id, arguments).
+A full buffer holds the newest capacity records'''
+def decode_log(raw):
+
+    return [(time, fields[0], fields[1:]) for time, fields in decode_ring(raw, LOG_RECORD)]
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+The message of a record - %d arguments are signed, the others unsigned words'''
+def format_record(formats, format_id, arguments):
+
+    if format_id >= len(formats):
+        return "unknown format {}: {}".format(format_id, list(arguments))
+
+    text   = formats[format_id]
+    values = []
+    for argument, conversion in zip(arguments, _CONVERSION.findall(text)):
+        if conversion in "di" and argument & 0x80000000:
+            argument = argument - 0x100000000
+        values.append(argument)
+
+    return text % tuple(values)
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Writes the logs of logs, a list of (placement, raw log region), as one text file sorted by time'''
+def write_log(filename, logs, formats):
+
+    lines = []
+    for placement, raw in logs:
+        for time, format_id, arguments in decode_log(raw):
+            lines.append((time, placement.x, placement.y, placement.p,
+                          format_record(formats, format_id, arguments)))
+
+    with open(filename, 'w') as log_file:
+        for time, x, y, p, message in sorted(lines):
+            log_file.write("{:12.2f} {},{},{:<2} {}\n".format(time, x, y, p, message))
+
+'''-----------------------------------------------------------------------------------------'''
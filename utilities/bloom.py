@@ -0,0 +1,36 @@
+"""
+Sizing of the per-core Bloom filters used for membership queries
+"""
+
+import math
+
+'''largest filter a core keeps in DTCM (in 32 bit words)'''
+BLOOM_MAX_WORDS = 4096
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Returns (number of 32 bit words, number of hash functions) for a filter that holds
+expected_items values with the given false positive rate'''
+def bloom_parameters(expected_items, false_positive_rate):
+
+    if expected_items < 1:
+        expected_items = 1
+
+    bits = -expected_items * math.log(false_positive_rate) / (math.log(2) ** 2)
+    num_words = int(math.ceil(bits / 32))
+
+    if num_words > BLOOM_MAX_WORDS:
+        num_words = BLOOM_MAX_WORDS
+
+    num_hashes = int(round((num_words * 32.0 / expected_items) * math.log(2)))
+    if num_hashes < 1:
+        num_hashes = 1
+
+    return num_words, num_hashes
+
+'''-----------------------------------------------------------------------------------------'''
+'''False positive rate a filter of the given size actually achieves'''
+def bloom_false_positive_rate(expected_items, num_words, num_hashes):
+
+    bits = num_words * 32.0
+    return (1 - math.exp(-num_hashes * expected_items / bits)) ** num_hashes
@@ -0,0 +1,234 @@
+"""
+Binary columnar datasets - the column blocks are stored exactly as they are laid out in the
+INPUT_DATA region (see PackedPartition), so a vertex's rows are a slice of every column
+"""
+
+from utilities.ingest import CHUNK_ROWS, SPOOL_SIZE, ROW_COST, DISTINCT_LIMIT, pack_column
+from utilities.string_marshalling import _pad_string
+
+from tempfile import SpooledTemporaryFile
+from collections import namedtuple
+
+import array
+import mmap
+import struct
+import sys
+
+'''magic, version, columns, string columns, rows'''
+FILE_HEADER = struct.Struct("<4sIIII")
+MAGIC       = "SPCL"
+VERSION     = 1
+
+'''type, bytes per value, column of the csv, rows, flags, offset of the block in the file'''
+COLUMN_HEADER = struct.Struct("<IIIIIQ")
+
+COLUMN_INT    = 0
+COLUMN_STRING = 1
+
+'''the column header is followed by the smallest and the largest value, width bytes each'''
+FLAG_MIN_MAX = 1
+
+ColumnInfo = namedtuple("ColumnInfo", "type width source rows minimum maximum offset")
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Packs the rows of a csv into a columnar dataset: the string columns first, then the integer
+columns, like the partitions. The columns are spooled one chunk at a time, so the rows are
+read once and never held in memory as a whole'''
+def write_columnar(filename, rows, columns, num_string_cols, string_size, min_max=True):
+
+    num_cols = len(columns)
+    widths   = [string_size if i < num_string_cols else 4 for i in range(0, num_cols)]
+
+    spools   = [SpooledTemporaryFile(SPOOL_SIZE) for _ in range(0, num_cols)]
+    pending  = [[] for _ in range(0, num_cols)]
+    minimum  = [None] * num_cols
+    maximum  = [None] * num_cols
+    num_rows = 0
+
+    def flush():
+        for i in range(0, num_cols):
+            spools[i].write(pack_column(pending[i], string_size if i < num_string_cols else 0))
+            pending[i] = []
+
+    for data_row in rows:
+
+        for i in range(0, num_cols):
+
+            if i < num_string_cols:
+                value = _pad_string(data_row[columns[i]], string_size)
+            else:
+                value = int(data_row[columns[i]])
+
+            pending[i].append(value)
+            if minimum[i] is None or value < minimum[i]:
+                minimum[i] = value
+            if maximum[i] is None or value > maximum[i]:
+                maximum[i] = value
+
+        num_rows = num_rows + 1
+        if len(pending[0]) == CHUNK_ROWS:
+            flush()
+
+    flush()
+
+    flags = FLAG_MIN_MAX if min_max and num_rows > 0 else 0
+
+    #the blocks follow the headers, every block starts on a word
+    offset = FILE_HEADER.size + num_cols * COLUMN_HEADER.size
+    if flags & FLAG_MIN_MAX:
+        offset = offset + 2 * sum(widths)
+    offset = (offset + 3) & ~3
+
+    with open(filename, 'wb') as dataset:
+
+        dataset.write(FILE_HEADER.pack(MAGIC, VERSION, num_cols, num_string_cols, num_rows))
+
+        for i in range(0, num_cols):
+
+            column_type = COLUMN_STRING if i < num_string_cols else COLUMN_INT
+            dataset.write(COLUMN_HEADER.pack(column_type, widths[i], columns[i], num_rows, flags, offset))
+
+            if flags & FLAG_MIN_MAX:
+                if column_type == COLUMN_STRING:
+                    dataset.write(minimum[i] + maximum[i])
+                else:
+                    dataset.write(struct.pack("<II", minimum[i], maximum[i]))
+
+            offset = offset + widths[i] * num_rows
+
+        dataset.write('\0' * ((4 - dataset.tell() % 4) % 4))
+
+        for spool in spools:
+            spool.seek(0)
+            for chunk in iter(lambda: spool.read(SPOOL_SIZE), ''):
+                dataset.write(chunk)
+            spool.close()
+
+'''-----------------------------------------------------------------------------------------'''
+
+class ColumnarDataset(object):
+
+    '''
+    Memory maps a dataset written by write_columnar - nothing is read until a slice is taken'''
+    def __init__(self, filename):
+
+        self._file = open(filename, 'rb')
+        self._map  = mmap.mmap(self._file.fileno(), 0, access=mmap.ACCESS_READ)
+
+        magic, version, num_cols, self.num_string_cols, self.rows = \
+            FILE_HEADER.unpack_from(self._map, 0)
+        if magic != MAGIC or version != VERSION:
+            raise Exception("{} is not a columnar dataset of version {}".format(filename, VERSION))
+
+        self.columns = []
+        position = FILE_HEADER.size
+        for i in range(0, num_cols):
+
+            column_type, width, source, rows, flags, offset = COLUMN_HEADER.unpack_from(self._map, position)
+            position = position + COLUMN_HEADER.size
+
+            minimum = maximum = None
+            if flags & FLAG_MIN_MAX:
+                if column_type == COLUMN_STRING:
+                    minimum = self._map[position:position + width]
+                    maximum = self._map[position + width:position + 2 * width]
+                else:
+                    minimum, maximum = struct.unpack_from("<II", self._map, position)
+                position = position + 2 * width
+
+            self.columns.append(ColumnInfo(column_type, width, source, rows, minimum, maximum, offset))
+
+        self.string_size = self.columns[0].width if self.num_string_cols > 0 else 0
+
+    '''
+    true if the dataset holds these csv columns packed the same way'''
+    def matches(self, columns, num_string_cols, string_size):
+
+        return [column.source for column in self.columns] == list(columns) and \
+               self.num_string_cols == num_string_cols and \
+               (num_string_cols == 0 or self.string_size == string_size)
+
+    '''
+    rows start to end - 1 of every column'''
+    def slice(self, start, end):
+        return ColumnarSlice(self, start, end)
+
+    def block(self, column, start, end):
+
+        info = self.columns[column]
+        return self._map[info.offset + start * info.width:info.offset + end * info.width]
+
+    '''
+    distinct values of rows start to end - 1 of a column, exact up to DISTINCT_LIMIT like
+    PackedPartition.distinct'''
+    def distinct(self, column, start, end):
+
+        info  = self.columns[column]
+        block = self.block(column, start, end)
+
+        if info.type == COLUMN_INT:
+            values = array.array('I', block)
+        else:
+            values = (block[i:i + info.width] for i in range(0, len(block), info.width))
+
+        seen = set()
+        for value in values:
+            seen.add(value)
+            if len(seen) == DISTINCT_LIMIT:
+                break
+
+        return len(seen)
+
+    def close(self):
+
+        self._map.close()
+        self._file.close()
+
+'''-----------------------------------------------------------------------------------------'''
+
+class ColumnarSlice(object):
+
+    '''
+    Rows of one vertex - stands in for a PackedPartition'''
+    def __init__(self, dataset, start, end):
+
+        self.dataset  = dataset
+        self.start    = start
+        self.end      = end
+        self.rows     = end - start
+        self.size     = sum(column.width for column in dataset.columns) * self.rows
+
+        '''the key column comes first - its block is read once to count its values'''
+        self.distinct = dataset.distinct(0, start, end)
+
+        '''the full string width is counted, the padding is not known either'''
+        self.cost     = self.rows * (ROW_COST + sum(column.width for column in dataset.columns))
+
+    def image(self, header):
+
+        words = array.array('I', struct.pack("<{}I".format(len(header)), *header))
+        for column in range(0, len(self.dataset.columns)):
+            words.fromstring(self.dataset.block(column, self.start, self.end))
+
+        if sys.byteorder == 'big':
+            words.byteswap()
+
+        return words
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Splits the dataset like partition_rows - the first vertices take one leftover row each'''
+def partition_columnar(dataset, num_processors):
+
+    rows_per_core = dataset.rows / num_processors
+    leftovers     = dataset.rows % num_processors
+
+    start = 0
+    for core in range(0, num_processors):
+
+        end = start + rows_per_core + (1 if core < leftovers else 0)
+        yield dataset.slice(start, end)
+        start = end
+
+'''-----------------------------------------------------------------------------------------'''
@@ -0,0 +1,200 @@
+"""
+Machine images for the native emulator (see emulator/src/emulator.c) - the data specs of
+the vertices are run on the host and written with a routing table taken from the machine graph
+"""
+
+import array
+import os
+import struct
+import sys
+
+'''magic "SPEM", version, cores, routes, run ticks'''
+IMAGE_HEADER  = struct.Struct("<IIIII")
+IMAGE_MAGIC   = 0x4D455053
+IMAGE_VERSION = 1
+
+'''must match MAX_REGIONS in emulator/src/emulator.h'''
+MAX_REGIONS = 32
+
+'''flags, tag, ports, addresses - what the emulator fills in of a message of the host'''
+SDP_HEADER_SIZE = 8
+
+_WORD_FORMATS = {1: 'B', 2: 'H', 4: 'I', 8: 'Q'}
+
+'''-----------------------------------------------------------------------------------------'''
+
+class EmulatedSpec(object):
+
+    '''
+    Takes the data specification calls of a vertex and writes straight into its regions'''
+    def __init__(self):
+
+        self.regions = {}
+        self._focus  = None
+
+    def comment(self, comment):
+        pass
+
+    def reserve_memory_region(self, region, size, label=None, empty=False, shrink=True):
+
+        if region >= MAX_REGIONS:
+            raise Exception("region {} is beyond the {} regions of the emulator".format(
+                region, MAX_REGIONS))
+        self.regions[region] = (size, bytearray())
+
+    def switch_write_focus(self, region):
+
+        if region not in self.regions:
+            raise Exception("region {} is written but not reserved".format(region))
+        self._focus = region
+
+    def write_value(self, data, data_type=None):
+
+        size   = getattr(data_type, 'size', 4)
+        format = _WORD_FORMATS[size]
+        if data < 0:
+            format = format.lower()
+
+        self._write(struct.pack("<" + format, data))
+
+    def write_array(self, array_values, data_type=None):
+
+        if isinstance(array_values, array.array) and array_values.itemsize == 4:
+            if sys.byteorder == 'big':
+                array_values = array.array(array_values.typecode, array_values)
+                array_values.byteswap()
+            self._write(array_values.tostring())
+        else:
+            self._write(struct.pack("<{}I".format(len(array_values)),
+                                    *[int(value) & 0xFFFFFFFF for value in array_values]))
+
+    def _write(self, data):
+
+        size, written = self.regions[self._focus]
+        if len(written) + len(data) > size:
+            raise Exception("region {} holds {} bytes, {} are written".format(
+                self._focus, size, len(written) + len(data)))
+        written.extend(data)
+
+    def end_specification(self):
+        pass
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Writes the cores that run binary (e.g. "vertex.aplx") with their regions and the routes
+between them. Packets to cores of other binaries are left out of the routes. iptags maps a
+vertex to the tags its data spec gets (none by default) - whatever the emulated cores send
+over SDP ends up in the output directory, whichever tag it names'''
+def write_machine_image(filename, placements, machine_graph, routing_info, binary, run_ticks,
+                        machine_time_step=1000, time_scale_factor=1, iptags=None):
+
+    cores = [placement for placement in sorted(placements.placements, key=lambda p: (p.x, p.y, p.p))
+             if getattr(placement.vertex, 'get_binary_file_name', lambda: None)() == binary]
+    index = dict((placement.vertex, core) for core, placement in enumerate(cores))
+
+    routes = []
+    for placement in cores:
+        for partition in machine_graph.get_outgoing_edge_partitions_starting_at_vertex(placement.vertex):
+
+            key_and_mask = routing_info.get_routing_info_from_partition(partition).first_key_and_mask
+            targets = sorted(set(index[edge.post_vertex] for edge in partition.edges
+                                 if edge.post_vertex in index))
+            routes.append((key_and_mask.key, key_and_mask.mask, targets))
+
+    with open(filename, 'wb') as image:
+
+        image.write(IMAGE_HEADER.pack(IMAGE_MAGIC, IMAGE_VERSION, len(cores), len(routes), run_ticks))
+
+        for placement in cores:
+
+            spec = EmulatedSpec()
+            placement.vertex.generate_machine_data_specification(
+                spec, placement, machine_graph, routing_info,
+                (iptags or {}).get(placement.vertex, []), [],
+                machine_time_step, time_scale_factor)
+
+            num_regions = max(spec.regions.keys()) + 1 if spec.regions else 0
+            image.write(struct.pack("<IIII", placement.x, placement.y, placement.p, num_regions))
+
+            for region in range(0, num_regions):
+                size, written = spec.regions.get(region, (0, bytearray()))
+                image.write(struct.pack("<II", size, len(written)))
+                image.write(written)
+                image.write('\0' * ((4 - len(written) % 4) % 4))
+
+        for key, mask, targets in routes:
+            image.write(struct.pack("<{}I".format(3 + len(targets)), key, mask, len(targets), *targets))
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Writes the SDP messages of the host for the -S option of the emulator - messages is a list of
+(tick, placement, port, data) in the order of their ticks, data being what follows the SDP
+header (the command header first)'''
+def write_sdp_messages(filename, messages):
+
+    with open(filename, 'wb') as sdp:
+        for tick, placement, port, data in messages:
+            sdp.write(struct.pack("<6I", tick, placement.x, placement.y, placement.p, port,
+                                  SDP_HEADER_SIZE + len(data)))
+            sdp.write(data)
+            sdp.write('\0' * ((4 - len(data) % 4) % 4))
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+The SDP messages the core of placement sent in an emulated run, in order - each one as the
+host receives it with the SDP header kept (2 bytes padding, then the SDP header)'''
+def read_sdp_replies(directory, placement):
+
+    filename = os.path.join(directory, "{}_{}_{}.sdp".format(
+        placement.x, placement.y, placement.p))
+    if not os.path.exists(filename):
+        return []
+
+    with open(filename, 'rb') as sdp:
+        data = sdp.read()
+
+    replies  = []
+    position = 0
+    while position < len(data):
+        size, = struct.unpack_from("<I", data, position)
+        replies.append(bytearray(data[position + 4:position + 4 + size]))
+        position = position + 4 + size
+    return replies
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+What the core of placement recorded on channel in an emulated run, like vertex.read()'''
+def read_recording(directory, placement, channel=0):
+
+    filename = os.path.join(directory, "{}_{}_{}_{}.rec".format(
+        placement.x, placement.y, placement.p, channel))
+    if not os.path.exists(filename):
+        return bytearray()
+
+    with open(filename, 'rb') as recording:
+        return bytearray(recording.read())
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Region of the core of placement as the emulated run left it, e.g. for vertex.decode_profile()'''
+def read_region(directory, placement, region):
+
+    filename = os.path.join(directory, "{}_{}_{}.regions".format(
+        placement.x, placement.y, placement.p))
+
+    with open(filename, 'rb') as regions:
+        data = regions.read()
+
+    num_regions, = struct.unpack_from("<I", data, 0)
+    if region >= num_regions:
+        return bytearray()
+
+    position = 4
+    for index in range(0, num_regions):
+        size, = struct.unpack_from("<I", data, position)
+        position = position + 4
+        if index == region:
+            return bytearray(data[position:position + size])
+        position = position + (size + 3) // 4 * 4
+
+'''-----------------------------------------------------------------------------------------'''
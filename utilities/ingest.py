@@ -0,0 +1,409 @@
+"""
+Streaming ingest - rows are routed straight into the packed data block of their vertex
+"""
+
+from utilities.string_marshalling import pack_string_column_image
+from utilities import workers
+
+from tempfile import SpooledTemporaryFile
+
+import array
+import bisect
+import struct
+import sys
+import zlib
+
+'''rows collected per column before they are packed'''
+CHUNK_ROWS = 4096
+
+'''bytes of a partition kept in memory before it is spilled to a temporary file'''
+SPOOL_SIZE = 1 << 20
+
+'''vertex.c keeps 16 bit ids - counting more distinct values than that is of no use'''
+DISTINCT_LIMIT = 1 << 16
+
+'''
+cost model of a row: a fixed part for the dictionary lookup and id bookkeeping, plus
+one unit per character that is compared and 4 per integer that is copied'''
+ROW_COST = 16
+
+'''one node of the dictionary of a core (a linked list, see search_dictionary in vertex.c) compared'''
+SEARCH_COST = 4
+
+'''a value new to a core is inserted into its dictionary and its rows get the id of the value'''
+DISTINCT_COST = 32
+
+'''a value whose rows are expected to take more than this share of a core's load is hot'''
+HOT_SHARE = 0.25
+
+'''host encoded ids share the packet with a 16 bit count (see ENCODED HISTOGRAM in vertex.c)'''
+ENCODED_ID_LIMIT = 1 << 16
+
+'''chunks a partition may have with the worker processes before it waits for them'''
+MAX_INFLIGHT = 64
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Packs the rows collected for one column - runs in a worker process'''
+def pack_column(values, string_size):
+
+    if string_size:
+        return pack_string_column_image(values, string_size)
+
+    return struct.pack("<{}I".format(len(values)), *[int(value) for value in values])
+
+'''-----------------------------------------------------------------------------------------'''
+
+class PackedPartition(object):
+
+    '''
+    String and integer block of one vertex exactly as they are laid out in SDRAM
+    behind the header: string columns first, then integer columns, column by column'''
+    def __init__(self, num_string_cols, num_cols, string_size, key_column=0):
+
+        self.num_string_cols = num_string_cols
+        self.key_column      = key_column
+        self.num_cols        = num_cols
+        self.string_size     = string_size
+        self.rows            = 0
+        self.size            = 0
+        self.cost            = 0
+
+        self._pending  = [[] for _ in range(0, num_cols)]
+        self._columns  = [SpooledTemporaryFile(SPOOL_SIZE) for _ in range(0, num_cols)]
+        self._distinct = set()
+        self._block    = None
+        self._inflight = []
+
+    '''distinct values of the key column, exact up to DISTINCT_LIMIT'''
+    @property
+    def distinct(self):
+        return len(self._distinct)
+
+    '''predicted dictionary work of adding row to this vertex, see search_cost'''
+    def lookup_cost(self, row):
+
+        new_value = len(self._distinct) < DISTINCT_LIMIT and row[self.key_column] not in self._distinct
+        return search_cost(len(self._distinct), new_value)
+
+    def add(self, row, cost=0):
+
+        self.cost = self.cost + cost
+
+        for i in range(0, self.num_cols):
+            self._pending[i].append(row[i])
+
+        if len(self._distinct) < DISTINCT_LIMIT:
+            self._distinct.add(row[self.key_column])
+
+        self.rows = self.rows + 1
+        if len(self._pending[0]) == CHUNK_ROWS:
+            self._flush()
+
+    '''
+    hands the collected rows to the worker processes - the packed chunks are written in the
+    order they were handed out, so the block does not depend on which worker finishes first'''
+    def _flush(self):
+
+        pool = workers.pool()
+
+        for i in range(0, self.num_cols):
+
+            string_size = self.string_size if i < self.num_string_cols else 0
+
+            if pool is None:
+                self._write(i, pack_column(self._pending[i], string_size))
+            else:
+                self._inflight.append((i, pool.apply_async(pack_column, (self._pending[i], string_size))))
+
+            self._pending[i] = []
+
+        if len(self._inflight) > MAX_INFLIGHT:
+            self._drain()
+
+    def _write(self, column, packed):
+
+        self._columns[column].write(packed)
+        self.size = self.size + len(packed)
+
+    def _drain(self):
+
+        for column, result in self._inflight:
+            self._write(column, result.get())
+
+        self._inflight = []
+
+    '''
+    packs the last rows and joins the columns into a single block'''
+    def close(self):
+
+        self._flush()
+        self._drain()
+
+        self._block = SpooledTemporaryFile(SPOOL_SIZE)
+        for column in self._columns:
+            column.seek(0)
+            for chunk in iter(lambda: column.read(SPOOL_SIZE), ''):
+                self._block.write(chunk)
+            column.close()
+
+        self._columns = []
+        self._pending = []
+
+    '''
+    returns the header followed by the block as one array of 32 bit words - the
+    bytes are taken over as they are, no word is converted on its own'''
+    def image(self, header):
+
+        self._block.seek(0)
+
+        words = array.array('I', struct.pack("<{}I".format(len(header)), *header))
+        words.fromstring(self._block.read())
+
+        if sys.byteorder == 'big':
+            words.byteswap()
+
+        return words
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Splits num_rows rows evenly among num_processors vertices, the first vertices take one
+leftover row each. Yields one closed PackedPartition per vertex - only the partition that is
+currently filled holds rows in memory'''
+def partition_rows(rows, num_rows, num_processors, columns, num_string_cols, string_size,
+                   key_column=0):
+
+    rows_per_core = num_rows / num_processors
+    leftovers     = num_rows % num_processors
+
+    rows = iter(rows)
+    for core in range(0, num_processors):
+
+        partition = PackedPartition(num_string_cols, len(columns), string_size, key_column)
+
+        add_leftover = 0
+        if core < leftovers:
+            add_leftover = 1
+
+        for row in range(0, rows_per_core + add_leftover):
+            data_row = next(rows)
+            partition.add([data_row[column] for column in columns])
+
+        partition.close()
+        yield partition
+
+'''-----------------------------------------------------------------------------------------'''
+
+'''
+Places all rows with the same value in the key column (an index into columns) on the same vertex.
+mode 'hash' spreads the values by their crc32, mode 'range' by the sorted splitters (one less
+than num_processors, see choose_splitters). Values in hot (see assign_hot_values) go to the
+core given there. Returns one closed PackedPartition per vertex'''
+def partition_rows_by_key(rows, num_processors, columns, num_string_cols, string_size,
+                          mode='hash', splitters=None, key_column=0, hot=None):
+
+    partitions = [PackedPartition(num_string_cols, len(columns), string_size, key_column)
+                  for _ in range(0, num_processors)]
+
+    for data_row in rows:
+
+        key = data_row[columns[key_column]]
+        packed = [data_row[column] for column in columns]
+
+        if hot and key in hot:
+            core = hot[key]
+        elif mode == 'range':
+            core = bisect.bisect_right(splitters, key)
+        else:
+            core = (zlib.crc32(str(key)) & 0xFFFFFFFF) % num_processors
+
+        partitions[core].add(packed, row_cost(packed, num_string_cols) +
+                             partitions[core].lookup_cost(packed))
+
+    for partition in partitions:
+        partition.close()
+
+    return partitions
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Picks num_processors - 1 splitters from a sample of the key column so that the ranges hold
+about the same number of distinct values'''
+def choose_splitters(sample, num_processors):
+
+    values = sorted(set(sample))
+    if not values:
+        return []
+
+    return [values[(len(values) * core) / num_processors] for core in range(1, num_processors)]
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Dictionary of the values of a column, sorted so that ids keep the order of the values.
+The id of dictionary[i] is i + 1 - id 0 is never used'''
+def build_dictionary(rows, column):
+
+    values = set()
+    for data_row in rows:
+        values.add(data_row[column])
+
+    dictionary = sorted(values)
+    if len(dictionary) >= ENCODED_ID_LIMIT:
+        raise Exception("{} distinct values do not fit into 16 bit ids".format(len(dictionary)))
+
+    return dictionary
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Replaces the value of the key column by its id. Returns the rows and the columns the partitions
+should use: the remaining string columns, then the id column, then the integer columns'''
+def encode_rows(rows, columns, num_string_cols, dictionary):
+
+    ids = dict((value, i + 1) for i, value in enumerate(dictionary))
+
+    key = columns[0]
+    encoded_columns = columns[1:num_string_cols] + [key] + columns[num_string_cols:]
+
+    def encoded(rows):
+        for data_row in rows:
+            data_row = list(data_row)
+            data_row[key] = ids[data_row[key]]
+            yield data_row
+
+    return encoded(rows), encoded_columns
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Id of a value of the dictionary'''
+def dictionary_id(dictionary, value):
+    return bisect.bisect_left(dictionary, value) + 1
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Predicted work of a row as it is packed: string columns first, then integer columns'''
+def row_cost(row, num_string_cols):
+
+    cost = ROW_COST + 4 * (len(row) - num_string_cols)
+    for i in range(0, num_string_cols):
+        cost = cost + len(str(row[i]).rstrip())
+
+    return cost
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Predicted dictionary work of a row on a vertex that holds distinct values so far. The row is
+looked up in the linked list of the vertex, half of it on average. A value the vertex does not
+hold yet is inserted, and it is looked up once more in the id round and in the histogram round
+of the ring - the bloom filter keeps the values of the other vertices out of these lookups'''
+def search_cost(distinct, new_value):
+
+    cost = SEARCH_COST * distinct / 2.0
+    if new_value:
+        cost = cost + DISTINCT_COST + SEARCH_COST * distinct
+
+    return cost
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Mean predicted work of a row from a sample of the file, or from all of its rows. The rows are
+cut into blocks of rows_per_core rows, each block stands for the dictionary of one vertex - with
+all rows that is the work of the even split'''
+def mean_row_cost(sample, columns, num_string_cols, rows_per_core=0):
+
+    total = 0
+    count = 0
+    held  = set()
+    for data_row in sample:
+
+        if rows_per_core and count % rows_per_core == 0:
+            held = set()
+
+        row = [data_row[column] for column in columns]
+        total = total + row_cost(row, num_string_cols) + \
+                search_cost(len(held), row[0] not in held)
+        held.add(row[0])
+        count = count + 1
+
+    if count == 0:
+        return ROW_COST
+
+    return float(total) / count
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Like partition_rows, but the rows are split so that every vertex gets the same predicted
+work rather than the same number of rows. The work of a row grows with the distinct values
+its vertex holds (see search_cost), so a vertex with many values takes fewer rows. A vertex
+stops early when fits(rows, distinct) says one more row would not fit into the core. The target of each vertex is an equal share of
+the work that is left: sampled_cost (see mean_row_cost) for every row of the file less what the
+vertices before took, or the mean cost seen so far for the rows that are left, whichever is more.
+A part of the file that is cheaper than the rest then does not leave the rest to the last vertex'''
+def partition_rows_balanced(rows, num_rows, num_processors, columns, num_string_cols,
+                            string_size, key_column=0, sampled_cost=ROW_COST, fits=None):
+
+    def has_room(partition):
+        return fits is None or fits(partition.rows + 1, partition.distinct + 1)
+
+    seen_rows = 0
+    seen_cost = 0
+
+    rows = iter(rows)
+    for core in range(0, num_processors):
+
+        partition = PackedPartition(num_string_cols, len(columns), string_size, key_column)
+
+        mean_cost = float(seen_cost) / seen_rows if seen_rows else sampled_cost
+        left      = max(sampled_cost * num_rows - seen_cost, mean_cost * (num_rows - seen_rows))
+        target    = left / (num_processors - core)
+
+        #the last vertex takes whatever is left
+        while seen_rows < num_rows and (core == num_processors - 1 or
+                                        (partition.cost < target and has_room(partition))):
+
+            data_row = next(rows)
+            packed   = [data_row[column] for column in columns]
+            cost     = row_cost(packed, num_string_cols) + partition.lookup_cost(packed)
+
+            partition.add(packed, cost)
+            seen_rows = seen_rows + 1
+            seen_cost = seen_cost + cost
+
+        partition.close()
+        yield partition
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Values expected to overload a core under hash partitioning get a core of their own choosing:
+the heaviest first, each to the core with the least predicted load (longest processing time
+first). Returns value -> core for partition_rows_by_key'''
+def assign_hot_values(sample, num_rows, num_processors, columns, num_string_cols):
+
+    if not sample:
+        return {}
+
+    scale = float(num_rows) / len(sample)
+
+    value_cost = {}
+    total = 0
+    for data_row in sample:
+        cost = row_cost([data_row[column] for column in columns], num_string_cols) * scale
+        key  = data_row[columns[0]]
+        value_cost[key] = value_cost.get(key, 0) + cost
+        total = total + cost
+
+    threshold = HOT_SHARE * total / num_processors
+    hot = sorted([(cost, key) for key, cost in value_cost.items() if cost > threshold], reverse=True)
+
+    #the remaining values are spread evenly by their hash
+    background = (total - sum(cost for cost, key in hot)) / num_processors
+    loads = [background] * num_processors
+
+    assignment = {}
+    for cost, key in hot:
+        core = loads.index(min(loads))
+        assignment[key] = core
+        loads[core] = loads[core] + cost
+
+    return assignment
+
+'''-----------------------------------------------------------------------------------------'''
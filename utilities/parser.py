@@ -3,6 +3,7 @@ This section is used for parsing the data from the csv file provided
 """
 
 import csv
+import random
 
 class parser(object):
     
@@ -24,6 +25,48 @@ class parser(object):
             #return the data
             return data_parcel
     
+    def count_rows(self):
+        
+        #number of data rows, the header is not counted
+        with open(self.filename, 'rb') as csvfile:
+            
+            count = -1
+            for line in csv.reader(csvfile, delimiter=',', quotechar='|'):
+                count = count + 1
+                
+            return max(count, 0)
+        
+    def stream_rows(self):
+        
+        #yields one row at a time, only the current row is held in memory
+        with open(self.filename, 'rb') as csvfile:
+            
+            datareader = csv.reader(csvfile, delimiter=',', quotechar='|')
+            
+            #get rid of the headers
+            next(datareader, None)
+            
+            for row in datareader:
+                yield row
+    
+    def sample_rows(self, size):
+        
+        #reservoir sample of the rows - used to estimate load and pick range splitters
+        sample = []
+        for count, row in enumerate(self.stream_rows()):
+            if count < size:
+                sample.append(row)
+            else:
+                position = random.randint(0, count)
+                if position < size:
+                    sample[position] = row
+                    
+        return sample
+    
+    def sample_column(self, column, size):
+        
+        return [row[column] for row in self.sample_rows(size)]
+    
     def write_to_csv(self, new_filename, array):
         
         with open(new_filename, "wb") as f:
@@ -0,0 +1,633 @@
+"""
+Discrete-event model of the id assignment (function 2) and histogram (function 3) protocols of
+vertex.c - every packet of a ring of 16 cores goes through the routers, links and receive
+queues of the machine, so the completion time and the load of every router and link can be
+predicted for rings and datasets that do not fit on the boards at hand
+
+The handlers below follow index_receive() and histogram_receive() packet for packet: messages
+of 5 packets, 15 (14 while a subordinate leads) acknowledgements per round, the leader
+forwarding what the core in charge sends, one query and one update round per id. The rings of
+a machine do not talk to each other, so a machine takes as long as its slowest ring.
+"""
+
+from utilities.synthetic import ZipfSampler
+
+import collections
+import heapq
+import math
+
+RING_SIZE = 16
+
+'''payloads - a subordinate reports ready with -1, string words are never a signal'''
+ACK    = -1
+STRING = 'S'
+
+'''partitions of send_state() in vertex.c'''
+RING_PARTITION   = 1
+SECOND_PARTITION = 2 # command from the leader, report to the leader
+
+'''event kinds, in the order they are handled at the same time'''
+START, DELIVER, PROCESS, ROUTE, LINK = range(0, 5)
+
+'''-----------------------------------------------------------------------------------------'''
+
+class ModelParameters(object):
+
+    '''
+    Costs the model charges - cpu cycles of the cores and nanoseconds of the routers and links.
+    The defaults are estimates for an ARM968 at 200 MHz, calibrate them with validate()'''
+    def __init__(self, **overrides):
+
+        self.clock_mhz         = 200
+        self.packet_cycles     = 120 # receive interrupt, callback queue and receive_data()
+        self.message_cycles    = 60  # handling of the fifth packet of a message
+        self.send_cycles       = 40  # send_state(), one packet
+        self.search_cycles     = 30  # call of a dictionary search
+        self.probe_cycles      = 12  # one node of the linked list dictionary
+        self.row_cycles        = 40  # a row of initialise_index() and complete_index()
+        self.record_cycles     = 150 # one value and its frequency recorded
+        self.router_ns         = 8   # a router takes a packet this often
+        self.router_latency_ns = 100 # from a router to a core or a link
+        self.link_ns           = 250 # a link takes a packet this often (72 bit packets)
+        self.link_latency_ns   = 100
+        self.cores_per_chip    = 16  # application cores of a chip that take ring members
+
+        for name, value in overrides.items():
+            if not hasattr(self, name):
+                raise Exception("no model parameter {}".format(name))
+            setattr(self, name, value)
+
+    def cycles_us(self, cycles):
+        return cycles / float(self.clock_mhz)
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Statistics of the cores of one ring the model needs, from the values of the string column of
+each core in ring order (the leader first):
+    rows           rows of the core
+    distinct       values in its dictionary
+    new_distinct   values no earlier core of the ring holds - the ids this core hands out
+    new_rows       rows with such a value (complete_index() searches them again)
+    init_probes    dictionary nodes visited while the dictionary is built
+    search_probes  mean nodes visited by a search for any value of the ring'''
+def ring_statistics(core_values):
+
+    seen       = set()
+    statistics = []
+    positions  = []
+
+    for values in core_values:
+
+        order       = {}
+        init_probes = 0
+        for value in values:
+            position = order.get(value)
+            if position is None:
+                init_probes = init_probes + len(order)
+                order[value] = len(order)
+            else:
+                init_probes = init_probes + position + 1
+
+        statistics.append({"rows":         len(values),
+                           "distinct":     len(order),
+                           "new_distinct": len([value for value in order if value not in seen]),
+                           "new_rows":     len([value for value in values if value not in seen]),
+                           "init_probes":  init_probes})
+        positions.append(order)
+        seen.update(order)
+
+    #a hit visits the nodes up to the value, a miss all of them
+    for core, order in zip(statistics, positions):
+        hits   = sum(order.values()) + len(order)
+        misses = (len(seen) - len(order)) * len(order)
+        core["search_probes"] = float(hits + misses) / max(len(seen), 1)
+
+    return statistics
+
+'''
+Statistics of a ring whose cores hold rows_per_core rows drawn from unique values with a zipf
+skew, like the benchmark datasets of utilities/synthetic.py'''
+def synthetic_ring_statistics(rows_per_core, unique, skew, seed=0):
+
+    sampler = ZipfSampler(unique, skew, seed)
+    return ring_statistics([[sampler.sample() for _ in xrange(rows_per_core)]
+                            for _ in range(0, RING_SIZE)])
+
+'''-----------------------------------------------------------------------------------------'''
+
+class ModelCore(object):
+
+    def __init__(self, index, number, chip, statistics):
+
+        self.index      = index      # in the ring, 0 - leader
+        self.number     = number     # in the machine
+        self.chip       = chip
+        self.statistics = statistics
+
+        self.inbox = collections.deque()
+        self.busy  = False
+
+        #local_index and the globals of vertex.c the protocols use
+        self.function          = 2
+        self.messages_received = 0
+        self.message           = [0, 0, 0, 0]
+        self.message_id        = 0
+        self.index_complete    = index == 0
+        self.in_charge         = index == 0
+        self.max_id            = statistics["new_distinct"] if index == 0 else 0
+        self.forward_mode      = False
+        self.reported_ready    = 0
+        self.current_leader    = 0
+        self.global_max_id     = 0
+        self.current_id        = 1
+
+        self.counters = collections.Counter()
+
+    def signal(self, signal):
+        return self.message[0] == signal and self.message[1] == signal and self.message[2] == signal
+
+'''-----------------------------------------------------------------------------------------'''
+
+class RingModel(object):
+
+    '''
+    One ring of 16 cores with the statistics of ring_statistics(), on the chips of a machine that
+    is chip_width chips wide. first_core places the ring among the cores of the machine'''
+    def __init__(self, statistics, parameters=None, first_core=0, chip_width=None):
+
+        if len(statistics) != RING_SIZE:
+            raise Exception("a ring has {} cores, not {}".format(RING_SIZE, len(statistics)))
+
+        self.parameters = parameters or ModelParameters()
+        per_chip        = self.parameters.cores_per_chip
+        last_chip       = (first_core + RING_SIZE - 1) // per_chip
+        self.chip_width = chip_width or int(math.ceil(math.sqrt(last_chip + 1)))
+
+        self.cores = [ModelCore(index, first_core + index,
+                                self._chip((first_core + index) // per_chip), statistics[index])
+                      for index in range(0, RING_SIZE)]
+
+        self.events       = []
+        self.sequence     = 0
+        self.now          = 0.0
+        self.router_free  = collections.defaultdict(float)
+        self.link_free    = collections.defaultdict(float)
+        self.router_load  = collections.Counter()
+        self.link_load    = collections.Counter()
+        self.record_done  = 0.0
+
+    def _chip(self, number):
+        return (number % self.chip_width, number // self.chip_width)
+
+    def _schedule(self, time, kind, *arguments):
+
+        self.sequence = self.sequence + 1
+        heapq.heappush(self.events, (time, kind, self.sequence, arguments))
+
+    '''
+    Runs the protocols from the tick in which every core starts until nothing is left to do'''
+    def run(self):
+
+        for core in self.cores:
+            self._schedule(0.0, START, core)
+
+        handlers = {START: self._start, DELIVER: self._deliver, PROCESS: self._process,
+                    ROUTE: self._route, LINK: self._link}
+
+        while self.events:
+            self.now, kind, _, arguments = heapq.heappop(self.events)
+            handlers[kind](*arguments)
+
+        return self
+
+    '''-------------------------------------------------------------------------------------'''
+    '''cores - a handler charges cycles and collects sends, which leave once it is done'''
+
+    def _start(self, core):
+
+        statistics = core.statistics
+        self._begin(core)
+        self._work(statistics["rows"] * (self.parameters.row_cycles + self.parameters.search_cycles) +
+                   statistics["init_probes"] * self.parameters.probe_cycles)
+        core.counters["searches"]      += statistics["rows"]
+        core.counters["search_probes"] += statistics["init_probes"]
+
+        #the leader numbers its values and sends the first one
+        if core.index == 0:
+            core.global_max_id = 1
+            self._send_string(core)
+
+        self._end(core)
+
+    def _deliver(self, core, packet):
+
+        source, partition, payload = packet
+        if partition == RING_PARTITION:
+            core.counters["received_ring"] += 1
+        elif source.index == 0:
+            core.counters["received_command"] += 1
+        else:
+            core.counters["received_other"] += 1
+
+        core.inbox.append(payload)
+        if not core.busy:
+            core.busy = True
+            self._schedule(self.now, PROCESS, core)
+
+    def _process(self, core):
+
+        if not core.inbox:
+            core.busy = False
+            return
+
+        payload = core.inbox.popleft()
+        self._begin(core)
+        self._work(self.parameters.packet_cycles)
+
+        if core.function == 2:
+            if core.index == 0:
+                self._leader_index(core, payload)
+            else:
+                self._subordinate_index(core, payload)
+        else:
+            if core.index == 0:
+                self._leader_histogram(core, payload)
+            else:
+                self._subordinate_histogram(core, payload)
+
+        self._end(core)
+
+    def _begin(self, core):
+
+        self.current = core
+        self.cycles  = 0
+        self.sends   = []
+        self.records = 0
+
+    def _work(self, cycles):
+        self.cycles = self.cycles + cycles
+
+    def _send(self, core, partition, payload):
+
+        self.sends.append((partition, payload))
+        core.counters["sent_ring" if partition == RING_PARTITION else "sent_other"] += 1
+
+    def _end(self, core):
+
+        parameters = self.parameters
+        time = self.now + parameters.cycles_us(self.cycles)
+
+        for partition, payload in self.sends:
+            time = time + parameters.cycles_us(parameters.send_cycles)
+            self._schedule(time, ROUTE, core.chip, (core, partition, payload),
+                           self._destinations(core, partition))
+
+        if self.records:
+            self.record_done = max(self.record_done, time)
+
+        core.busy = True
+        self._schedule(time, PROCESS, core)
+
+    def _destinations(self, core, partition):
+
+        if partition == RING_PARTITION:
+            return [self.cores[(core.index + 1) % RING_SIZE]]
+        if core.index == 0:
+            return self.cores[1:]
+        return [self.cores[0]]
+
+    '''-------------------------------------------------------------------------------------'''
+    '''routers and links - each takes one packet at a time, multicasts split where paths part'''
+
+    def _route(self, chip, packet, destinations):
+
+        parameters = self.parameters
+        start = max(self.now, self.router_free[chip])
+        self.router_free[chip] = start + parameters.router_ns / 1000.0
+        self.router_load[chip] += 1
+        leave = start + parameters.router_latency_ns / 1000.0
+
+        onwards = collections.defaultdict(list)
+        for destination in destinations:
+            if destination.chip == chip:
+                self._schedule(leave, DELIVER, destination, packet)
+            else:
+                onwards[self._next_chip(chip, destination.chip)].append(destination)
+
+        for next_chip, group in onwards.items():
+            self._schedule(leave, LINK, (chip, next_chip), packet, group)
+
+    def _link(self, link, packet, destinations):
+
+        parameters = self.parameters
+        start = max(self.now, self.link_free[link])
+        self.link_free[link] = start + parameters.link_ns / 1000.0
+        self.link_load[link] += 1
+
+        self._schedule(start + (parameters.link_ns + parameters.link_latency_ns) / 1000.0,
+                       ROUTE, link[1], packet, destinations)
+
+    @staticmethod
+    def _next_chip(chip, target):
+
+        #dimension order: x first, then y
+        if chip[0] != target[0]:
+            return (chip[0] + (1 if target[0] > chip[0] else -1), chip[1])
+        return (chip[0], chip[1] + (1 if target[1] > chip[1] else -1))
+
+    '''-------------------------------------------------------------------------------------'''
+    '''the protocols - see index_receive(), histogram_receive() and their helpers in vertex.c'''
+
+    def _search(self, core, count=True):
+
+        self._work(self.parameters.search_cycles +
+                   core.statistics["search_probes"] * self.parameters.probe_cycles)
+        if count:
+            core.counters["searches"]      += 1
+            core.counters["search_probes"] += core.statistics["search_probes"]
+
+    def _send_message(self, core, words):
+        for word in words:
+            self._send(core, SECOND_PARTITION, word)
+
+    def _send_string(self, core):
+
+        #find_instance_of() walks the dictionary for the id
+        self._search(core, False)
+        self._send_message(core, [STRING, STRING, STRING, STRING, core.global_max_id
+                                  if core.index == 0 else core.message_id])
+
+    def _send_signal(self, core, identifier, signal):
+        self._send_message(core, [signal, signal, signal, core.index, identifier])
+
+    def _send_function_signal(self, core, signal, entry1, entry2):
+        self._send_message(core, [signal, signal, signal, entry1, entry2])
+
+    def _collect(self, core, payload):
+
+        #True once the fifth packet of a message is in
+        core.messages_received += 1
+        if core.messages_received % 5 != 0:
+            core.message[core.messages_received % 5 - 1] = payload
+            return False
+
+        core.message_id = payload
+        self._work(self.parameters.message_cycles)
+        return True
+
+    def _leader_index(self, core, payload):
+
+        #Case 1: waiting for reports
+        if not core.forward_mode:
+
+            cores_to_report = 15 if core.current_leader == 0 else 14
+
+            if payload == ACK:
+                core.reported_ready += 1
+            if core.reported_ready == cores_to_report:
+
+                core.reported_ready = 0
+                core.global_max_id += 1
+
+                if core.current_leader % RING_SIZE != 0:
+                    self._send_signal(core, core.global_max_id, 1)
+                    core.forward_mode = True
+                elif core.global_max_id <= core.max_id:
+                    self._send_string(core)
+                else:
+                    self._send_signal(core, core.global_max_id, 0)
+                    core.current_leader = 1
+                    core.forward_mode = True
+
+        #Case 2: forwarding what the core in charge sends
+        if core.forward_mode:
+
+            core.messages_received += 1
+            if core.messages_received % 5 != 0:
+                core.message[core.messages_received % 5 - 1] = payload
+                if payload == ACK:
+                    core.messages_received -= 1
+                return
+
+            core.message_id = payload
+            self._work(self.parameters.message_cycles)
+
+            if not core.signal(0):
+                self._send_message(core, core.message + [core.message_id])
+                core.forward_mode = False
+                return
+
+            core.current_leader += 1
+            if core.current_leader < RING_SIZE:
+                self._send_message(core, core.message + [core.message_id])
+                core.forward_mode = True
+
+            if core.current_leader == RING_SIZE:
+                self._start_histogram(core)
+
+    def _subordinate_index(self, core, payload):
+
+        if not self._collect(core, payload):
+            return
+
+        if core.signal(3):
+            core.function = core.message_id
+            self._send(core, SECOND_PARTITION, ACK)
+
+        if not core.in_charge:
+
+            if core.signal(1):
+                return
+
+            if core.signal(0):
+                if core.message[3] + 1 == core.index:
+
+                    core.in_charge = True
+                    core.index_complete = True
+                    statistics = core.statistics
+
+                    #find_instance_of(0), then complete_index() on the rows without an id
+                    self._search(core, False)
+                    self._work(statistics["new_rows"] * self.parameters.row_cycles)
+                    for _ in range(0, statistics["new_rows"]):
+                        self._search(core)
+
+                    if statistics["new_distinct"] > 0:
+                        core.max_id = core.message_id + statistics["new_distinct"] - 1
+                        self._send_string(core)
+                    else:
+                        core.in_charge = False
+                        self._send_signal(core, core.message_id, 0)
+
+            else:
+                if not core.index_complete:
+                    self._search(core)
+                self._send(core, SECOND_PARTITION, ACK)
+
+        if core.in_charge and core.signal(1):
+
+            if core.message_id <= core.max_id:
+                self._send_string(core)
+            else:
+                core.in_charge = False
+                self._send_signal(core, core.message_id, 0)
+
+    def _start_histogram(self, core):
+
+        core.function          = 3
+        core.messages_received = 0
+        core.forward_mode      = False
+        core.reported_ready    = 0
+        core.current_leader    = 0
+        core.current_id        = 1
+        self._send_function_signal(core, 3, 0, 3)
+
+    def _leader_next_step(self, core):
+
+        core.reported_ready = 0
+
+        if core.current_id > core.global_max_id:
+            self._record(core, core.max_id)
+            core.current_leader += 1
+            self._send_function_signal(core, 2, core.current_leader, core.max_id + 1)
+            core.forward_mode = True
+            return
+
+        core.forward_mode = True
+        self._send_function_signal(core, 1, 0, core.current_id)
+
+    def _leader_histogram(self, core, payload):
+
+        #Case 1: waiting for reports
+        if not core.forward_mode:
+            if payload == ACK:
+                core.reported_ready += 1
+            if core.reported_ready == 15:
+                self._leader_next_step(core)
+
+        #Case 2: collecting frequencies, or where the recording has got to
+        if core.forward_mode:
+
+            if core.current_id > core.global_max_id:
+                if payload == ACK:
+                    return
+                core.current_leader += 1
+                self._send_function_signal(core, 2, core.current_leader, payload)
+                return
+
+            if payload != ACK:
+                core.reported_ready += 1
+
+            if core.reported_ready == 15:
+
+                core.reported_ready = 0
+                core.forward_mode = False
+                if core.current_id <= core.max_id:
+                    self._search(core, False)
+
+                self._send_function_signal(core, 0, 0, core.current_id)
+                core.current_id += 1
+
+    def _subordinate_histogram(self, core, payload):
+
+        if not self._collect(core, payload):
+            return
+
+        if core.signal(0):
+            self._search(core, False)
+            self._send(core, SECOND_PARTITION, ACK)
+
+        if core.signal(1):
+            self._search(core, False)
+            self._send(core, SECOND_PARTITION, 0)
+
+        if core.signal(2) and core.message[3] == core.index:
+
+            start = core.message_id
+            if start <= core.max_id:
+                self._record(core, core.max_id - start + 1)
+                self._send(core, SECOND_PARTITION, core.max_id + 1)
+            else:
+                self._send(core, SECOND_PARTITION, start)
+
+    def _record(self, core, count):
+
+        #record_unqiue_items() walks the whole dictionary
+        self._work(count * self.parameters.record_cycles +
+                   core.statistics["distinct"] * self.parameters.probe_cycles)
+        self.records = self.records + count
+        core.counters["recorded"] += count
+
+    '''-------------------------------------------------------------------------------------'''
+
+    def prediction(self):
+
+        return {"time_to_result_us": self.record_done,
+                "drained_us":        self.now,
+                "counters":          [dict(core.counters) for core in self.cores],
+                "router_packets":    dict(("{},{}".format(*chip), count)
+                                          for chip, count in self.router_load.items()),
+                "link_packets":      dict(("{},{}-{},{}".format(*(link[0] + link[1])), count)
+                                          for link, count in self.link_load.items())}
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Predicts a machine of cores cores (a multiple of 16) whose rows are drawn from unique values
+with a zipf skew and split evenly. The rings do not share packets, so sample_rings sampled rings
+stand for all of them: the slowest gives the completion time, the mean the load'''
+def predict_machine(cores, rows, unique, skew, parameters=None, sample_rings=3):
+
+    if cores % RING_SIZE != 0:
+        raise Exception("{} cores do not make rings of {}".format(cores, RING_SIZE))
+
+    parameters    = parameters or ModelParameters()
+    rings         = cores // RING_SIZE
+    rows_per_core = max(rows // cores, 1)
+    chip_width    = int(math.ceil(math.sqrt(int(math.ceil(cores / float(parameters.cores_per_chip))))))
+
+    predictions = []
+    distinct    = []
+    for ring in range(0, min(rings, sample_rings)):
+        statistics = synthetic_ring_statistics(rows_per_core, unique, skew, seed=ring)
+        model = RingModel(statistics, parameters, ring * RING_SIZE, chip_width).run()
+        predictions.append(model.prediction())
+        distinct.append(sum(core["new_distinct"] for core in statistics))
+
+    time  = max(prediction["time_to_result_us"] for prediction in predictions)
+    sent  = [sum(counters.get("sent_ring", 0) + counters.get("sent_other", 0)
+                 for counters in prediction["counters"]) for prediction in predictions]
+    peaks = [max(prediction["router_packets"].values()) for prediction in predictions]
+    links = [max(prediction["link_packets"].values() or [0]) for prediction in predictions]
+
+    return {"cores":                  cores,
+            "rings":                  rings,
+            "rows_per_core":          rows_per_core,
+            "time_to_result_us":      time,
+            "packets_sent":           int(round(float(sum(sent)) / len(sent) * rings)),
+            "router_packets_max":     max(peaks),
+            "router_packets_per_s":   max(peaks) / (time / 1e6) if time else 0,
+            "link_packets_max":       max(links),
+            "distinct_per_ring":      distinct}
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Measured against predicted, one entry per counter of the PROFILE regions (see
+Vertex.decode_profile) of a ring, and the time to the result if it was measured on a board'''
+def validate(prediction, profiles, time_to_result_us=None):
+
+    comparison = {}
+    for name in ["sent_ring", "sent_other", "received_ring", "received_command",
+                 "received_other", "searches", "search_probes"]:
+        measured  = sum(profile[name] for profile in profiles)
+        predicted = sum(counters.get(name, 0) for counters in prediction["counters"])
+        comparison[name] = {"measured": measured, "predicted": int(round(predicted)),
+                            "ratio": predicted / float(measured) if measured else None}
+
+    if time_to_result_us is not None:
+        comparison["time_to_result_us"] = {
+            "measured": time_to_result_us, "predicted": prediction["time_to_result_us"],
+            "ratio": prediction["time_to_result_us"] / float(time_to_result_us)}
+
+    return comparison
+
+'''-----------------------------------------------------------------------------------------'''
@@ -0,0 +1,61 @@
+"""
+Decoding of the result blocks recorded by vertex.c
+"""
+
+import struct
+
+'''number of fields and payload bytes at the start of every block'''
+BLOCK_HEADER = struct.Struct("<HH")
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Yields (number of fields, payload) for every block in the output of one core'''
+def read_blocks(raw):
+
+    offset = 0
+    while offset + BLOCK_HEADER.size <= len(raw):
+
+        num_fields, num_bytes = BLOCK_HEADER.unpack_from(raw, offset)
+        offset = offset + BLOCK_HEADER.size
+
+        yield num_fields, raw[offset:offset + num_bytes]
+        offset = offset + num_bytes
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Returns all integers recorded by one core - every block is unpacked in one go'''
+def decode_ints(raw):
+
+    values = []
+    for num_fields, payload in read_blocks(raw):
+        values.extend(struct.unpack_from("<{}I".format(num_fields), payload))
+
+    return values
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Returns the records of one core as tuples - layout has one character per field,
+'s' for a string and 'i' for an integer, e.g. "si" for the histogram'''
+def decode_records(raw, layout):
+
+    if 's' not in layout:
+        fields = decode_ints(raw)
+    else:
+        fields = []
+        for num_fields, payload in read_blocks(raw):
+
+            offset = 0
+            for field in range(0, num_fields):
+
+                if layout[len(fields) % len(layout)] == 's':
+                    length = payload[offset]
+                    fields.append(str(payload[offset + 1:offset + 1 + length]))
+                    offset = offset + 1 + length
+                else:
+                    fields.append(struct.unpack_from("<I", payload, offset)[0])
+                    offset = offset + 4
+
+    size = len(layout)
+    return [tuple(fields[i:i + size]) for i in range(0, len(fields) - size + 1, size)]
+
+'''-----------------------------------------------------------------------------------------'''
@@ -0,0 +1,73 @@
+"""
+Deterministic replay of one core - the packets its capture region holds (see capture_packet in
+vertex.c) are fed to that core alone on the native emulator, in the ticks it handled them in
+"""
+
+import os
+import struct
+import subprocess
+
+'''capacity, packets received - then every packet: tick, key, payload'''
+CAPTURE_HEADER = struct.Struct("<II")
+CAPTURE_PACKET = struct.Struct("<III")
+
+'''the tick count of vertex.c before its first tick'''
+TICK_BEFORE_START = 0xFFFFFFFF
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Packets of one capture region in the order they were handled: (tick, key, payload), and the
+number received - more than the packets if the capture was cut short'''
+def decode_capture(raw):
+
+    raw = str(raw)
+    capacity, received = CAPTURE_HEADER.unpack_from(raw, 0)
+
+    packets = [CAPTURE_PACKET.unpack_from(raw, CAPTURE_HEADER.size + i * CAPTURE_PACKET.size)
+               for i in range(0, min(capacity, received))]
+
+    return packets, received
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Writes a capture region as read from the board, the file the emulator replays'''
+def write_capture(filename, raw):
+
+    with open(filename, 'wb') as capture:
+        capture.write(str(raw))
+
+    return filename
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Runs the core of placement from the machine image (see utilities/emulation.py) on its captured
+packets and leaves its recordings, regions and iobuf in directory. The image must be written
+from the graph the capture was taken with'''
+def replay(emulator, application, image, placement, capture_file, directory, stats=None):
+
+    command = [emulator, "-R", "{},{},{}:{}".format(placement.x, placement.y, placement.p,
+                                                    os.path.abspath(capture_file))]
+    if stats is not None:
+        command = command + ["-s", stats]
+
+    return subprocess.check_output(command + [application, image, directory])
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Index of the first packet the replay handled in another tick or order than the capture,
+None if both agree - the replayed core captures again if its capture region is on'''
+def first_divergence(captured, replayed):
+
+    captured_packets, _ = decode_capture(captured)
+    replayed_packets, _ = decode_capture(replayed)
+
+    for index, (original, again) in enumerate(zip(captured_packets, replayed_packets)):
+        if original != again:
+            return index
+
+    if len(captured_packets) != len(replayed_packets):
+        return min(len(captured_packets), len(replayed_packets))
+
+    return None
+
+'''-----------------------------------------------------------------------------------------'''
@@ -0,0 +1,40 @@
+"""
+Ring buffers of the cores - the trace and the log regions (see trace_event and log_record in
+vertex.c) share a header and start every entry with the tick and the cycles into it
+"""
+
+import struct
+
+'''capacity, entries written, timer period (us)'''
+RING_HEADER = struct.Struct("<III")
+
+'''timer 2 counts cpu cycles'''
+CLOCK_MHZ = 200
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Entries of one ring buffer region, oldest first: (microseconds since the start, the fields of
+the entry after the tick and the cycles). entry is the struct of an entry. A full buffer holds
+the newest capacity entries'''
+def decode_ring(raw, entry):
+
+    raw = str(raw)
+    capacity, written, timer_period = RING_HEADER.unpack_from(raw, 0)
+
+    if written > capacity:
+        order = [(written + i) % capacity for i in range(0, capacity)]
+    else:
+        order = range(0, written)
+
+    entries = []
+    for slot in order:
+        fields = entry.unpack_from(raw, RING_HEADER.size + slot * entry.size)
+        tick, cycles = fields[0:2]
+
+        #tick 1 starts at 0, the entries before the first tick at the very start
+        time = max(tick - 1, 0) * timer_period + cycles / float(CLOCK_MHZ)
+        entries.append((time, fields[2:]))
+
+    return entries
+
+'''-----------------------------------------------------------------------------------------'''
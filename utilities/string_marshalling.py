@@ -1,3 +1,5 @@
+import struct
+
 '''Convert binary number to decimal'''
 def anyBinaryToDecimal(binary):
     result = 0
@@ -128,57 +130,56 @@ def _32intarray_to_four_8bitchars(_32_int_arr):
 def convert_string_to_integer_parcel(string, bytes_per_string):
     
     '''size is the number of bytes that every string gets'''
-    
-    ascii     = []
-    count     = 0
-    
-    #produce array of ascii characters
-    for char in string:    
-        ascii.append(ord(char))
-        count = count + 1
-       
-    while count < bytes_per_string:
-        ascii.append(32) #32 is the ascii for space
-        count = count + 1
-    
-    #convert each element of the ascii array to a bit array of size 8
-    ascii_byte_arr = []
-    for index1 in range(0, bytes_per_string):
-        ascii_byte_arr.append(_32int_to_8bitarray(ascii[index1]))
-    
-    #now take 4 8-bit arrays each and construct an integer
-    #the integer is then put into an array of size bytes_per_string/4
-    #This saves 75% of memory space
-    parcel    = []
-    for index2 in range(0, bytes_per_string/4):
-        
-        start = index2*4
-        
-        _4_8bit_arrays = []
-        _4_8bit_arrays.append(ascii_byte_arr[start+0])
-        _4_8bit_arrays.append(ascii_byte_arr[start+1])
-        _4_8bit_arrays.append(ascii_byte_arr[start+2])
-        _4_8bit_arrays.append(ascii_byte_arr[start+3]) 
-     
-        _32bit_array = _four_8bitarrays_to_32intarray(_4_8bit_arrays)
-        parcel.append(_32intarray_to_int(_32bit_array))
-    
-    return parcel
+    return pack_string_column([string], bytes_per_string)
 
 '''-----------------------------------------------------------------------------------------'''   
 '''Undoes convert_string_to_integer_parcel(string, bytes_per_string)'''
 def convert_integer_parcel_to_string(integer_array, num_chars):
     
-    array_of_32bit_arrays = []
+    return unpack_string_column(integer_array[0:num_chars/4], num_chars)[0]
+
+'''-----------------------------------------------------------------------------------------'''   
+'''BULK CONVERSION <->'''
+'''
+Pads (with spaces) or cuts a string to bytes_per_string characters - characters outside
+of the 8 bit range become spaces'''
+def _pad_string(string, bytes_per_string):
+    
+    if isinstance(string, unicode):
+        string = ''.join(char if ord(char) < 256 else ' ' for char in string).encode('latin-1')
+        
+    return string[0:bytes_per_string].ljust(bytes_per_string, ' ')
+
+'''-----------------------------------------------------------------------------------------'''   
+'''
+Converts a whole column of strings into the big endian words vertex.c expects, 
+bytes_per_string/4 words per string, in one pass'''
+def pack_string_column(strings, bytes_per_string):
+    
+    words_per_string = bytes_per_string/4
+    string_bytes     = words_per_string*4
+    
+    blob = ''.join([_pad_string(string, bytes_per_string)[0:string_bytes] for string in strings])
     
-    #convert integers into their bit representation
-    for i in integer_array:
-        array_of_32bit_arrays.append(_32int_to_32bitarray(i))
+    return list(struct.unpack(">{}I".format(len(strings)*words_per_string), blob))
 
-    original_string = ''
-    for index1 in range(0,num_chars/4):   
-        _4char_parcel = _32intarray_to_four_8bitchars(array_of_32bit_arrays[index1])
-        string = ''.join(_4char_parcel)
-        original_string = original_string + string
+'''-----------------------------------------------------------------------------------------'''   
+'''
+Same as pack_string_column but returns the bytes as they end up in SDRAM (little endian words)'''
+def pack_string_column_image(strings, bytes_per_string):
+    
+    words = pack_string_column(strings, bytes_per_string)
+    
+    return struct.pack("<{}I".format(len(words)), *words)
 
-    return original_string
+'''-----------------------------------------------------------------------------------------'''   
+'''
+Undoes pack_string_column(strings, bytes_per_string) - the strings keep their padding'''
+def unpack_string_column(words, bytes_per_string):
+    
+    words_per_string = bytes_per_string/4
+    string_bytes     = words_per_string*4
+    
+    blob = struct.pack(">{}I".format(len(words)), *words)
+    
+    return [blob[start:start + string_bytes] for start in range(0, len(blob), string_bytes)]
@@ -0,0 +1,70 @@
+"""
+Synthetic datasets for the benchmarks - a csv with one string column whose row count,
+number of distinct values, skew and string length are given
+"""
+
+import bisect
+import csv
+import random
+
+'''digits of the generated values - any value fits the string columns of the vertices'''
+ALPHABET = "0123456789ABCDEFGHIJKLMNOPQRSTUVWXYZ"
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Value number index, string_length characters long - distinct for distinct indices'''
+def synthetic_value(index, string_length):
+
+    digits = []
+    rest   = index
+    while rest > 0 or not digits:
+        rest, digit = divmod(rest, len(ALPHABET))
+        digits.append(ALPHABET[digit])
+
+    if len(digits) > string_length:
+        raise Exception("{} characters cannot hold value {}".format(string_length, index))
+
+    return "V" * (string_length - len(digits)) + "".join(reversed(digits))
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Draws value indices 0..unique-1, index k with a probability proportional to 1/(k+1)^skew
+(skew 0 - every value equally likely)'''
+class ZipfSampler(object):
+
+    def __init__(self, unique, skew, seed=0):
+
+        self.random     = random.Random(seed)
+        self.cumulative = []
+
+        total = 0.0
+        for rank in range(1, unique + 1):
+            total = total + 1.0 / rank ** skew
+            self.cumulative.append(total)
+
+    def sample(self):
+        return bisect.bisect_right(self.cumulative, self.random.random() * self.cumulative[-1])
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Writes rows values drawn from unique distinct ones to filename, with a header like the csv
+files in resources/. The same arguments always give the same file'''
+def write_synthetic_csv(filename, rows, unique, skew, string_length, seed=0):
+
+    if len(ALPHABET) ** string_length < unique:
+        raise Exception("{} distinct values do not fit in {} characters".format(unique, string_length))
+
+    sampler = ZipfSampler(unique, skew, seed)
+    values  = [synthetic_value(index, string_length) for index in range(0, unique)]
+
+    with open(filename, 'wb') as csvfile:
+
+        writer = csv.writer(csvfile, delimiter=',', quotechar='|')
+        writer.writerow(["Value"])
+
+        for _ in xrange(rows):
+            writer.writerow([values[min(sampler.sample(), unique - 1)]])
+
+    return filename
+
+'''-----------------------------------------------------------------------------------------'''
@@ -0,0 +1,80 @@
+"""
+Phase timelines - the trace regions of all cores (see trace_event in vertex.c) merged into one
+Chrome trace, which chrome://tracing and ui.perfetto.dev open
+"""
+
+from utilities.ring_buffer import decode_ring
+
+import json
+import struct
+
+'''after the ring header every event: tick, cycles since its start, event'''
+TRACE_EVENT  = struct.Struct("<III")
+
+TRACE_BEGIN, TRACE_END, TRACE_LEADER, TRACE_ROUND, TRACE_TIMEOUT = range(0, 5)
+
+PHASE_NAMES = {0: "resident", 1: "count", 2: "index", 3: "histogram", 4: "sort",
+               5: "membership", 6: "append", 7: "record"}
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Events of one trace region, oldest first: (microseconds since the start, event, argument).
+A full buffer holds the newest capacity events'''
+def decode_trace(raw):
+
+    return [(time, word >> 24, word & 0xFFFFFF)
+            for time, (word,) in decode_ring(raw, TRACE_EVENT)]
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Writes the Chrome trace of traces, a list of (placement, raw trace region): a process for
+every chip, a thread for every core, phases as slices and the other events as instants.
+The leader of each ring is a counter of its first core'''
+def write_chrome_trace(filename, traces):
+
+    trace_events = []
+    chips        = set()
+
+    for placement, raw in traces:
+
+        pid = placement.x * 256 + placement.y
+        tid = placement.p
+
+        if pid not in chips:
+            chips.add(pid)
+            trace_events.append({"name": "process_name", "ph": "M", "pid": pid,
+                                 "args": {"name": "chip {}, {}".format(placement.x, placement.y)}})
+        trace_events.append({"name": "thread_name", "ph": "M", "pid": pid, "tid": tid,
+                             "args": {"name": "core {}".format(placement.p)}})
+
+        open_phases = []
+        for time, event, argument in decode_trace(raw):
+
+            entry = {"pid": pid, "tid": tid, "ts": time}
+
+            if event == TRACE_BEGIN:
+                entry.update({"name": PHASE_NAMES.get(argument, str(argument)), "ph": "B"})
+                open_phases.append(entry["name"])
+            elif event == TRACE_END:
+                #a wrapped buffer may have lost the beginning
+                if not open_phases:
+                    continue
+                entry.update({"name": open_phases.pop(), "ph": "E"})
+            elif event == TRACE_LEADER:
+                trace_events.append({"name": "leader", "ph": "C", "pid": pid, "ts": time,
+                                     "args": {"core": argument}})
+                entry.update({"name": "leader {}".format(argument), "ph": "i", "s": "t"})
+            elif event == TRACE_ROUND:
+                entry.update({"name": "round", "ph": "i", "s": "t", "args": {"id": argument}})
+            elif event == TRACE_TIMEOUT:
+                entry.update({"name": "timeout", "ph": "i", "s": "t",
+                              "args": {"ticks": argument}})
+            else:
+                continue
+
+            trace_events.append(entry)
+
+    with open(filename, 'w') as trace_file:
+        json.dump({"traceEvents": trace_events, "displayTimeUnit": "ms"}, trace_file)
+
+'''-----------------------------------------------------------------------------------------'''
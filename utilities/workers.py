@@ -0,0 +1,75 @@
+"""
+Host workers - packing the partitions and extracting the results run next to each other
+while the results keep the order in which the work was handed out
+"""
+
+from multiprocessing.pool import ThreadPool
+
+import multiprocessing
+
+'''worker processes for the packing and decoding, 1 -> everything stays in this process'''
+WORKERS = multiprocessing.cpu_count()
+
+'''threads that wait for the machine at the same time'''
+FETCH_THREADS = 8
+
+_pool = None
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Pool of worker processes, created on first use (None if there is only one worker)'''
+def pool():
+
+    global _pool
+    if _pool is None and WORKERS > 1:
+        _pool = multiprocessing.Pool(WORKERS)
+
+    return _pool
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+Stops the worker processes'''
+def close():
+
+    global _pool
+    if _pool is not None:
+        _pool.close()
+        _pool.join()
+        _pool = None
+
+'''-----------------------------------------------------------------------------------------'''
+
+def _call(work):
+
+    function, item, args = work
+    return function(item, *args)
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+function(item, *args) for every item in the worker processes - function has to be defined at
+module level. The results are in the order of items'''
+def parallel_map(function, items, *args):
+
+    workers = pool()
+    if workers is None or len(items) < 2:
+        return [function(item, *args) for item in items]
+
+    return workers.map(_call, [(function, item, args) for item in items], chunksize=1)
+
+'''-----------------------------------------------------------------------------------------'''
+'''
+function(item) for every item in threads of this process - for work that waits on the machine
+rather than the cpu. The results are in the order of items'''
+def parallel_fetch(function, items):
+
+    if len(items) < 2:
+        return [function(item) for item in items]
+
+    threads = ThreadPool(min(FETCH_THREADS, len(items)))
+    try:
+        return threads.map(function, items, chunksize=1)
+    finally:
+        threads.close()
+        threads.join()
+
+'''-----------------------------------------------------------------------------------------'''